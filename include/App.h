@@ -30,9 +30,10 @@ class App
         LOG_DEBUG("parsing asset done")
 
         // 2. render
+        mainRenderer.setResourceManager(resourceManager);
         mainRenderer.render(mainScene, fb, db);
 
         // 3. save & show framebuffer
-        fileIO::writePPM("output.ppm", fb.width, fb.height, fb.color);
+        fileIO::writePPM("output.ppm", fb);
     }
 };
@@ -5,6 +5,7 @@
 #include "scene.h"
 #include <filesystem>
 #include <expected>
+#include <optional>
 #include <string>
 #include <variant>
 #include <span>
@@ -64,6 +65,7 @@ namespace asset
         };
 
         using LightConfig = scene::Light;
+        using SettingsConfig = scene::Settings;
 
         struct GeometryConfig
         {
@@ -95,16 +97,18 @@ namespace asset
             std::vector<MaterialConfig> materials;
             std::vector<GeometryConfig> geometries;
             std::vector<ObjectConfig>   objects;
+            SettingsConfig              settings;
         };
 
         // one instance per one file
         // file명은 caller가 추가해서 전체 Materialkey를 완성해야 함
+        // texture maps are paths relative to the mtl file, loaded by the caller
         struct MaterialEntry
         {
-            std::string_view name;
-            core::Material   material;
+            core::Material material;
+            std::string    baseColorMap; // map_Kd, empty: none
         };
-        using MaterialEntries = std::unordered_map<std::string_view, core::Material>;
+        using MaterialEntries = std::unordered_map<std::string, MaterialEntry>;
 
         enum class PixelFormat
         {
@@ -147,9 +151,13 @@ namespace asset
         // load & parsing
         Result<parser::SceneConfig> loadSceneConfig(const fs::path &jsonPath);
         Result<core::Mesh>          loadMesh(const fs::path &objPath);
-        Result<core::Material>      loadMaterial(const fs::path &mtlPath, std::string_view name);
+        Result<parser::MaterialEntry>   loadMaterial(const fs::path &mtlPath, std::string_view name);
         Result<parser::MaterialEntries> loadMaterialList(const fs::path &mtlPath);
         Result<parser::ImageBuffer>     loadImage(const fs::path &imgPath);
+        // image -> texture with its mip chain; format: the smallest one that keeps the
+        // image unless given (e.g. RG8 for a normal map)
+        Result<core::Texture> loadTexture(const fs::path                      &imgPath,
+                                          std::optional<core::Texture::Format> format = {});
 
     } // namespace loader
 } // namespace asset
@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <cstdint>
+
+// BCn block codecs: one 4x4 block <-> 16 RGBA8 texels in raster order (y * 4 + x)
+namespace bcn
+{
+    // 8 bytes: rgb 565 endpoints + 2 bit indices, 1 bit alpha
+    void decodeBC1(const uint8_t *block, uint8_t out[16][4]);
+    void encodeBC1(const uint8_t in[16][4], uint8_t *block);
+
+    // 16 bytes: BC4 alpha + BC1 color (always four colors)
+    void decodeBC3(const uint8_t *block, uint8_t out[16][4]);
+    void encodeBC3(const uint8_t in[16][4], uint8_t *block);
+
+    // 16 bytes: BC4 red + BC4 green, decodes to (r, g, 0, 255)
+    void decodeBC5(const uint8_t *block, uint8_t out[16][4]);
+    void encodeBC5(const uint8_t in[16][4], uint8_t *block);
+
+    // 16 bytes: every mode decodes; the encoder writes mode 6 (one subset, rgba 7.7.7.7
+    // endpoints with p-bits, 4 bit indices)
+    void decodeBC7(const uint8_t *block, uint8_t out[16][4]);
+    void encodeBC7(const uint8_t in[16][4], uint8_t *block);
+} // namespace bcn
@@ -1,6 +1,9 @@
 ﻿#pragma once
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include "math/vec.h" // math::Vec3, Vec4 사용 시
 
 namespace color {
@@ -33,4 +36,50 @@ inline math::Vec4 linearToSrgb(math::Vec4 c) noexcept {
     return { linearToSrgb(c.x), linearToSrgb(c.y), linearToSrgb(c.z), c.w };
 }
 
+// 8 bit 변환: pow 없이 테이블로 (texel decode / encode 마다 호출됨)
+
+// sRGB byte -> linear, 256 entries
+const float *srgb8ToLinearTable() noexcept;
+
+inline float srgb8ToLinear(uint8_t s) noexcept {
+    return srgb8ToLinearTable()[s];
+}
+
+// linear -> sRGB byte, rounded to nearest like linearToSrgb(l) * 255 + 0.5.
+// [2^-12, 1) is split into 256 buckets per octave (bucket 0: below 2^-12); a bucket is
+// narrower than half a step, so it holds its first code and where the next one starts.
+struct LinearToSrgb8Table {
+    static constexpr int      kBuckets = 12 * 256 + 1;
+    static constexpr uint32_t kFirst = (127 - 12) << 8; // top bits of 2^-12, bucket 1
+    static constexpr float    kBelowOne = 0.99999994f;
+
+    float   threshold[kBuckets];
+    uint8_t code[kBuckets + 3]; // padded for 32 bit gathers
+};
+const LinearToSrgb8Table &linearToSrgb8Table() noexcept;
+
+inline uint8_t linearToSrgb8(float l) noexcept {
+    using T = LinearToSrgb8Table;
+    const T &t = linearToSrgb8Table();
+    l = l > 0.0f ? std::min(l, T::kBelowOne) : 0.0f; // NaN -> 0
+    const int i = std::max(int(std::bit_cast<uint32_t>(l) >> 15) - int(T::kFirst) + 1, 0);
+    return uint8_t(t.code[i] + (l >= t.threshold[i]));
+}
+
+// 배열 단위 (AVX2: 8개씩)
+void srgb8ToLinear(const uint8_t *in, float *out, size_t count) noexcept;
+void linearToSrgb8(const float *in, uint8_t *out, size_t count) noexcept;
+
+// 톤 매핑: HDR linear [0, inf) -> [0,1]
+inline float reinhard(float x) noexcept {
+    x = std::max(x, 0.0f);
+    return x / (1.0f + x);
+}
+
+// ACES filmic, Narkowicz fit
+inline float acesFilm(float x) noexcept {
+    x = std::max(x, 0.0f);
+    return std::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+}
+
 } // namespace color
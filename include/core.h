@@ -1,9 +1,12 @@
 ﻿#pragma once
 #include "handle.h"
 #include "math/math.h"
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <algorithm>
+#include <bit>
 #include <expected>
 
 namespace core
@@ -44,6 +47,10 @@ namespace core
         MaterialHandle material;
         uint32_t       idxStart;
         uint32_t       idxEnd;
+        uint32_t       vtxStart; // vertices referenced by [idxStart, idxEnd)
+        uint32_t       vtxEnd;   // (empty range: whole mesh)
+        math::AABB     bounds;   // local space, empty: unknown
+        math::Sphere   sphere;
     };
 
     struct Mesh
@@ -51,15 +58,80 @@ namespace core
         std::vector<Submesh>  subs;
         std::vector<Vertex>   vertices;
         std::vector<uint32_t> indices;
-        // TODO: AABB 등 최적화용 자료구조 추가
+        math::AABB            bounds; // local space, empty: unknown
+        math::Sphere          sphere;
     };
 
+    // How a texture is read, kept apart from its texels: one texture can be bound with
+    // different addressing / filtering, like a GPU sampler object.
+    struct Sampler
+    {
+        enum class Wrap
+        {
+            Repeat, // tiles
+            Clamp,  // edge texels stretch out
+            Mirror  // every other tile flipped
+        };
+        enum class Filter
+        {
+            Nearest, // one texel
+            Bilinear // 2x2 texels
+        };
+        enum class Mip
+        {
+            None,    // level 0 only
+            Nearest, // the nearest level
+            Linear   // between the two nearest levels (trilinear with Bilinear)
+        };
+
+        Wrap   wrapU = Wrap::Repeat;
+        Wrap   wrapV = Wrap::Repeat;
+        Filter filter = Filter::Bilinear;
+        Mip    mip = Mip::Linear;
+    };
+
+    // sample8 / sample16 results, one array per channel
+    template <int N> struct Texels
+    {
+        alignas(64) float r[N];
+        alignas(64) float g[N];
+        alignas(64) float b[N];
+        alignas(64) float a[N];
+    };
+
+    // Texels of the whole mip chain, level 0 first, encoded in one of the packed formats.
+    // Every level is stored in 4x4 tiles, row-major over the tiles and Z-order (Morton)
+    // inside one: a bilinear footprint lands in one tile most of the time (64 bytes for
+    // RGBA8), and a minified or rotated surface walks a few tiles instead of striding
+    // over rows. In the BCn formats a tile is one compressed block.
     struct Texture
     {
-        int                     width = 0;
-        int                     height = 0;
-        std::vector<math::Vec4> data; // RGBA
+        static constexpr int kTile = 4;
+
+        struct Level
+        {
+            int    width, height;
+            int    tilesX; // tiles per row
+            size_t offset; // first texel in data, in texels
+        };
 
+        // texels decode to linear RGBA
+        enum class Format
+        {
+            RGBA32F,   // 16 bytes
+            RGBA16F,   // 8 bytes, half floats (HDR)
+            RGBA8,     // 4 bytes, UNORM
+            RGBA8Srgb, // 4 bytes, sRGB rgb + linear alpha
+            RG8,       // 2 bytes, UNORM (r, g, 0, 1), normal maps
+            R8,        // 1 byte, UNORM (r, r, r, 1), occlusion / gray
+            BC1,       // 8 bytes per 4x4 block, rgb + 1 bit alpha
+            BC1Srgb,   // BC1, sRGB rgb
+            BC3,       // 16 bytes per block, rgb + alpha
+            BC3Srgb,   // BC3, sRGB rgb
+            BC5,       // 16 bytes per block, (r, g, 0, 1), normal maps
+            BC7,       // 16 bytes per block, rgba
+            BC7Srgb    // BC7, sRGB rgb
+        };
         enum class Origin
         {
             TopLeft,
@@ -70,13 +142,99 @@ namespace core
             Straight,
             Premultiplied
         };
+        static constexpr int bytesPerTexel(Format f)
+        {
+            switch (f)
+            {
+            case Format::RGBA32F:
+                return 16;
+            case Format::RGBA16F:
+                return 8;
+            case Format::RGBA8:
+            case Format::RGBA8Srgb:
+                return 4;
+            case Format::RG8:
+                return 2;
+            case Format::R8:
+                return 1;
+            default: // block compressed
+                return 0;
+            }
+        }
+        static constexpr bool isCompressed(Format f) { return bytesPerTexel(f) == 0; }
+        static constexpr int  bytesPerTile(Format f)
+        {
+            if (!isCompressed(f))
+                return bytesPerTexel(f) * kTile * kTile;
+            return f == Format::BC1 || f == Format::BC1Srgb ? 8 : 16;
+        }
+
+        int                  width = 0;
+        int                  height = 0;
+        Format               format = Format::RGBA32F;
+        std::vector<uint8_t> data;         // encoded texels, tiled, every level
+        std::vector<Level>   levels;       // levels[0]: width x height
+        uint64_t             revision = 0; // new with every encoding, keys the block cache
 
         Origin    origin = Origin::TopLeft;    // 옵션
         AlphaMode alpha = AlphaMode::Straight; // 옵션
 
-        // todo: 추후 샘플러 분리 고려 (clamp, repeat, mirror)
-        math::Vec4 sample(int u, int v) const { return data[width * v + u]; }
-        math::Vec4 sample(math::Vec2 uv) const { return data[width * uv.y + uv.x]; }
+        // level 0 of w x h zero texels, drops any mip levels
+        void create(int w, int h, Format f);
+        // level 0 from row-major linear texels (first row at origin)
+        void assign(int w, int h, const math::Vec4 *texels, Format f = Format::RGBA32F);
+        // 2x2 box filter down to 1x1, averaged in linear space (before compress())
+        void generateMips();
+        // every level re-encoded in the block format f
+        void compress(Format f);
+
+        size_t index(int level, int x, int y) const
+        {
+            const Level &l = levels[level];
+            const int    inTile = (x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2;
+            return l.offset + size_t((y >> 2) * l.tilesX + (x >> 2)) * 16 + inTile;
+        }
+        // encoded texel, or the block holding it
+        size_t byteOffset(int level, int x, int y) const
+        {
+            const size_t i = index(level, x, y);
+            return (i >> 4) * bytesPerTile(format) + (i & 15) * bytesPerTexel(format);
+        }
+        uint8_t       *bytes(int level, int x, int y) { return &data[byteOffset(level, x, y)]; }
+        const uint8_t *bytes(int level, int x, int y) const
+        {
+            return &data[byteOffset(level, x, y)];
+        }
+        math::Vec4 texel(int level, int x, int y) const;
+        // uncompressed formats only
+        void store(int level, int x, int y, const math::Vec4 &c);
+        // store() of a whole row of level, width texels
+        void storeRow(int level, int y, const math::Vec4 *texels);
+
+        // uv: v up (obj), addressed by the sampler's wrap modes
+        math::Vec4 sample(int u, int v) const { return texel(0, u, v); }
+        math::Vec4 sample(const Sampler &s, math::Vec2 uv) const { return sampleLod(s, uv, 0.0f); }
+        // filtered at the footprint of a pixel: dx, dy = uv change per pixel step
+        math::Vec4 sample(const Sampler &s, math::Vec2 uv, math::Vec2 dx, math::Vec2 dy) const
+        {
+            return sampleLod(s, uv, lod(dx, dy));
+        }
+        math::Vec4 sampleLod(const Sampler &s, math::Vec2 uv, float lod) const;
+
+        // A SIMD group of fragments at once: u, v, lod per fragment (lod from lod(dx, dy)).
+        // Uncompressed formats gather all lanes' texels with AVX2 (RGBA16F also needs
+        // F16C); block compressed ones, and builds without AVX2, filter lane by lane.
+        void sample8(const Sampler &s, const float *u, const float *v, const float *lod,
+                     Texels<8> &out) const;
+        void sample16(const Sampler &s, const float *u, const float *v, const float *lod,
+                      Texels<16> &out) const;
+
+        float      lod(math::Vec2 dx, math::Vec2 dy) const;
+        math::Vec4 filtered(const Sampler &s, int level, math::Vec2 uv) const;
+
+      private:
+        void sampleBatch(const Sampler &s, const float *u, const float *v, const float *lod,
+                         float *r, float *g, float *b, float *a) const;
     };
 
     // 우선 Emmisive는 자체 발광만 함 (주변 사물에 영향x)
@@ -96,67 +254,417 @@ namespace core
         TextureHandle baseColorTex{};
         TextureHandle normalTex{};
         TextureHandle occlusionTex{};
+        Sampler       sampler{}; // addressing / filtering of the maps
     };
 
-    struct FrameBuffer
+    // pixel order of the color and depth buffers: 8x8 micro-tiles, row-major inside, grouped
+    // row-major into 64x64 tiles, stored row-major; a triangle's footprint stays in a few
+    // cache lines and pages, and a 64x64 tile (a renderer tile at the default size) is one
+    // span of memory. Buffers are padded to whole tiles.
+    struct TiledLayout
     {
-        int                  width, height;
-        std::vector<uint8_t> color; // RGB256
+        static constexpr int kMicro = 8; // micro-tile edge, the raster / Hi-Z block
+        static constexpr int kTile = 64; // tile edge
+
+        int tilesX = 0, tilesY = 0;
+
+        TiledLayout() = default;
+        TiledLayout(int w, int h)
+            : tilesX((w + kTile - 1) / kTile), tilesY((h + kTile - 1) / kTile)
+        {
+        }
 
-        FrameBuffer(int w, int h) : width(w), height(h), color(w * h * 4, 0) {}
+        size_t pixelCount() const { return size_t(tilesX) * tilesY * kTile * kTile; }
 
-        void clear(const math::Vec4 &rgba)
+        // position of pixel (x, y); micro-tile (x / 8, y / 8) is the 64 pixels from
+        // index(x & ~7, y & ~7) on
+        size_t index(int x, int y) const
         {
-            auto    clamp_0_1 = [](float n) { return std::max(0.0f, std::min(n, 1.0f)); };
-            uint8_t r = clamp_0_1(rgba.x) * 255.0f;
-            uint8_t g = clamp_0_1(rgba.y) * 255.0f;
-            uint8_t b = clamp_0_1(rgba.z) * 255.0f;
-            uint8_t a = clamp_0_1(rgba.w) * 255.0f;
+            return (size_t(y >> 6) * tilesX + (x >> 6)) << 12 | size_t(y >> 3 & 7) << 9 |
+                   size_t(x >> 3 & 7) << 6 | size_t(y & 7) << 3 | size_t(x & 7);
+        }
+    };
 
-            for (int i = 0; i < width * height; i++)
+    // micro-tiles overlapping [x0, x1) x [y0, y1) of a TiledLayout image set to the Bpp bytes
+    // of pixel; stores only, the pixels are never read
+    template <int Bpp>
+    void fillTiles(uint8_t *image, const TiledLayout &layout, int x0, int y0, int x1, int y1,
+                   const void *pixel)
+    {
+        // about 64 bytes of whole pixels per store: constant-size copies become vector stores
+        constexpr size_t kChunk = 64 / Bpp * Bpp;
+        constexpr int    kMicro = TiledLayout::kMicro;
+        constexpr size_t kSpan = kMicro * kMicro * Bpp; // one micro-tile
+        uint8_t          pattern[kChunk];
+        for (size_t i = 0; i < kChunk; i += Bpp)
+            std::memcpy(pattern + i, pixel, Bpp);
+
+        for (int y = y0 & ~(kMicro - 1); y < y1; y += kMicro)
+            for (int x = x0 & ~(kMicro - 1); x < x1; x += kMicro)
             {
-                color[i * 4 + 0] = r;
-                color[i * 4 + 1] = g;
-                color[i * 4 + 2] = b;
-                color[i * 4 + 3] = a;
+                uint8_t *p = image + layout.index(x, y) * Bpp;
+                size_t   i = 0;
+                for (; i + kChunk <= kSpan; i += kChunk)
+                    std::memcpy(p + i, pattern, kChunk);
+                std::memcpy(p + i, pattern, kSpan - i);
             }
+    }
+
+    struct FrameBuffer
+    {
+        int                  width, height;
+        TiledLayout          layout;
+        std::vector<uint8_t> color; // RGBA8, layout order; resolve() / linear() for row-major
+
+        FrameBuffer(int w, int h)
+            : width(w), height(h), layout(w, h), color(layout.pixelCount() * 4, 0)
+        {
+        }
+
+        void clear(const math::Vec4 &rgba) { clearRect(0, 0, width, height, rgba); }
+
+        // x0, y0 on micro-tile edges; x1, y1 too, or at the buffer edge (the padding past it
+        // is cleared along)
+        void clearRect(int x0, int y0, int x1, int y1, const math::Vec4 &rgba)
+        {
+            if (x0 >= x1 || y0 >= y1)
+                return;
+            auto          clamp_0_1 = [](float n) { return std::max(0.0f, std::min(n, 1.0f)); };
+            const uint8_t pixel[4] = {uint8_t(clamp_0_1(rgba.x) * 255.0f),
+                                      uint8_t(clamp_0_1(rgba.y) * 255.0f),
+                                      uint8_t(clamp_0_1(rgba.z) * 255.0f),
+                                      uint8_t(clamp_0_1(rgba.w) * 255.0f)};
+            fillTiles<4>(color.data(), layout, x0, y0, x1, y1, pixel);
         }
 
         void writeRGBA(int x, int y, const math::Vec4 &rgba)
         {
-            if (!(0 <= x && x <= width) || !(0 <= y && y <= height))
+            if (!(0 <= x && x < width) || !(0 <= y && y < height))
                 return;
+            writeRGBAUnchecked(x, y, rgba);
+        }
+
+        // (x, y) must be inside the buffer
+        void writeRGBAUnchecked(int x, int y, const math::Vec4 &rgba)
+        {
+            encode(rgba, &color[layout.index(x, y) * 4]);
+        }
+
+        // rgba -> the 4 bytes of a pixel
+        static void encode(const math::Vec4 &rgba, uint8_t *p)
+        {
             auto clamp_0_1 = [](float n) { return std::max(0.0f, std::min(n, 1.0f)); };
-            int  idx = (y * width + x) * 4;
+            p[0] = clamp_0_1(rgba.x) * 255.0f;
+            p[1] = clamp_0_1(rgba.y) * 255.0f;
+            p[2] = clamp_0_1(rgba.z) * 255.0f;
+            p[3] = clamp_0_1(rgba.w) * 255.0f;
+        }
 
-            color[idx + 0] = clamp_0_1(rgba.x) * 255.0f;
-            color[idx + 1] = clamp_0_1(rgba.y) * 255.0f;
-            color[idx + 2] = clamp_0_1(rgba.z) * 255.0f;
-            color[idx + 3] = clamp_0_1(rgba.w) * 255.0f;
+        // row-major RGBA rows of pitch bytes at dst (a file buffer, a locked texture)
+        void resolve(uint8_t *dst, size_t pitch) const
+        {
+            constexpr int kMicro = TiledLayout::kMicro;
+            for (int y = 0; y < height; y++)
+            {
+                uint8_t *row = dst + y * pitch;
+                for (int x = 0; x < width; x += kMicro)
+                    std::memcpy(row + x * 4, &color[layout.index(x, y) * 4],
+                                std::min(kMicro, width - x) * 4);
+            }
+        }
+
+        std::vector<uint8_t> linear() const
+        {
+            std::vector<uint8_t> out(size_t(width) * height * 4);
+            resolve(out.data(), size_t(width) * 4);
+            return out;
         }
     };
 
-    struct DepthBuffer
+    // linear, unclamped color; tone mapped into a FrameBuffer at the end of the frame
+    struct HdrBuffer
     {
-        int                width, height;
-        std::vector<float> depth; // [0 , 1]
+        enum class Format
+        {
+            RGBA16F, // 8 bytes per pixel, half floats
+            RGBA32F  // 16 bytes per pixel
+        };
+
+        int                  width, height;
+        Format               format;
+        TiledLayout          layout;
+        std::vector<uint8_t> color; // pixels in format, layout order
+
+        HdrBuffer(int w, int h, Format f = Format::RGBA16F) { resize(w, h, f); }
+
+        int bytesPerPixel() const { return format == Format::RGBA16F ? 8 : 16; }
+
+        void resize(int w, int h, Format f)
+        {
+            width = w;
+            height = h;
+            format = f;
+            layout = TiledLayout(w, h);
+            color.assign(layout.pixelCount() * bytesPerPixel(), 0);
+        }
+
+        void clear(const math::Vec4 &rgba) { clearRect(0, 0, width, height, rgba); }
+
+        // on micro-tile edges, see FrameBuffer::clearRect
+        void clearRect(int x0, int y0, int x1, int y1, const math::Vec4 &rgba)
+        {
+            if (x0 >= x1 || y0 >= y1)
+                return;
+            uint8_t pixel[16];
+            encode(rgba, pixel);
+            if (format == Format::RGBA32F)
+                fillTiles<16>(color.data(), layout, x0, y0, x1, y1, pixel);
+            else
+                fillTiles<8>(color.data(), layout, x0, y0, x1, y1, pixel);
+        }
 
-        DepthBuffer(int w, int h) : width(w), height(h), depth(w * h, 1.0f) {}
+        // (x, y) must be inside the buffer
+        void writeRGBAUnchecked(int x, int y, const math::Vec4 &rgba)
+        {
+            encode(rgba, &color[layout.index(x, y) * bytesPerPixel()]);
+        }
 
-        void clear(float z) { std::fill(depth.begin(), depth.end(), z); }
+        math::Vec4 readRGBA(int x, int y) const
+        {
+            const uint8_t *p = &color[layout.index(x, y) * bytesPerPixel()];
+            math::Vec4     c;
+            if (format == Format::RGBA32F)
+                std::memcpy(&c, p, sizeof(c));
+            else
+            {
+                uint16_t h[4];
+                std::memcpy(h, p, sizeof(h));
+                math::halfToFloat4(h, &c.x);
+            }
+            return c;
+        }
 
-        bool testAndWrite(int x, int y, float z)
+        // rgba -> the bytesPerPixel() bytes of a pixel
+        void encode(const math::Vec4 &rgba, uint8_t *p) const
         {
-            if (!(0 <= x && x <= width) || !(0 <= y && y <= height))
-                return false;
-            int idx = (y * width) + x;
-            if (z < depth[idx])
+            if (format == Format::RGBA32F)
             {
-                depth[idx] = z;
-                return true;
+                std::memcpy(p, &rgba, sizeof(rgba));
+                return;
             }
-            else
-                return false;
+            uint16_t h[4];
+            math::floatToHalf4(&rgba.x, h);
+            std::memcpy(p, h, sizeof(h));
+        }
+    };
+
+    // depth buffer formats; every format maps depth to a uint32_t key whose unsigned order is
+    // the depth test (smaller = nearer), so Hi-Z and the rasterizer only see keys
+    enum class DepthFormat
+    {
+        D32F,         // float, 0 at the near plane
+        D32FReversed, // float, 1 at the near plane: float precision is densest at the far end
+        D24,          // unorm, 3 bytes per pixel
+        D16           // unorm
+    };
+
+    // raster depth -> key -> depth in the buffer's range, and the key's bytes in the buffer
+    // raster depth is the ndc depth in [0, 1], negated under reversed-Z, so it always grows
+    // with distance
+    template <DepthFormat F>
+    struct DepthCodec;
+
+    template <>
+    struct DepthCodec<DepthFormat::D32F>
+    {
+        static constexpr int kBytes = 4;
+
+        // non-negative floats order like their bits
+        static uint32_t key(float z) { return std::bit_cast<uint32_t>(z > 0.0f ? z : 0.0f); }
+        static float    depth(uint32_t k) { return std::bit_cast<float>(k); }
+        static uint32_t load(const uint8_t *p)
+        {
+            uint32_t k;
+            std::memcpy(&k, p, sizeof(k));
+            return k;
+        }
+        static void store(uint8_t *p, uint32_t k) { std::memcpy(p, &k, sizeof(k)); }
+    };
+
+    // the buffer holds the plain reversed float, whose bits order the other way
+    template <>
+    struct DepthCodec<DepthFormat::D32FReversed>
+    {
+        static constexpr int kBytes = 4;
+
+        static uint32_t key(float z) { return ~DepthCodec<DepthFormat::D32F>::key(-z); }
+        static float    depth(uint32_t k) { return std::bit_cast<float>(~k); }
+        static uint32_t load(const uint8_t *p) { return ~DepthCodec<DepthFormat::D32F>::load(p); }
+        static void     store(uint8_t *p, uint32_t k)
+        {
+            DepthCodec<DepthFormat::D32F>::store(p, ~k);
+        }
+    };
+
+    // little-endian unorm; D24 loads read a byte past the pixel (buffers end with a spare byte)
+    template <int Bits>
+    struct UnormDepthCodec
+    {
+        static constexpr int      kBytes = Bits / 8;
+        static constexpr uint32_t kMax = (1u << Bits) - 1;
+
+        static uint32_t key(float z)
+        {
+            return std::min(uint32_t(std::clamp(z, 0.0f, 1.0f) * float(kMax) + 0.5f), kMax);
+        }
+        static float    depth(uint32_t k) { return float(double(k) / kMax); }
+        static uint32_t load(const uint8_t *p)
+        {
+            uint32_t k = 0;
+            std::memcpy(&k, p, kBytes == 3 ? 4 : kBytes);
+            return k & kMax;
+        }
+        static void store(uint8_t *p, uint32_t k) { std::memcpy(p, &k, kBytes); }
+    };
+
+    template <>
+    struct DepthCodec<DepthFormat::D24> : UnormDepthCodec<24>
+    {
+    };
+
+    template <>
+    struct DepthCodec<DepthFormat::D16> : UnormDepthCodec<16>
+    {
+    };
+
+    // raster depth over an 8x8 block: z at the first pixel center plus a step per pixel
+    struct DepthPlane
+    {
+        float z, dzdx, dzdy;
+
+        // the 64 pixels, row-major; every plane is evaluated here, so a block kept as its
+        // plane and the same block written pixel by pixel hold the same keys
+        void eval(float out[64]) const;
+    };
+
+    struct DepthBuffer
+    {
+        static constexpr int kHiZBlock = 8; // Hi-Z block edge in pixels
+
+        // per Hi-Z block
+        // zmin/zmax: conservative key bounds; min follows every write, max can only shrink
+        // and is refreshed by updateHiZ()
+        // compressed: the pixels are not stored, plane holds the whole block (clears, and
+        // triangles covering every pixel); expand() writes them out before partial writes
+        struct Block
+        {
+            uint32_t   zmin, zmax;
+            DepthPlane plane;
+            bool       compressed;
+        };
+
+        int                  width, height;
+        DepthFormat          format;
+        bool                 compression; // blocks may be kept as planes
+        TiledLayout          layout;      // a Hi-Z block is one micro-tile: 64 adjacent keys
+        std::vector<uint8_t> pixels;      // keys, DepthCodec<format> bytes, layout order
+        int                  hizCols, hizRows;
+        std::vector<Block>   blocks;
+
+        DepthBuffer(int w, int h, DepthFormat f = DepthFormat::D32F, bool compress = true);
+
+        bool  reversedZ() const { return format == DepthFormat::D32FReversed; }
+        float farDepth() const { return reversedZ() ? 0.0f : 1.0f; }
+
+        // depth in the buffer's own range ([0, 1], 1 near under reversed-Z)
+        void clear(float depth) { clearRect(0, 0, width, height, depth); }
+        // x0, y0 on Hi-Z block edges; x1, y1 too, or at the buffer edge
+        // compressed buffers only touch the blocks
+        void clearRect(int x0, int y0, int x1, int y1, float depth);
+
+        // depth of one pixel, compressed blocks included
+        float at(int x, int y) const;
+        // writes out every compressed block, e.g. before reading pixels directly
+        void decompress();
+
+        // D32F buffers without compression: plain floats, floats()[layout.index(x, y)]
+        float       *floats() { return reinterpret_cast<float *>(pixels.data()); }
+        const float *floats() const { return reinterpret_cast<const float *>(pixels.data()); }
+
+        // the 64 keys of block (bx, by), bit (y * 8 + x) at + bit * Codec::kBytes
+        template <class Codec>
+        uint8_t *blockPixels(int bx, int by)
+        {
+            return pixels.data() + layout.index(bx * kHiZBlock, by * kHiZBlock) * Codec::kBytes;
         }
+
+        // block coordinates (pixel / kHiZBlock)
+        Block       &block(int bx, int by) { return blocks[by * hizCols + bx]; }
+        const Block &block(int bx, int by) const { return blocks[by * hizCols + bx]; }
+
+        // compressed block -> pixels
+        template <class Codec>
+        void expand(int bx, int by)
+        {
+            Block &b = block(bx, by);
+            float  z[64];
+            b.plane.eval(z);
+            // edge blocks too: the padding past the buffer edge is allocated
+            uint8_t *p = blockPixels<Codec>(bx, by);
+            for (int i = 0; i < 64; i++)
+                Codec::store(p + i * Codec::kBytes, Codec::key(z[i]));
+            b.compressed = false;
+        }
+
+        // recompute the max of an expanded block after writes into it
+        template <class Codec>
+        void updateHiZ(int bx, int by)
+        {
+            const int x0 = bx * kHiZBlock, w = std::min(kHiZBlock, width - x0);
+            const int y0 = by * kHiZBlock, h = std::min(kHiZBlock, height - y0);
+            const uint8_t *p = blockPixels<Codec>(bx, by);
+            uint32_t       zmax = 0;
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                    zmax = std::max(zmax, Codec::load(p + (y * 8 + x) * Codec::kBytes));
+            block(bx, by).zmax = zmax;
+        }
+
+      private:
+        uint32_t key(float depth) const;
+    };
+
+    // deferred shading: which triangle of which draw covers each pixel
+    struct VisibilityBuffer
+    {
+        static constexpr uint32_t kEmpty = ~uint32_t(0);
+
+        struct Sample
+        {
+            uint32_t triangle; // triangle index in the mesh
+            uint32_t instance; // draw index in the frame
+        };
+
+        int                 width, height;
+        std::vector<Sample> ids;
+
+        VisibilityBuffer(int w, int h) : width(w), height(h), ids(w * h, {kEmpty, kEmpty}) {}
+
+        void resize(int w, int h)
+        {
+            width = w;
+            height = h;
+            ids.assign(w * h, {kEmpty, kEmpty});
+        }
+
+        void clear() { std::fill(ids.begin(), ids.end(), Sample{kEmpty, kEmpty}); }
+        void clearRect(int x0, int y0, int x1, int y1)
+        {
+            for (int y = y0; y < y1; y++)
+                std::fill(&ids[y * width + x0], &ids[y * width + x1], Sample{kEmpty, kEmpty});
+        }
+
+        void          write(int x, int y, Sample s) { ids[y * width + x] = s; }
+        const Sample &at(int x, int y) const { return ids[y * width + x]; }
     };
 } // namespace core
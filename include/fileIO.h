@@ -37,4 +37,7 @@ namespace fileIO
                   bool isRGBA = true);
     bool writePNG(const std::string &path, int width, int height, const std::vector<uint8_t> &color,
                   bool isRGBA = true);
+    // framebuffers are stored tiled: resolved to row-major RGBA here, at the hand-off
+    bool writePPM(const std::string &path, const core::FrameBuffer &fb);
+    bool writePNG(const std::string &path, const core::FrameBuffer &fb);
 } // namespace fileIO
@@ -1,5 +1,7 @@
 ﻿#pragma once
 #include "vec.h"
+#include <cmath>
+#include <cstdint>
 
 namespace math
 {
@@ -19,4 +21,39 @@ inline bool inside_cw(Vec2 v0, Vec2 v1, Vec2 v2, Vec2 p)
 
 	return (w0 > 0.0f && w1 > 0.0f && w2 > 0.0f);
 }
+
+// ----------------------------------
+// fixed point edge (28.4 subpixel)
+// ----------------------------------
+constexpr int kSubpixelBits = 4;
+constexpr int kSubpixelOne = 1 << kSubpixelBits;
+
+inline int32_t to_fixed(float v)
+{
+	return static_cast<int32_t>(std::lround(v * kSubpixelOne));
+}
+
+// edge(v0, v1, p) as a * p.x + b * p.y + c, exact in integers (28.4 in, 24.8 out)
+// stepping one subpixel in x adds a, in y adds b
+// top-left rule: a sample exactly on the edge is inside only for top/left edges,
+// so a pixel on an edge shared by two triangles is covered by exactly one of them
+struct EdgeFx
+{
+	int32_t a, b;
+	int64_t c;
+	int32_t bias; // 1: top-left edge, 0: otherwise
+
+	int64_t eval(int32_t x, int32_t y) const { return int64_t(a) * x + int64_t(b) * y + c; }
+	bool    inside(int64_t e) const { return e + bias > 0; }
+};
+inline EdgeFx edge_fx(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+	EdgeFx e;
+	e.a = y1 - y0;
+	e.b = x0 - x1;
+	e.c = -(int64_t(e.a) * x0 + int64_t(e.b) * y0);
+	// CW with y down: inside normal (a, b) points right for left edges, down for top edges
+	e.bias = (e.a > 0 || (e.a == 0 && e.b > 0)) ? 1 : 0;
+	return e;
+}
 } // namespace math
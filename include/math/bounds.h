@@ -0,0 +1,159 @@
+﻿#pragma once
+#include "mat.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace math
+{
+// axis-aligned box, empty while min > max
+struct AABB
+{
+	Vec3 min{FLT_MAX, FLT_MAX, FLT_MAX};
+	Vec3 max{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+	bool empty() const { return min.x > max.x; }
+	Vec3 center() const { return (min + max) * 0.5f; }
+	Vec3 extent() const { return (max - min) * 0.5f; } // half size
+};
+
+struct Sphere
+{
+	Vec3  center;
+	float radius{-1.0f}; // < 0: empty
+};
+
+inline void expand(AABB &b, Vec3 p)
+{
+	b.min = {std::min(b.min.x, p.x), std::min(b.min.y, p.y), std::min(b.min.z, p.z)};
+	b.max = {std::max(b.max.x, p.x), std::max(b.max.y, p.y), std::max(b.max.z, p.z)};
+}
+inline void expand(AABB &b, const AABB &o)
+{
+	if (o.empty())
+		return;
+	expand(b, o.min);
+	expand(b, o.max);
+}
+
+// sphere around the box center, tight enough for culling and a single pass over points
+template <class It, class Pos> Sphere boundingSphere(const AABB &box, It first, It last, Pos pos)
+{
+	Sphere s;
+	if (box.empty())
+		return s;
+	s.center = box.center();
+	float r2 = 0.0f;
+	for (; first != last; ++first)
+	{
+		const Vec3 d = pos(*first) - s.center;
+		r2 = std::max(r2, dot(d, d));
+	}
+	s.radius = std::sqrt(r2);
+	return s;
+}
+
+// box of a transformed box (affine M, row-vector)
+inline AABB transform(const AABB &b, const Mat4 &M)
+{
+	if (b.empty())
+		return b;
+	const Vec3 c = b.center(), e = b.extent();
+	const Vec4 tc = M.mul_point(c);
+	Vec3       te;
+	te.x = std::fabs(M.m[0][0]) * e.x + std::fabs(M.m[1][0]) * e.y + std::fabs(M.m[2][0]) * e.z;
+	te.y = std::fabs(M.m[0][1]) * e.x + std::fabs(M.m[1][1]) * e.y + std::fabs(M.m[2][1]) * e.z;
+	te.z = std::fabs(M.m[0][2]) * e.x + std::fabs(M.m[1][2]) * e.y + std::fabs(M.m[2][2]) * e.z;
+	return {Vec3{tc.x, tc.y, tc.z} - te, Vec3{tc.x, tc.y, tc.z} + te};
+}
+
+// radius grows by the largest axis scale of M
+inline Sphere transform(const Sphere &s, const Mat4 &M)
+{
+	if (s.radius < 0.0f)
+		return s;
+	const Vec4 c = M.mul_point(s.center);
+	float      k = 0.0f;
+	for (int i = 0; i < 3; i++)
+		k = std::max(k, M.m[i][0] * M.m[i][0] + M.m[i][1] * M.m[i][1] + M.m[i][2] * M.m[i][2]);
+	return {{c.x, c.y, c.z}, s.radius * std::sqrt(k)};
+}
+
+// cone of a spot light: apex p, unit axis d, length range, half angle of cosine cosAngle
+inline Sphere coneBounds(Vec3 p, Vec3 d, float range, float cosAngle)
+{
+	if (cosAngle <= 0.0f)
+		return {p, range};
+	// wider than 45 degrees: the rim circle; narrower: apex and rim on the sphere
+	if (cosAngle < 0.70710678f)
+		return {p + d * (range * cosAngle), range * std::sqrt(1.0f - cosAngle * cosAngle)};
+	const float r = range / (2.0f * cosAngle);
+	return {p + d * r, r};
+}
+
+inline AABB coneBox(Vec3 p, Vec3 d, float range, float cosAngle)
+{
+	AABB b;
+	expand(b, p);
+	// rim circle around the axis
+	const float k = range * std::sqrt(std::max(1.0f - cosAngle * cosAngle, 0.0f));
+	const Vec3  c = p + d * (range * cosAngle);
+	const Vec3  e{k * std::sqrt(std::max(1.0f - d.x * d.x, 0.0f)),
+	              k * std::sqrt(std::max(1.0f - d.y * d.y, 0.0f)),
+	              k * std::sqrt(std::max(1.0f - d.z * d.z, 0.0f))};
+	expand(b, c - e);
+	expand(b, c + e);
+	// the cap bulges past the rim along the axis directions inside the cone
+	const Vec3 axes[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+	for (const Vec3 &a : axes)
+		for (float s : {-1.0f, 1.0f})
+			if (s * dot(a, d) >= cosAngle)
+				expand(b, p + a * (s * range));
+	return b;
+}
+
+// planes (n, d) with |n| = 1, a point p is inside when dot(n, p) + d >= 0
+struct Frustum
+{
+	Vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// planes of a clip matrix (clip = p * M, -w <= x, y, z <= w)
+inline Frustum frustumFromMatrix(const Mat4 &M)
+{
+	auto col = [&](int c) { return Vec4{M.m[0][c], M.m[1][c], M.m[2][c], M.m[3][c]}; };
+	const Vec4 x = col(0), y = col(1), z = col(2), w = col(3);
+
+	Frustum f;
+	f.planes[0] = w + x;
+	f.planes[1] = w - x;
+	f.planes[2] = w + y;
+	f.planes[3] = w - y;
+	f.planes[4] = w + z;
+	f.planes[5] = w - z;
+	for (Vec4 &p : f.planes)
+		p = p / std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+	return f;
+}
+
+// conservative: false only when the box is fully outside one plane
+inline bool intersects(const Frustum &f, const AABB &b)
+{
+	const Vec3 c = b.center(), e = b.extent();
+	for (const Vec4 &p : f.planes)
+	{
+		const float r = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+		if (p.x * c.x + p.y * c.y + p.z * c.z + p.w + r < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+inline bool intersects(const Frustum &f, const Sphere &s)
+{
+	for (const Vec4 &p : f.planes)
+		if (p.x * s.center.x + p.y * s.center.y + p.z * s.center.z + p.w + s.radius < 0.0f)
+			return false;
+	return true;
+}
+} // namespace math
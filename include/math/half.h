@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace math
+{
+// IEEE 754 binary16, stored as its bits
+inline float halfToFloat(uint16_t h)
+{
+	const uint32_t sign = uint32_t(h & 0x8000) << 16;
+	const uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+	if (exp == 0) // zero, subnormal: mant * 2^-24
+		return std::bit_cast<float>(std::bit_cast<uint32_t>(mant * 5.9604645e-8f) | sign);
+	if (exp == 31)
+		return std::bit_cast<float>(sign | 0x7f800000u | mant << 13);
+	return std::bit_cast<float>(sign | (exp + 112) << 23 | mant << 13);
+}
+
+// round to nearest even, overflow to inf
+inline uint16_t floatToHalf(float f)
+{
+	const uint32_t bits = std::bit_cast<uint32_t>(f);
+	const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	const float    a = std::fabs(f);
+	if (std::isnan(f))
+		return sign | 0x7e00;
+	if (a >= 65520.0f) // rounds past the largest half
+		return sign | 0x7c00;
+	if (a < 6.1035156e-5f) // subnormal: multiples of 2^-24
+		return sign | uint16_t(std::nearbyint(a * 16777216.0f));
+	// rebias the exponent, round the mantissa to nearest even
+	uint32_t b = bits & 0x7fffffffu;
+	b += 0x0fffu + ((b >> 13) & 1);
+	return sign | uint16_t((b >> 13) - (112u << 10));
+}
+
+// four at a time (one rgba texel / pixel)
+inline void floatToHalf4(const float *f, uint16_t *h)
+{
+#if defined(__F16C__)
+	const __m128i v = _mm_cvtps_ph(_mm_loadu_ps(f), _MM_FROUND_TO_NEAREST_INT);
+	_mm_storel_epi64(reinterpret_cast<__m128i *>(h), v);
+#else
+	for (int i = 0; i < 4; i++)
+		h[i] = floatToHalf(f[i]);
+#endif
+}
+
+inline void halfToFloat4(const uint16_t *h, float *f)
+{
+#if defined(__F16C__)
+	_mm_storeu_ps(f, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(h))));
+#else
+	for (int i = 0; i < 4; i++)
+		f[i] = halfToFloat(h[i]);
+#endif
+}
+} // namespace math
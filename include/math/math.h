@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include "math/barycentric.h"
+#include "math/bounds.h"
+#include "math/half.h"
 #include "math/mat.h"
 #include "math/projection.h"
 #include "math/transform.h"
@@ -17,43 +17,62 @@ namespace math
         Mat4 R = Mat4::identity();
         R.m[0][0] = r.x;
         R.m[1][0] = r.y;
-        R.m[2][0] = r.y;
+        R.m[2][0] = r.z;
         R.m[0][1] = u.x;
         R.m[1][1] = u.y;
-        R.m[2][1] = u.y;
+        R.m[2][1] = u.z;
         R.m[0][2] = -f.x;
         R.m[1][2] = -f.y;
-        R.m[2][2] = -f.y;
+        R.m[2][2] = -f.z;
 
         // Translate first, then rotate
         return T * R;
     }
 
     // asymmetric frustum
-    inline Mat4 frustum(float l, float r, float b, float t, float n, float f)
+    // row-vector layout (clip = view * F), w_clip = -z_view
+    // ndc z: [-1, 1] near to far; reversedZ: [1, 0] near to far, the depth written as is
+    // (see Viewport::reversedZ), so float depth keeps its precision at the far plane
+    inline Mat4 frustum(float l, float r, float b, float t, float n, float f,
+                        bool reversedZ = false)
     {
         Mat4 F = Mat4::identity();
 
         F.m[0][0] = 2.0f * n / (r - l);
-        F.m[0][2] = (r + l) / (r - l);
+        F.m[2][0] = (r + l) / (r - l);
         F.m[1][1] = 2.0f * n / (t - b);
-        F.m[1][2] = (t + b) / (t - b);
-        F.m[2][2] = -(f + n) / (f - n);
-        F.m[2][3] = -2.0f * (f * n) / (f - n);
-        F.m[3][2] = -1.0f;
+        F.m[2][1] = (t + b) / (t - b);
+        F.m[2][2] = reversedZ ? n / (f - n) : -(f + n) / (f - n);
+        F.m[3][2] = reversedZ ? (f * n) / (f - n) : -2.0f * (f * n) / (f - n);
+        F.m[2][3] = -1.0f;
+        F.m[3][3] = 0.0f;
         return F;
     }
 
+    // parallel projection of the view-space box [l, r] x [b, t] x [-n, -f]
+    inline Mat4 orthographic(float l, float r, float b, float t, float n, float f)
+    {
+        Mat4 O = Mat4::identity();
+
+        O.m[0][0] = 2.0f / (r - l);
+        O.m[3][0] = -(r + l) / (r - l);
+        O.m[1][1] = 2.0f / (t - b);
+        O.m[3][1] = -(t + b) / (t - b);
+        O.m[2][2] = -2.0f / (f - n);
+        O.m[3][2] = -(f + n) / (f - n);
+        return O;
+    }
+
     // symmetric frustum
     // aspect = width / height
     // The center of near plane = [0, 0]
-    inline Mat4 perspective(float fovY, float aspect, float n, float f)
+    inline Mat4 perspective(float fovY, float aspect, float n, float f, bool reversedZ = false)
     {
         float t_ratio = tan(fovY / 2.f * (M_PI / 180.f));
         float h = n * t_ratio; // absolute value of t, b
         float w = aspect * h;  // absolute value of l, r
 
         // l = -w, r = w, b = -h, t = h
-        return frustum(-w, w, -h, h, n, f);
+        return frustum(-w, w, -h, h, n, f, reversedZ);
     }
 } // namespace math
@@ -4,6 +4,11 @@
 
 namespace math
 {
+inline float radians(float deg)
+{
+	return deg * static_cast<float>(M_PI / 180.0);
+}
+
 inline Mat4 rotateX(float r)
 {
 	float c = std::cos(r);
@@ -8,13 +8,15 @@ struct Viewport
 {
 	int x{0}, y{0}; // start point offset
 	int w{1}, h{1};
+	bool reversedZ{false}; // ndc z already in [0, 1], 1 at the near plane (reversed-Z projection)
 
 	// ndc [-1,-1] -> screen [0, 1]
+	// ndc +y is up, screen +y is down
 	inline Vec3 ndcToScreen(Vec3 ndc) const
 	{
-		float sx = (ndc.x * 0.5f + 0.5f) * w + x; // offset + [0, w]
-		float sy = (ndc.y * 0.5f + 0.5f) * h + y; // offset + [0, h]
-		float sz = (ndc.y * 0.5f + 0.5f);         // [0, 1]
+		float sx = (ndc.x * 0.5f + 0.5f) * w + x;  // offset + [0, w]
+		float sy = (0.5f - ndc.y * 0.5f) * h + y;  // offset + [0, h]
+		float sz = reversedZ ? ndc.z : (ndc.z * 0.5f + 0.5f); // [0, 1]
 		return {sx, sy, sz};
 	}
 };
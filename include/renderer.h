@@ -1,8 +1,18 @@
 ﻿#pragma once
 #include "core.h"
 #include "math/math.h"
+#include "renderer/msaa.h"
+#include "renderer/occlusion.h"
+#include "renderer/pool.h"
+#include "renderer/raster.h"
+#include "renderer/resolve.h"
+#include "renderer/shader.h"
+#include "renderer/tile.h"
+#include "resource.h"
 #include "scene.h"
+#include "scene/bvh.h"
 #include <functional>
+#include <optional>
 
 namespace renderer
 {
@@ -28,65 +38,189 @@ namespace renderer
     }
 #undef X
 
-    // 차후 쉐이더 프로그램 추가
-    namespace shader
+
+    struct RenderConfig
     {
-        struct VSUniform
-        {
-            math::Mat4 M, V, P;
-            math::Mat4 N; // normal matrix (normai is covector)
-        };
+        int   tileSize = 64;            // binning tile edge in pixels
+        int   workerCount = 0;          // 0: std::thread::hardware_concurrency()
+        bool  deferred = false;         // visibility buffer: rasterize ids, shade once per pixel
+        bool  occlusionCulling = true;  // largest visible objects hide the ones behind them
+        int   shadowMapSize = 1024;     // directional light cascade edge in texels
+        int   shadowCascades = 4;       // per directional light
+        float shadowDistance = 50.0f;   // directional shadows end this far from the camera
+        int   pointShadowMapSize = 256; // cube face edge in texels
+        int   msaaSamples = 1;          // 1, 2, 4 or 8 per pixel; forward shading only
 
-        struct FSUniform
-        {
-            std::vector<scene::Light> lights;
-            float                     gamma = 2.2f;
-        };
+        // color target while the scene's settings tone map (or expose) the image
+        core::HdrBuffer::Format hdrFormat = core::HdrBuffer::Format::RGBA16F;
+    };
 
-        struct VSIn
-        {
-            math::Vec3 local_pos;
-            math::Vec3 local_nrm;
-            math::Vec4 color = {1, 1, 1, 1};
-        };
+    // one submesh of one object
+    struct DrawItem
+    {
+        const core::Mesh    *mesh;
+        const core::Submesh *sub;
+        shader::VSUniform    vsu;
+        math::Vec4           color;
+        const core::Texture *baseColorTex;     // null: color only
+        core::Sampler        sampler;          // of the material's maps
+        uint32_t             triStart;         // first triangle in frame order
+        uint32_t             vtxStart, vtxEnd; // mesh vertices used by the submesh
+        uint32_t             vtxBase;          // slot of vtxStart in the post-transform cache
+        bool                 cullBack;         // !Material::doubleSided
+    };
+
+    // scene object as last seen by the renderer; transforms are recomputed only on change
+    struct ObjectState
+    {
+        MeshHandle mesh;
+        math::Vec3 pos, rot, scale;
+        math::Mat4 M, N; // model, normal
+    };
+
+    // render() = shadow maps (depth only, parallel over maps)
+    //          -> vertex shading (parallel over vertices, each vertex of a draw shaded once)
+    //          -> triangle assembly & binning (parallel over triangles)
+    //          -> point lights sorted into tiles (parallel over tiles)
+    //          -> rasterization (parallel over tiles, one tile per worker at a time),
+    //             each drawn tile cleared first; tiles nothing covers are cleared after
+    //             multisampled: coverage and depth per sample, FS once per pixel and
+    //             triangle; the worker resolves a tile's edge pixels when it is done
+    //          -> tone mapping into the framebuffer (parallel over 64x64 tiles), HDR scenes only
+    // deferred: rasterization writes (triangle, instance) ids only, a second pass over the
+    //           tiles runs FS exactly once per covered pixel
+    class Renderer
+    {
+      private:
+        shader::VS               vs; // empty: default shaders
+        shader::FS               fs; // empty: default shaders
+        const resource::Manager *resources = nullptr;
+
+        WorkerPool                            pool;
+        TileGrid                              grid;
+        std::vector<TileBins<RasterTriangle>> bins; // one per worker
+        core::VisibilityBuffer                vis{0, 0};
+
+        // scene BVH: rebuilt when objects are added/removed or change mesh,
+        // refit when only transforms changed
+        scene::Bvh                         bvh;
+        std::vector<ObjectState>           objects;
+        std::vector<math::AABB>            objectBounds; // world space
+        std::vector<std::vector<uint32_t>> moved;        // per worker
+        std::vector<uint32_t>              visible;      // objects in the frustum, scene order
+
+        // an object was added, removed or moved by the last syncScene
+        bool sceneChanged = true;
 
-        struct VSOut
+        // occlusion culling: largest visible objects rasterized at low resolution first
+        OcclusionBuffer            occlusion;
+        std::vector<OcclusionRect> rects;        // per visible object
+        std::vector<math::Vec4>    occluderClip; // scratch
+        std::vector<math::Vec3>    occluderTris; // screen-space occluders, 3 vertices each
+
+        // Forward+: screen bounds of fsu.localLights, matched against each tile's depth range
+        struct LightRect
         {
-            math::Vec4 clip_pos;
-            math::Vec3 world_pos;
-            math::Vec3 world_nrm;
-            math::Vec3 color;
+            int   x0, y0, x1, y1; // inclusive pixels
+            float zMin, zMax;
         };
+        std::vector<LightRect> lightRects;
+
+        // depth-only views of castShadow lights, rendered before the main passes
+        ShadowMaps                              shadows;
+        std::vector<std::vector<shader::VSOut>> shadowVerts; // per worker, clip positions only
+
+        // tone mapped scenes shade into hdr, resolved into the framebuffer at the end
+        core::HdrBuffer hdr{0, 0};
+        bool            hdrOut = false;
+        ToneMapper      toneMapper;
+
+        // lazy clears: a tile is cleared by the raster worker that first draws into it
+        // (while its pixels are in that worker's cache), the rest in one pass at the end
+        std::vector<uint8_t> tileCleared; // per grid tile
+
+        // multisampling: db holds sample 0, sampleDepth the others (same format); color is
+        // kept per sample only where triangles only partly cover a pixel (sampleColor)
+        int                              sampleCount = 1;
+        std::vector<core::DepthBuffer>   sampleDepth;
+        std::vector<core::DepthBuffer *> depthSamples; // db, then sampleDepth
+        SampleStore                      sampleColor;
 
-        struct FSIn
+        // per-frame state shared by the passes
+        int                        workers = 1;
+        std::vector<DrawItem>      draws;
+        uint32_t                   triCount = 0;
+        uint32_t                   vtxCount = 0;
+        std::vector<shader::VSOut> vtxCache; // post-transform vertices of every draw
+        math::Viewport             viewport;
+        shader::FSUniform          fsu;
+
+        void syncScene(const scene::Scene &scn);
+        void occlusionPass(const math::Mat4 &VP, int width, int height);
+        void shadowPass(const scene::Camera &cam, float aspect);
+        int  beginFrame(const scene::Scene &scn, core::FrameBuffer &fb, core::DepthBuffer &db);
+        int  assemble(const DrawItem &d, uint32_t meshTri, RasterTriangle *tris) const;
+        void geometryPass();
+        void lightPass();
+        void resolvePass(core::FrameBuffer &fb);
+        void clearTile(int tile, core::FrameBuffer &fb, core::DepthBuffer &db);
+        void finishClears(core::FrameBuffer &fb, core::DepthBuffer &db);
+
+        void writeColor(core::FrameBuffer &fb, int x, int y, const math::Vec4 &c)
         {
-            math::Vec3 nrm;
-            math::Vec3 color;
-        };
+            if (hdrOut)
+                hdr.writeRGBAUnchecked(x, y, c);
+            else
+                fb.writeRGBAUnchecked(x, y, c);
+        }
 
-        struct FSOut
+        // multisampled writeColor: the samples of mask get c
+        void writeSamples(core::FrameBuffer &fb, int tile, int x, int y, uint32_t mask,
+                          const math::Vec4 &c)
         {
-            float      depth;
-            math::Vec4 color;
-        };
+            uint8_t      px[16];
+            const size_t i = fb.layout.index(x, y);
+            if (hdrOut)
+            {
+                hdr.encode(c, px);
+                sampleColor.write(tile, hdr.color.data(), i, mask, px);
+            }
+            else
+            {
+                core::FrameBuffer::encode(c, px);
+                sampleColor.write(tile, fb.color.data(), i, mask, px);
+            }
+        }
 
-        using VS = std::function<VSOut(const VSIn &)>;
-        using FS = std::function<FSOut(const FSIn &)>;
+        template <class VSType> void vertexPass(const VSType &vertex);
+        template <class FSType>
+        void rasterPass(const FSType &fragment, core::FrameBuffer &fb, core::DepthBuffer &db);
+        template <class FSType> void shadePass(const FSType &fragment, core::FrameBuffer &fb);
 
-        VSOut defaultVS(const VSIn &);
-        FSOut defaultFS(const FSIn &);
-    } // namespace shader
+      public:
+        int          flags;
+        RenderConfig config;
 
-    class Renderer
-    {
-      private:
-        shader::VS vs = shader::defaultVS;
-        shader::FS fs = shader::defaultFS;
+        Renderer();
+        ~Renderer();
+
+        // shaders set through setVertexShader / setFragmentShader (std::function),
+        // or the specialized default pipeline if none were set
+        int render(const scene::Scene &scn, core::FrameBuffer &fb, core::DepthBuffer &db);
+        // pipeline specialized for the shader types; functors inline into the raster loop
+        template <class VSType, class FSType>
+        int render(const scene::Scene &scn, core::FrameBuffer &fb, core::DepthBuffer &db,
+                   const VSType &vertex, const FSType &fragment);
+
+        // object whose world box is nearest under pixel (x, y) of the last rendered frame
+        std::optional<uint32_t> pick(const scene::Camera &cam, int x, int y) const;
+        // hierarchy over the objects of the last rendered scene
+        const scene::Bvh &sceneBvh() const { return bvh; }
 
-      public:
-        int  flags;
-        int  render(const scene::Scene &scn, core::FrameBuffer &fb, core::DepthBuffer &db);
         void setVertexShader(const shader::VS &vs);
         void setFragmentShader(const shader::FS &vs);
+        void setResourceManager(const resource::Manager &mgr);
     };
 } // namespace renderer
+
+#include "renderer/pipeline.h"
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+    // Color samples of a multisampled frame, compressed per pixel. A pixel whose samples all
+    // hold one color (inside a triangle, most pixels) keeps only that color, in the target
+    // buffer; a pixel an edge runs through gets a fragment record with one color per sample.
+    // Records live in a pool per raster tile, owned by the worker drawing the tile, and are
+    // averaged back into the target by resolve() once the tile is done.
+    class SampleStore
+    {
+      public:
+        static constexpr uint32_t kNone = ~uint32_t(0); // pixel without a record
+
+        // pixel encoding of the target
+        enum class Format
+        {
+            RGBA8,   // core::FrameBuffer
+            RGBA16F, // core::HdrBuffer
+            RGBA32F
+        };
+
+        // samples: 2, 4 or 8; pixelCount: of the target; tiles: raster tiles (pools)
+        void reset(int samples, Format format, size_t pixelCount, int tiles);
+
+        uint32_t fullMask() const { return (1u << samples) - 1; }
+
+        // encoded color px into the samples of mask of target pixel (layout index) pixel;
+        // only the worker owning tile writes its pixels
+        void write(int tile, uint8_t *target, size_t pixel, uint32_t mask, const uint8_t *px);
+
+        // target pixels of the tile's records <- average of their samples; empties the pool
+        void resolve(int tile, uint8_t *target);
+
+      private:
+        int    samples = 0;
+        Format format = Format::RGBA8;
+        int    bpp = 4;        // bytes per sample
+        size_t recordSize = 0; // uint32_t pixel, then samples * bpp bytes
+
+        std::vector<uint32_t>             fragment; // per pixel: record offset, or kNone
+        std::vector<std::vector<uint8_t>> pools;    // per tile, records
+    };
+} // namespace renderer
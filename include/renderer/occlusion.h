@@ -0,0 +1,58 @@
+﻿#pragma once
+#include "math/math.h"
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+    // screen bounds of an object in occlusion buffer pixels
+    struct OcclusionRect
+    {
+        int   x0, y0, x1, y1; // inclusive
+        float zMin;           // nearest depth
+        bool  valid;          // false: the object reaches the near plane, never tested
+        bool  hidden;         // result of the occlusion test
+    };
+
+    // Low-resolution software occlusion buffer in the style of Masked Occlusion Culling:
+    // tiles of 32x8 pixels, one coverage bit per pixel and two conservative max depths.
+    //  z0   : every pixel of the tile has an occluder at depth <= z0 (reference layer)
+    //  z1   : pixels set in mask have an occluder at depth <= z1 (working layer)
+    // A pixel only counts as covered when the occluder covers all of it, not just its center.
+    // Occluders only ever lower the bounds, so a test against them never hides anything
+    // that the full-resolution depth test would have kept.
+    class OcclusionBuffer
+    {
+      public:
+        static constexpr int kTileW = 32; // one row = one uint32_t
+        static constexpr int kTileH = 8;  // one tile = one AVX2 register
+
+      private:
+        struct alignas(32) Tile
+        {
+            uint32_t mask[kTileH];
+            float    z0, z1;
+        };
+
+        int               width = 0, height = 0;
+        int               tilesX = 0, tilesY = 0;
+        std::vector<Tile> tiles;
+
+        void merge(Tile &t, int tx, int ty, const uint32_t cov[kTileH], float z);
+
+      public:
+        int  getWidth() const { return width; }
+        int  getHeight() const { return height; }
+        int  getTileRows() const { return tilesY; }
+        void resize(int w, int h);
+        void clear();
+
+        // occluder in buffer pixels (x, y) with depth z in [0, 1], either winding;
+        // only tile rows [rowBegin, rowEnd) are written, so workers can split the buffer
+        void renderTriangle(const math::Vec3 &p0, const math::Vec3 &p1, const math::Vec3 &p2,
+                            int rowBegin = 0, int rowEnd = INT_MAX);
+        // inclusive pixel rect whose nearest depth is zMin lies behind the occluders
+        bool occluded(int x0, int y0, int x1, int y1, float zMin) const;
+    };
+} // namespace renderer
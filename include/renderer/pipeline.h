@@ -0,0 +1,264 @@
+﻿#pragma once
+#include "renderer.h"
+#include <atomic>
+
+// Renderer passes, templated on the shader types so functor shaders are inlined.
+namespace renderer
+{
+    // vertex shading: every vertex of every draw lands once in vtxCache,
+    // workers take contiguous slices and shade them kVertexBatch at a time
+    template <class VSType> void Renderer::vertexPass(const VSType &vertex)
+    {
+        constexpr int kBatch = shader::kVertexBatch;
+
+        pool.run(
+            [&](int w)
+            {
+                const uint32_t begin = uint64_t(vtxCount) * w / workers;
+                const uint32_t end = uint64_t(vtxCount) * (w + 1) / workers;
+
+                shader::VSInBatch batch;
+                for (const DrawItem &d : draws)
+                {
+                    const uint32_t lo = std::max(begin, d.vtxBase);
+                    const uint32_t hi = std::min(end, d.vtxBase + (d.vtxEnd - d.vtxStart));
+                    const core::Vertex *mv = &d.mesh->vertices[d.vtxStart];
+                    for (uint32_t slot = lo; slot < hi; slot += kBatch)
+                    {
+                        const int           n = std::min<int>(kBatch, hi - slot);
+                        const core::Vertex *src = mv + (slot - d.vtxBase);
+                        shader::VSOut      *dst = &vtxCache[slot];
+
+                        if constexpr (requires { vertex.batch(batch, d.vsu, dst); })
+                        {
+                            batch.count = n;
+                            batch.color = d.color;
+                            for (int i = 0; i < kBatch; i++)
+                            {
+                                const core::Vertex &v = src[std::min(i, n - 1)];
+                                batch.px[i] = v.position.x;
+                                batch.py[i] = v.position.y;
+                                batch.pz[i] = v.position.z;
+                                batch.nx[i] = v.normal.x;
+                                batch.ny[i] = v.normal.y;
+                                batch.nz[i] = v.normal.z;
+                                batch.u[i] = v.uv.x;
+                                batch.v[i] = v.uv.y;
+                            }
+                            vertex.batch(batch, d.vsu, dst);
+                        }
+                        else
+                        {
+                            for (int i = 0; i < n; i++)
+                                dst[i] = vertex(
+                                    {src[i].position, src[i].normal, d.color, src[i].uv}, d.vsu);
+                        }
+                    }
+                }
+            });
+    }
+
+    // Textured fragments wait here until kFragmentBatch of them can go through the
+    // shader's batch() together; untextured ones, and shaders without batch(), are shaded
+    // at once. A queued pixel coming again (a later triangle over it, textured or not)
+    // flushes first, so writes keep their order.
+    template <class FSType, class Write> class FragmentQueue
+    {
+      public:
+        // write(const FSIn &, uint32_t tag, const Vec4 &color); tag: the caller's, per fragment
+        FragmentQueue(const FSType &fragment, const shader::FSUniform &fsu, Write write)
+            : fragment(fragment), fsu(fsu), write(write)
+        {
+        }
+
+        void push(const shader::FSIn &f, uint32_t tag)
+        {
+            if constexpr (kBatched)
+            {
+                if (f.baseColorTex)
+                {
+                    if (count > 0 && !fits(f))
+                        flush();
+                    in[count] = f;
+                    tags[count++] = tag;
+                    if (count == kBatch)
+                        flush();
+                    return;
+                }
+                if (queued(f))
+                    flush();
+            }
+            write(f, tag, fragment(f, fsu).color);
+        }
+
+        void flush()
+        {
+            if constexpr (kBatched)
+            {
+                if (count == 0)
+                    return;
+                shader::FSOut out[kBatch];
+                fragment.batch(in, count, fsu, out);
+                for (int i = 0; i < count; i++)
+                    write(in[i], tags[i], out[i].color);
+                count = 0;
+            }
+        }
+
+      private:
+        static constexpr int  kBatch = shader::kFragmentBatch;
+        static constexpr bool kBatched =
+            requires(const FSType &fs, const shader::FSIn *in, const shader::FSUniform &u,
+                     shader::FSOut *out) { fs.batch(in, 0, u, out); };
+
+        bool queued(const shader::FSIn &f) const
+        {
+            for (int i = 0; i < count; i++)
+                if (in[i].x == f.x && in[i].y == f.y)
+                    return true;
+            return false;
+        }
+
+        bool fits(const shader::FSIn &f) const
+        {
+            return f.baseColorTex == in[0].baseColorTex && f.sampler == in[0].sampler &&
+                   !queued(f);
+        }
+
+        const FSType            &fragment;
+        const shader::FSUniform &fsu;
+        Write                    write;
+        shader::FSIn             in[kBatch];
+        uint32_t                 tags[kBatch];
+        int                      count = 0;
+    };
+
+    // rasterization: tiles are handed out one at a time, a tile's pixels belong
+    // to exactly one worker so the buffers need no synchronization
+    template <class FSType>
+    void Renderer::rasterPass(const FSType &fragment, core::FrameBuffer &fb,
+                              core::DepthBuffer &db)
+    {
+        const bool           deferred = config.deferred;
+        const SamplePattern &pattern = samplePattern(sampleCount);
+        std::atomic<int>     nextTile{0};
+        pool.run(
+            [&](int)
+            {
+                for (int tile = nextTile++; tile < grid.count(); tile = nextTile++)
+                {
+                    const TileRect rect = grid.rect(tile);
+                    FragmentQueue  queue(fragment, fsu,
+                                         [&](const shader::FSIn &in, uint32_t samples,
+                                             const math::Vec4 &c)
+                                         {
+                                             if (sampleCount > 1)
+                                                 writeSamples(fb, tile, in.x, in.y, samples, c);
+                                             else
+                                                 writeColor(fb, in.x, in.y, c);
+                                         });
+                    for (const TileBins<RasterTriangle> &b : bins)
+                    {
+                        if (!b.tiles[tile].empty() && !tileCleared[tile])
+                            clearTile(tile, fb, db);
+                        for (uint32_t i : b.tiles[tile])
+                        {
+                            const RasterTriangle &tri = b.tris[i];
+                            const DrawItem       &draw = draws[tri.instance];
+                            auto                  shade = [&](int x, int y, uint32_t samples)
+                            {
+                                shader::FSIn in = interpolate(tri, x, y);
+                                in.baseColorTex = draw.baseColorTex;
+                                in.sampler = &draw.sampler;
+                                queue.push(in, samples);
+                            };
+                            if (deferred)
+                                rasterizeTriangle(tri, rect, db,
+                                                  [&](int x, int y) {
+                                                      vis.write(x, y, {tri.triangle, tri.instance});
+                                                  });
+                            else if (sampleCount > 1)
+                                rasterizeTriangleMS(tri, rect, depthSamples.data(), pattern,
+                                                    shade);
+                            else
+                                rasterizeTriangle(tri, rect, db,
+                                                  [&](int x, int y) { shade(x, y, 1); });
+                        }
+                    }
+                    queue.flush();
+                    // the tile's edge pixels, while they are still in this worker's cache
+                    if (sampleCount > 1)
+                        sampleColor.resolve(tile, hdrOut ? hdr.color.data() : fb.color.data());
+                }
+            });
+    }
+
+    // deferred shading: one FS per covered pixel, the triangle is rebuilt from its
+    // ids (neighbouring pixels mostly share it, so the last one is kept per worker);
+    // a clipped triangle is shaded from the piece that covers the pixel; textured pixels
+    // are shaded in FragmentQueue batches
+    template <class FSType> void Renderer::shadePass(const FSType &fragment, core::FrameBuffer &fb)
+    {
+        using Sample = core::VisibilityBuffer::Sample;
+        constexpr uint32_t kEmpty = core::VisibilityBuffer::kEmpty;
+
+        std::atomic<int> nextTile{0};
+        pool.run(
+            [&](int)
+            {
+                RasterTriangle tris[kMaxClippedTriangles];
+                int            count = 0;
+                Sample         cached{kEmpty, kEmpty};
+                FragmentQueue  queue(fragment, fsu,
+                                     [&](const shader::FSIn &in, uint32_t, const math::Vec4 &c)
+                                     { writeColor(fb, in.x, in.y, c); });
+                for (int tile = nextTile++; tile < grid.count(); tile = nextTile++)
+                {
+                    if (!tileCleared[tile]) // nothing drawn, ids never written
+                        continue;
+                    const TileRect rect = grid.rect(tile);
+                    for (int y = rect.y0; y < rect.y1; y++)
+                    {
+                        for (int x = rect.x0; x < rect.x1; x++)
+                        {
+                            const Sample &s = vis.at(x, y);
+                            if (s.instance == kEmpty)
+                                continue;
+                            if (s.instance != cached.instance || s.triangle != cached.triangle)
+                            {
+                                count = assemble(draws[s.instance], s.triangle, tris);
+                                cached = s;
+                            }
+                            int piece = 0;
+                            while (piece + 1 < count && !pixelInside(tris[piece], x, y))
+                                piece++;
+                            shader::FSIn in = interpolate(tris[piece], x, y);
+                            in.baseColorTex = draws[s.instance].baseColorTex;
+                            in.sampler = &draws[s.instance].sampler;
+                            queue.push(in, 0);
+                        }
+                    }
+                    queue.flush();
+                }
+            });
+    }
+
+    template <class VSType, class FSType>
+    int Renderer::render(const scene::Scene &scn, core::FrameBuffer &fb, core::DepthBuffer &db,
+                         const VSType &vertex, const FSType &fragment)
+    {
+        if (int err = beginFrame(scn, fb, db); err != static_cast<int>(ErrorCode::OK))
+            return err;
+
+        vertexPass(vertex);
+        geometryPass();
+        lightPass();
+        rasterPass(fragment, fb, db);
+        if (config.deferred)
+            shadePass(fragment, fb);
+        finishClears(fb, db);
+        if (hdrOut)
+            resolvePass(fb);
+        return static_cast<int>(ErrorCode::OK);
+    }
+} // namespace renderer
@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace renderer
+{
+    // Persistent worker threads reused across frames.
+    // The calling thread takes part as worker 0, so size() == threads + 1.
+    class WorkerPool
+    {
+      public:
+        using Job = std::function<void(int worker)>;
+
+      private:
+        std::vector<std::thread> threads;
+        std::mutex               m;
+        std::condition_variable  wake;
+        std::condition_variable  done;
+        const Job               *job = nullptr;
+        uint64_t                 generation = 0;
+        int                      pending = 0;
+        bool                     stopping = false;
+
+        void workerMain(int worker, uint64_t seen);
+        void stop();
+
+      public:
+        WorkerPool() = default;
+        explicit WorkerPool(int count) { resize(count); }
+        ~WorkerPool() { stop(); }
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        int  size() const { return static_cast<int>(threads.size()) + 1; }
+        void resize(int count);
+        // runs job(worker) once on every worker and blocks until all return
+        void run(const Job &fn);
+    };
+} // namespace renderer
@@ -0,0 +1,281 @@
+﻿#pragma once
+#include "core.h"
+#include "renderer/shader.h"
+#include "renderer/tile.h"
+#include <bit>
+
+namespace renderer
+{
+    // screen-space triangle, ready to be binned and rasterized
+    struct RasterTriangle
+    {
+        float         z[3];    // raster depth (core::DepthCodec), grows with distance
+        float         zMin, zMax;
+        float         dzdx, dzdy;
+        float         invW[3]; // 1 / clip w, for perspective-correct attributes
+        float         invArea; // 1 / edge(p0, p1, p2) in 24.8 units
+        math::EdgeFx  e[3];    // e[i] is zero on the edge opposite to vertex i, CW winding
+        int           minX, minY, maxX, maxY; // inclusive pixel bbox, clamped to the viewport
+        uint32_t      instance;               // draw the triangle came from
+        uint32_t      triangle;               // triangle index in the mesh
+        shader::VSOut attr[3];
+    };
+
+    // a triangle clipped by the near/far planes and the guard band is a polygon of
+    // up to 9 vertices, fanned into at most this many triangles
+    constexpr int kMaxClippedTriangles = 7;
+
+    // clip -> screen, snapped to 28.4 fixed point
+    // clips against near/far in clip space; x/y are only clipped past the guard band,
+    // the viewport itself is handled by the bbox, so every emitted pixel is in bounds
+    // writes up to kMaxClippedTriangles to out, returns how many (0: culled)
+    // reach: how far (subpixels) samples lie from pixel centers, widens the bbox (multisampling)
+    int setupTriangle(const shader::VSOut &v0, const shader::VSOut &v1, const shader::VSOut &v2,
+                      const math::Viewport &vp, RasterTriangle *out, int reach = 0);
+
+    // back-face test on clip-space positions, before clipping: bit i is set when triangle i
+    // (vertices v[idx[3i..3i+2]]) is front-facing (CCW in NDC); count <= 64
+    // sign of det[xyw] is the facing for any w, so near-plane crossings need no special case
+    uint64_t frontFaceMask(const shader::VSOut *v, const uint32_t *idx, int count);
+
+    // pixel center (x, y) covered by tri (top-left rule)
+    bool pixelInside(const RasterTriangle &tri, int x, int y);
+
+    // sample positions of multisampling in subpixels from the pixel center: the standard
+    // 2x / 4x / 8x patterns, no two samples on one row or column
+    struct SamplePattern
+    {
+        int    count;
+        int8_t x[8], y[8];
+    };
+    // count: 1, 2, 4 or 8
+    const SamplePattern &samplePattern(int count);
+
+    // 8x8 coverage of the block whose top-left pixel is (bx, by); bit (y * 8 + x)
+    // ox, oy: sample offset from the pixel centers in subpixels
+    uint64_t blockCoverage(const RasterTriangle &tri, int bx, int by, int ox = 0, int oy = 0);
+
+    // screen-space barycentric at the center of pixel (x, y)
+    math::Vec3 pixelBarycentric(const RasterTriangle &tri, int x, int y);
+
+    // perspective-correct fragment input at the center of pixel (x, y)
+    shader::FSIn interpolate(const RasterTriangle &tri, int x, int y);
+
+    // depth plane of tri over the 8x8 block whose top-left pixel is (bx, by)
+    core::DepthPlane blockPlane(const RasterTriangle &tri, int bx, int by);
+
+    // bits of the 8x8 block that fall inside [x0, x1] x [y0, y1]
+    inline uint64_t rectMask(int bx, int by, int x0, int y0, int x1, int y1)
+    {
+        const int cx0 = std::max(x0 - bx, 0), cx1 = std::min(x1 - bx, 7);
+        const int cy0 = std::max(y0 - by, 0), cy1 = std::min(y1 - by, 7);
+        if (cx0 > cx1 || cy0 > cy1)
+            return 0;
+
+        const uint64_t row = ((1u << (cx1 + 1)) - 1) & ~((1u << cx0) - 1);
+        uint64_t       mask = 0;
+        for (int y = cy0; y <= cy1; y++)
+            mask |= row << (y * 8);
+        return mask;
+    }
+
+    // depth-only rasterization of the part of tri inside rect (shadow maps): a plane per
+    // triangle instead of per-pixel barycentrics, and no Hi-Z upkeep, the buffer's Hi-Z is
+    // left stale; db is D32F without compression
+    void rasterizeDepth(const RasterTriangle &tri, const TileRect &rect, core::DepthBuffer &db);
+
+    // depth test and write of the pixels of mask in block (bx, by), depth from plane;
+    // kMax: the triangle's largest key. Returns the pixels that passed.
+    template <class Codec>
+    uint64_t depthBlock(core::DepthBuffer &db, int bx, int by, const core::DepthPlane &plane,
+                        uint64_t mask, uint32_t kMax)
+    {
+        core::DepthBuffer::Block &blk = db.block(bx, by);
+        float                     z[64];
+        plane.eval(z);
+
+        // depthPass: the block's Hi-Z already proves the depth test passes
+        const bool depthPass = kMax < blk.zmin;
+        if (depthPass && mask == ~uint64_t(0) && db.compression)
+        {
+            // every pixel replaced: the block becomes the triangle's plane
+            float lo = z[0], hi = z[0];
+            for (int i = 1; i < 64; i++)
+            {
+                lo = std::min(lo, z[i]);
+                hi = std::max(hi, z[i]);
+            }
+            blk = {Codec::key(lo), Codec::key(hi), plane, true};
+            return mask;
+        }
+        if (blk.compressed)
+            db.expand<Codec>(bx, by);
+        uint8_t *const keys = db.blockPixels<Codec>(bx, by);
+
+        uint32_t zmin = blk.zmin;
+        uint64_t passed = 0;
+        while (mask)
+        {
+            const int bit = std::countr_zero(mask);
+            mask &= mask - 1;
+
+            const uint32_t k = Codec::key(z[bit]);
+            uint8_t       *d = keys + bit * Codec::kBytes;
+            if (!depthPass && k >= Codec::load(d))
+                continue;
+            Codec::store(d, k);
+            zmin = std::min(zmin, k);
+            passed |= uint64_t(1) << bit;
+        }
+        if (passed)
+        {
+            blk.zmin = zmin;
+            db.updateHiZ<Codec>(bx, by);
+        }
+        return passed;
+    }
+
+    // rasterizeTriangle for one depth format
+    template <class Codec, class OnPixel>
+    void rasterizeBlocks(const RasterTriangle &tri, const TileRect &rect, core::DepthBuffer &db,
+                         OnPixel &&onPixel)
+    {
+        const int x0 = std::max(tri.minX, rect.x0), x1 = std::min(tri.maxX, rect.x1 - 1);
+        const int y0 = std::max(tri.minY, rect.y0), y1 = std::min(tri.maxY, rect.y1 - 1);
+
+        // tiles are 8-aligned, so blocks never straddle two tiles
+        // and raster blocks coincide with Hi-Z blocks
+        static_assert(core::DepthBuffer::kHiZBlock == 8);
+        const int      bx0 = x0 >> 3, bx1 = x1 >> 3;
+        const int      by0 = y0 >> 3, by1 = y1 >> 3;
+        const uint32_t kMin = Codec::key(tri.zMin), kMax = Codec::key(tri.zMax);
+
+        // whole triangle behind everything already drawn under its bbox
+        bool visible = false;
+        for (int by = by0; by <= by1 && !visible; by++)
+            for (int bx = bx0; bx <= bx1 && !visible; bx++)
+                visible = kMin < db.block(bx, by).zmax;
+        if (!visible)
+            return;
+
+        for (int by = by0; by <= by1; by++)
+        {
+            for (int bx = bx0; bx <= bx1; bx++)
+            {
+                if (kMin >= db.block(bx, by).zmax)
+                    continue;
+                uint64_t mask = blockCoverage(tri, bx * 8, by * 8);
+                if (mask == 0)
+                    continue;
+                mask &= rectMask(bx * 8, by * 8, x0, y0, x1, y1);
+
+                uint64_t passed =
+                    depthBlock<Codec>(db, bx, by, blockPlane(tri, bx * 8, by * 8), mask, kMax);
+                while (passed)
+                {
+                    const int bit = std::countr_zero(passed);
+                    passed &= passed - 1;
+                    onPixel(bx * 8 + (bit & 7), by * 8 + (bit >> 3));
+                }
+            }
+        }
+    }
+
+    // rasterizeTriangleMS for one depth format
+    template <class Codec, class OnPixel>
+    void rasterizeBlocksMS(const RasterTriangle &tri, const TileRect &rect,
+                           core::DepthBuffer *const *depth, const SamplePattern &pattern,
+                           OnPixel &&onPixel)
+    {
+        const int x0 = std::max(tri.minX, rect.x0), x1 = std::min(tri.maxX, rect.x1 - 1);
+        const int y0 = std::max(tri.minY, rect.y0), y1 = std::min(tri.maxY, rect.y1 - 1);
+
+        const uint32_t kMin = Codec::key(tri.zMin), kMax = Codec::key(tri.zMax);
+        for (int by = y0 >> 3; by <= y1 >> 3; by++)
+        {
+            for (int bx = x0 >> 3; bx <= x1 >> 3; bx++)
+            {
+                const uint64_t         inRect = rectMask(bx * 8, by * 8, x0, y0, x1, y1);
+                const core::DepthPlane center = blockPlane(tri, bx * 8, by * 8);
+
+                uint64_t passed[8], any = 0;
+                for (int s = 0; s < pattern.count; s++)
+                {
+                    passed[s] = 0;
+                    core::DepthBuffer &db = *depth[s];
+                    if (kMin >= db.block(bx, by).zmax)
+                        continue;
+                    const int      ox = pattern.x[s], oy = pattern.y[s];
+                    const uint64_t mask = blockCoverage(tri, bx * 8, by * 8, ox, oy) & inRect;
+                    if (mask == 0)
+                        continue;
+                    core::DepthPlane plane = center;
+                    plane.z += (float(ox) * tri.dzdx + float(oy) * tri.dzdy) /
+                               float(math::kSubpixelOne);
+                    passed[s] = depthBlock<Codec>(db, bx, by, plane, mask, kMax);
+                    any |= passed[s];
+                }
+
+                while (any)
+                {
+                    const int bit = std::countr_zero(any);
+                    any &= any - 1;
+                    uint32_t samples = 0;
+                    for (int s = 0; s < pattern.count; s++)
+                        samples |= uint32_t(passed[s] >> bit & 1) << s;
+                    onPixel(bx * 8 + (bit & 7), by * 8 + (bit >> 3), samples);
+                }
+            }
+        }
+    }
+
+    // rasterize the part of tri inside rect (rect is owned by the caller's thread)
+    // pixels stay inside the viewport, so depth writes skip the bounds checks
+    // walks 8x8 blocks, rejecting/accepting whole blocks (coverage and Hi-Z) before
+    // testing pixels; depth comes from the triangle's plane at each block (blockPlane);
+    // onPixel(x, y) runs for every pixel that passed the depth test
+    template <class OnPixel>
+    void rasterizeTriangle(const RasterTriangle &tri, const TileRect &rect, core::DepthBuffer &db,
+                           OnPixel &&onPixel)
+    {
+        using core::DepthCodec, core::DepthFormat;
+        switch (db.format)
+        {
+        case DepthFormat::D32FReversed:
+            return rasterizeBlocks<DepthCodec<DepthFormat::D32FReversed>>(tri, rect, db, onPixel);
+        case DepthFormat::D24:
+            return rasterizeBlocks<DepthCodec<DepthFormat::D24>>(tri, rect, db, onPixel);
+        case DepthFormat::D16:
+            return rasterizeBlocks<DepthCodec<DepthFormat::D16>>(tri, rect, db, onPixel);
+        default:
+            return rasterizeBlocks<DepthCodec<DepthFormat::D32F>>(tri, rect, db, onPixel);
+        }
+    }
+
+    // multisampled rasterizeTriangle: depth[s] holds sample s of pattern (its pixel (x, y) is
+    // the sample at that offset from the pixel center), all of one format; coverage and the
+    // depth test are per sample, onPixel(x, y, samples) runs once per pixel with the mask of
+    // the samples that passed
+    template <class OnPixel>
+    void rasterizeTriangleMS(const RasterTriangle &tri, const TileRect &rect,
+                             core::DepthBuffer *const *depth, const SamplePattern &pattern,
+                             OnPixel &&onPixel)
+    {
+        using core::DepthCodec, core::DepthFormat;
+        switch (depth[0]->format)
+        {
+        case DepthFormat::D32FReversed:
+            return rasterizeBlocksMS<DepthCodec<DepthFormat::D32FReversed>>(tri, rect, depth,
+                                                                            pattern, onPixel);
+        case DepthFormat::D24:
+            return rasterizeBlocksMS<DepthCodec<DepthFormat::D24>>(tri, rect, depth, pattern,
+                                                                   onPixel);
+        case DepthFormat::D16:
+            return rasterizeBlocksMS<DepthCodec<DepthFormat::D16>>(tri, rect, depth, pattern,
+                                                                   onPixel);
+        default:
+            return rasterizeBlocksMS<DepthCodec<DepthFormat::D32F>>(tri, rect, depth, pattern,
+                                                                    onPixel);
+        }
+    }
+} // namespace renderer
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include "core.h"
+#include "scene.h"
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+    // HDR target -> 8 bit framebuffer in one sweep over memory: exposure, tone curve,
+    // 1 / gamma and packing per pixel. The gamma curve is a table indexed by sqrt(x):
+    // even steps in sqrt(x) stay fine near black, where x^(1 / gamma) is steepest.
+    class ToneMapper
+    {
+      public:
+        static constexpr int kLutSize = 4096;
+
+        void configure(float exposure, scene::ToneMapping curve, float gamma);
+        // pixels [first, first + count) in layout order; src and dst of the same size share
+        // the layout, so any span is contiguous in both
+        void resolve(const core::HdrBuffer &src, core::FrameBuffer &dst, size_t first,
+                     size_t count) const;
+
+      private:
+        float                exposure = 1.0f;
+        scene::ToneMapping   curve = scene::ToneMapping::None;
+        float                gamma = 0.0f; // of lut, 0: not built
+        std::vector<int32_t> lut;          // i -> 8 bit (i / (kLutSize - 1))^(2 / gamma)
+    };
+} // namespace renderer
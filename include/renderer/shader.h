@@ -0,0 +1,319 @@
+﻿#pragma once
+#include "core.h"
+#include "math/math.h"
+#include "renderer/shadow.h"
+#include "scene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace renderer
+{
+    namespace shader
+    {
+        struct VSUniform
+        {
+            math::Mat4 M, V, P;
+            math::Mat4 N;   // normal matrix (normai is covector)
+            math::Mat4 MVP; // M * V * P, cached per object
+        };
+
+        // Forward+: point lights sorted into the raster tiles, rebuilt every frame
+        struct LightTiles
+        {
+            int                                tileSize = 64;
+            int                                cols = 0;
+            std::vector<std::vector<uint32_t>> lists; // tile -> indices into localLights
+
+            bool                         empty() const { return lists.empty(); }
+            const std::vector<uint32_t> &at(int x, int y) const
+            {
+                return lists[(y / tileSize) * cols + x / tileSize];
+            }
+        };
+
+        struct FSUniform
+        {
+            std::vector<scene::Light> lights;      // every fragment: directional, spot, ambient
+            std::vector<scene::Light> localLights; // point lights, only those of the pixel's tile
+            LightTiles                tiles;       // empty: every local light is applied
+            float                     gamma = 2.2f;
+            // the frame is tone mapped afterwards: output linear color, the resolve applies
+            // exposure, tone curve and gamma
+            bool                      hdr = false;
+
+            // castShadow lights: index into shadows->lights per lights / localLights entry,
+            // -1 (or past the end) for none
+            const ShadowMaps *shadows = nullptr;
+            std::vector<int>  shadowOf;
+            std::vector<int>  localShadowOf;
+        };
+
+        struct VSIn
+        {
+            math::Vec3 local_pos;
+            math::Vec3 local_nrm;
+            math::Vec4 color = {1, 1, 1, 1};
+            math::Vec2 uv;
+        };
+
+        struct VSOut
+        {
+            math::Vec4 clip_pos;
+            math::Vec3 world_pos;
+            math::Vec3 world_nrm;
+            math::Vec3 color;
+            math::Vec2 uv;
+        };
+
+        struct FSIn
+        {
+            math::Vec3 world_pos;
+            math::Vec3 nrm;
+            math::Vec3 color;
+            math::Vec2 uv;
+            math::Vec2 duvdx, duvdy; // uv change per pixel step, picks the mip level
+            int        x = 0, y = 0; // pixel, selects the light tile
+
+            const core::Texture *baseColorTex = nullptr; // of the draw's material
+            const core::Sampler *sampler = nullptr;      // set with baseColorTex
+        };
+
+        struct FSOut
+        {
+            float      depth;
+            math::Vec4 color;
+        };
+
+        // vertices shaded together by the vertex pass
+#if defined(__AVX512F__)
+        constexpr int kVertexBatch = 16;
+#else
+        constexpr int kVertexBatch = 8;
+#endif
+
+        // textured fragments shaded together by the raster and shade passes; sample8's width
+        constexpr int kFragmentBatch = 8;
+
+        // SoA batch of VSIn; color is per draw (material)
+        struct VSInBatch
+        {
+            int        count; // valid lanes, <= kVertexBatch
+            float      px[kVertexBatch], py[kVertexBatch], pz[kVertexBatch];
+            float      nx[kVertexBatch], ny[kVertexBatch], nz[kVertexBatch];
+            float      u[kVertexBatch], v[kVertexBatch];
+            math::Vec4 color;
+        };
+
+        using VS = std::function<VSOut(const VSIn &, const VSUniform &)>;
+        using FS = std::function<FSOut(const FSIn &, const FSUniform &)>;
+
+        // Shaders are plain callables: VSOut(const VSIn &, const VSUniform &) and
+        // FSOut(const FSIn &, const FSUniform &). Functor types passed to
+        // Renderer::render<VSType, FSType> are inlined into the raster loop;
+        // VS / FS (std::function) is the slow path for swapping shaders at runtime.
+        // A vertex shader may also provide batch(const VSInBatch &, const VSUniform &, VSOut *)
+        // to shade kVertexBatch vertices at once.
+        // A fragment shader may provide batch(const FSIn *, int count, const FSUniform &,
+        // FSOut *) for up to kFragmentBatch fragments that share a texture and sampler.
+        struct DefaultVS
+        {
+            // lane loops over SoA arrays, vectorized by the compiler
+            void batch(const VSInBatch &in, const VSUniform &u, VSOut *out) const
+            {
+                const int n = in.count;
+                float     cx[kVertexBatch], cy[kVertexBatch], cz[kVertexBatch], cw[kVertexBatch];
+                float     wx[kVertexBatch], wy[kVertexBatch], wz[kVertexBatch];
+                float     nx[kVertexBatch], ny[kVertexBatch], nz[kVertexBatch];
+
+                const auto &C = u.MVP.m, &W = u.M.m, &N = u.N.m;
+                for (int i = 0; i < kVertexBatch; i++)
+                {
+                    const float x = in.px[i], y = in.py[i], z = in.pz[i];
+                    cx[i] = x * C[0][0] + y * C[1][0] + z * C[2][0] + C[3][0];
+                    cy[i] = x * C[0][1] + y * C[1][1] + z * C[2][1] + C[3][1];
+                    cz[i] = x * C[0][2] + y * C[1][2] + z * C[2][2] + C[3][2];
+                    cw[i] = x * C[0][3] + y * C[1][3] + z * C[2][3] + C[3][3];
+                    wx[i] = x * W[0][0] + y * W[1][0] + z * W[2][0] + W[3][0];
+                    wy[i] = x * W[0][1] + y * W[1][1] + z * W[2][1] + W[3][1];
+                    wz[i] = x * W[0][2] + y * W[1][2] + z * W[2][2] + W[3][2];
+                }
+                for (int i = 0; i < kVertexBatch; i++)
+                {
+                    const float x = in.nx[i], y = in.ny[i], z = in.nz[i];
+                    const float tx = x * N[0][0] + y * N[1][0] + z * N[2][0];
+                    const float ty = x * N[0][1] + y * N[1][1] + z * N[2][1];
+                    const float tz = x * N[0][2] + y * N[1][2] + z * N[2][2];
+                    const float l2 = tx * tx + ty * ty + tz * tz;
+                    const float inv = l2 > 0.0f ? 1.0f / std::sqrt(l2) : 1.0f;
+                    nx[i] = tx * inv;
+                    ny[i] = ty * inv;
+                    nz[i] = tz * inv;
+                }
+
+                const math::Vec3 color{in.color.x, in.color.y, in.color.z};
+                for (int i = 0; i < n; i++)
+                {
+                    out[i].clip_pos = {cx[i], cy[i], cz[i], cw[i]};
+                    out[i].world_pos = {wx[i], wy[i], wz[i]};
+                    out[i].world_nrm = {nx[i], ny[i], nz[i]};
+                    out[i].color = color;
+                    out[i].uv = {in.u[i], in.v[i]};
+                }
+            }
+
+            VSOut operator()(const VSIn &in, const VSUniform &u) const
+            {
+                VSOut      out;
+                math::Vec4 world = u.M.mul_point(in.local_pos);
+                math::Vec4 nrm = u.N.mul_vector(in.local_nrm);
+
+                out.clip_pos = u.MVP.mul_point(in.local_pos);
+                out.world_pos = {world.x, world.y, world.z};
+                out.world_nrm = math::normalize({nrm.x, nrm.y, nrm.z});
+                out.color = {in.color.x, in.color.y, in.color.z};
+                out.uv = in.uv;
+                return out;
+            }
+        };
+
+        // lambert term of one light at a surface point
+        inline math::Vec3 lightRadiance(const scene::Light &light, const math::Vec3 &n,
+                                        const math::Vec3 &pos)
+        {
+            math::Vec3 l;
+            float      atten = 1.0f;
+            switch (light.type)
+            {
+            case scene::LightType::Directional:
+                l = math::normalize(-light.directional.dir);
+                break;
+            case scene::LightType::Point:
+            {
+                math::Vec3 d = light.point.pos - pos;
+                float      dist = math::length(d);
+                l = d / std::max(dist, 1e-6f);
+                atten = std::clamp(1.0f - dist / light.point.range, 0.0f, 1.0f);
+                atten *= atten;
+                break;
+            }
+            case scene::LightType::Spot:
+            {
+                math::Vec3 d = light.spot.pos - pos;
+                float      dist = math::length(d);
+                l = d / std::max(dist, 1e-6f);
+                atten = std::clamp(1.0f - dist / light.spot.range, 0.0f, 1.0f);
+                // smooth falloff from the inner to the outer cone
+                const float cone = std::clamp(
+                    (-math::dot(l, light.spot.dir) - light.spot.cosOuter) /
+                        std::max(light.spot.cosInner - light.spot.cosOuter, 1e-4f),
+                    0.0f, 1.0f);
+                atten *= atten * cone * cone;
+                break;
+            }
+            case scene::LightType::Ambient:
+                return light.color * light.intensity;
+            }
+            float ndotl = std::max(math::dot(n, l), 0.0f);
+            return light.color * (light.intensity * ndotl * atten);
+        }
+
+        // lambert, lights in linear space, gamma applied at the end
+        struct DefaultFS
+        {
+            FSOut operator()(const FSIn &in, const FSUniform &u) const
+            {
+                math::Vec3 albedo = in.color;
+                if (in.baseColorTex)
+                {
+                    const math::Vec4 t =
+                        in.baseColorTex->sample(*in.sampler, in.uv, in.duvdx, in.duvdy);
+                    albedo = {albedo.x * t.x, albedo.y * t.y, albedo.z * t.z};
+                }
+                return shade(in, u, albedo);
+            }
+
+            // count fragments sharing baseColorTex and sampler: the texture is read once
+            // for all of them with sample8
+            void batch(const FSIn *in, int count, const FSUniform &u, FSOut *out) const
+            {
+                const core::Texture *tex = in[0].baseColorTex;
+                if (!tex)
+                {
+                    for (int i = 0; i < count; i++)
+                        out[i] = (*this)(in[i], u);
+                    return;
+                }
+
+                float uu[kFragmentBatch], vv[kFragmentBatch], lod[kFragmentBatch];
+                for (int i = 0; i < kFragmentBatch; i++)
+                {
+                    const FSIn &f = in[std::min(i, count - 1)];
+                    uu[i] = f.uv.x;
+                    vv[i] = f.uv.y;
+                    lod[i] = tex->lod(f.duvdx, f.duvdy);
+                }
+                core::Texels<kFragmentBatch> t;
+                tex->sample8(*in[0].sampler, uu, vv, lod, t);
+
+                for (int i = 0; i < count; i++)
+                {
+                    const math::Vec3 &c = in[i].color;
+                    out[i] = shade(in[i], u, {c.x * t.r[i], c.y * t.g[i], c.z * t.b[i]});
+                }
+            }
+
+          private:
+            FSOut shade(const FSIn &in, const FSUniform &u, const math::Vec3 &albedo) const
+            {
+                const math::Vec3 n = math::normalize(in.nrm);
+                math::Vec3       radiance{0.0f, 0.0f, 0.0f};
+
+                // the shadow map is only read where the light reaches
+                auto add = [&](const scene::Light &light, const std::vector<int> &shadowOf,
+                               uint32_t i)
+                {
+                    const math::Vec3 c = lightRadiance(light, n, in.world_pos);
+                    if (c.x == 0.0f && c.y == 0.0f && c.z == 0.0f)
+                        return;
+                    if (u.shadows && i < shadowOf.size() && shadowOf[i] >= 0)
+                        radiance += c * u.shadows->visibility(light, shadowOf[i], in.world_pos, n);
+                    else
+                        radiance += c;
+                };
+
+                for (uint32_t i = 0; i < u.lights.size(); i++)
+                    add(u.lights[i], u.shadowOf, i);
+                if (u.tiles.empty())
+                {
+                    for (uint32_t i = 0; i < u.localLights.size(); i++)
+                        add(u.localLights[i], u.localShadowOf, i);
+                }
+                else
+                {
+                    for (uint32_t i : u.tiles.at(in.x, in.y))
+                        add(u.localLights[i], u.localShadowOf, i);
+                }
+
+                FSOut out;
+                out.depth = 0.0f;
+                if (u.hdr)
+                {
+                    out.color = {albedo.x * radiance.x, albedo.y * radiance.y,
+                                 albedo.z * radiance.z, 1.0f};
+                    return out;
+                }
+                const float invGamma = 1.0f / u.gamma;
+                out.color = {std::pow(albedo.x * radiance.x, invGamma),
+                             std::pow(albedo.y * radiance.y, invGamma),
+                             std::pow(albedo.z * radiance.z, invGamma), 1.0f};
+                return out;
+            }
+        };
+
+        VSOut defaultVS(const VSIn &, const VSUniform &);
+        FSOut defaultFS(const FSIn &, const FSUniform &);
+    } // namespace shader
+} // namespace renderer
@@ -0,0 +1,88 @@
+﻿#pragma once
+#include "core.h"
+#include "math/math.h"
+#include "scene.h"
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+    // depth-only view of the scene from a light, depth in [0, 1] (D32F, not reversed,
+    // uncompressed: the lookups read the floats directly)
+    struct ShadowView
+    {
+        math::Mat4            VP;
+        core::DepthBuffer     depth{0, 0, core::DepthFormat::D32F, false};
+        float                 texel;               // world size of a texel (cube: at distance 1)
+        float                 sliceNear, sliceFar; // cascades: camera depths covered
+        std::vector<uint32_t> casters;             // objects inside the view, last render
+
+        // depth holds renderedVP of the scene as it was; kept while neither changes
+        bool       rendered = false;
+        math::Mat4 renderedVP;
+    };
+
+    // views of one light: cascades, nearest first (directional)
+    // or cube faces +x -x +y -y +z -z (point)
+    struct LightShadow
+    {
+        uint32_t first, count; // ShadowMaps::views[first, first + count)
+    };
+
+    struct ShadowMaps
+    {
+        std::vector<ShadowView>  views;
+        std::vector<LightShadow> lights;
+        math::Vec3               eye, forward; // camera, picks the cascade
+
+        // 1: lit, 0: shadowed; pos and normal in world space
+        float visibility(const scene::Light &light, int shadow, const math::Vec3 &pos,
+                         const math::Vec3 &n) const
+        {
+            const LightShadow &ls = lights[shadow];
+            if (light.type == scene::LightType::Point)
+            {
+                // the cube face is picked by the major axis of the light -> point direction
+                const math::Vec3 d = pos - light.point.pos;
+                const float      ax = std::fabs(d.x), ay = std::fabs(d.y), az = std::fabs(d.z);
+                int              face = 4 + (d.z < 0.0f);
+                if (ax >= ay && ax >= az)
+                    face = d.x < 0.0f;
+                else if (ay >= az)
+                    face = 2 + (d.y < 0.0f);
+                return sample(views[ls.first + face], pos, n, math::length(d)) ? 1.0f : 0.0f;
+            }
+            // cascade of the point's camera depth; past the last one everything is lit
+            const float depth = math::dot(pos - eye, forward);
+            for (uint32_t i = ls.first; i < ls.first + ls.count; i++)
+                if (depth <= views[i].sliceFar)
+                    return sample(views[i], pos, n, 1.0f) ? 1.0f : 0.0f;
+            return 1.0f;
+        }
+
+      private:
+        // single tap; the point is pushed off the surface by about one texel
+        static bool sample(const ShadowView &v, const math::Vec3 &pos, const math::Vec3 &n,
+                           float dist)
+        {
+            const math::Vec3 p = pos + n * (1.5f * v.texel * dist);
+            const math::Vec4 c = v.VP.mul_point(p);
+            if (c.w <= 0.0f)
+                return true;
+            const float invW = 1.0f / c.w;
+            const float z = c.z * invW * 0.5f + 0.5f;
+            const int   size = v.depth.width;
+            const int   x = std::clamp(int((c.x * invW * 0.5f + 0.5f) * size), 0, size - 1);
+            const int   y = std::clamp(int((0.5f - c.y * invW * 0.5f) * size), 0, size - 1);
+            return z <= v.depth.floats()[v.depth.layout.index(x, y)] + 1e-4f;
+        }
+    };
+
+    // size x size cascades over [cam.znear, distance] of the camera whose view -> world
+    // transform is camWorld; casters are kept along the light up to the scene box
+    void cascadeViews(const scene::Camera &cam, const math::Mat4 &camWorld, float aspect,
+                      float distance, const math::Vec3 &dir, const math::AABB &scene,
+                      int size, ShadowView *views, int count);
+    // six 90 degree size x size views around a point light
+    void cubeViews(const math::Vec3 &pos, float range, int size, ShadowView *views);
+} // namespace renderer
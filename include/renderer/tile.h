@@ -0,0 +1,72 @@
+﻿#pragma once
+#include "math/vec.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace renderer
+{
+    // pixel rect [x0, x1) x [y0, y1)
+    struct TileRect
+    {
+        int x0, y0, x1, y1;
+    };
+
+    // screen split into square tiles; the last column/row may be partial
+    // tileSize is kept a multiple of the 8x8 raster block
+    struct TileGrid
+    {
+        int width = 0, height = 0;
+        int tileSize = 64;
+        int cols = 0, rows = 0;
+
+        void init(int w, int h, int ts)
+        {
+            width = w;
+            height = h;
+            tileSize = std::max((ts + 7) & ~7, 8);
+            cols = (w + tileSize - 1) / tileSize;
+            rows = (h + tileSize - 1) / tileSize;
+        }
+
+        int count() const { return cols * rows; }
+
+        TileRect rect(int tile) const
+        {
+            int tx = tile % cols;
+            int ty = tile / cols;
+            return {tx * tileSize, ty * tileSize, std::min((tx + 1) * tileSize, width),
+                    std::min((ty + 1) * tileSize, height)};
+        }
+    };
+
+    // Triangle lists per tile, filled by one binning worker.
+    // Each worker bins a contiguous slice of the frame's triangles, so walking the
+    // workers' bins in worker order keeps submission order inside a tile.
+    template <class Tri> struct TileBins
+    {
+        std::vector<Tri>                   tris;
+        std::vector<std::vector<uint32_t>> tiles; // tile -> index into tris
+
+        void reset(int tileCount)
+        {
+            tris.clear();
+            tiles.resize(tileCount);
+            for (auto &t : tiles)
+                t.clear();
+        }
+
+        // inclusive pixel bbox, already clamped to the screen
+        void push(const Tri &tri, const TileGrid &grid, int minX, int minY, int maxX, int maxY)
+        {
+            const uint32_t idx = static_cast<uint32_t>(tris.size());
+            tris.push_back(tri);
+
+            const int tx0 = minX / grid.tileSize, tx1 = maxX / grid.tileSize;
+            const int ty0 = minY / grid.tileSize, ty1 = maxY / grid.tileSize;
+            for (int ty = ty0; ty <= ty1; ty++)
+                for (int tx = tx0; tx <= tx1; tx++)
+                    tiles[ty * grid.cols + tx].push_back(idx);
+        }
+    };
+} // namespace renderer
@@ -4,6 +4,7 @@
 #include <vector>
 #include <expected>
 #include <map>
+#include <optional>
 #include <type_traits>
 #include "logger.h"
 
@@ -63,7 +63,10 @@ namespace scene
             struct
             {
                 math::Vec3 pos;
-                math::Vec3 dir;
+                float      range;    // pos and range share the point light's layout
+                math::Vec3 dir;      // unit, cone axis
+                float      cosInner; // full intensity inside the inner cone
+                float      cosOuter; // none outside the outer cone
             } spot;
             struct
             { /* ambient has nothing extra */
@@ -73,6 +76,21 @@ namespace scene
         Light() {}
     };
 
+    enum class ToneMapping
+    {
+        None,     // clamped
+        Reinhard, // x / (1 + x)
+        ACES      // filmic curve (Narkowicz fit)
+    };
+
+    // output transform of the rendered image
+    struct Settings
+    {
+        float       gamma = 2.2f;
+        float       exposure = 1.0f; // linear scale before tone mapping
+        ToneMapping toneMapping = ToneMapping::None;
+    };
+
     struct HandlesById // id -> handle
     {
         std::unordered_map<std::string_view, MeshHandle>     mesh;
@@ -86,6 +104,7 @@ namespace scene
         Camera              camera;
         std::vector<Light>  lights;
         std::vector<Object> objects;
+        Settings            settings;
         HandlesById         handlesById;
 
         Scene() = default;
@@ -0,0 +1,150 @@
+﻿#pragma once
+#include "math/bounds.h"
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace scene
+{
+    // Bounding volume hierarchy over scene objects, one world-space AABB per object.
+    // build(): top-down binned SAH, subtrees below the first levels are built in parallel.
+    // refit(): bottom-up box update for objects that moved, the topology is kept.
+    class Bvh
+    {
+      public:
+        // runs fn(worker) once on each of `workers` workers and waits (renderer::WorkerPool::run)
+        using Parallel = std::function<void(const std::function<void(int worker)> &fn)>;
+
+        struct Node
+        {
+            math::AABB box;
+            uint32_t   left;  // 0: leaf, else children are left and left + 1
+            uint32_t   first; // objects of the subtree are items[first, first + count)
+            uint32_t   count;
+        };
+
+        struct Hit
+        {
+            uint32_t object;
+            float    t; // ray parameter where it enters the object's box
+        };
+
+        static constexpr int kMaxDepth = 64; // traversal stack size, bounds the tree depth
+
+      private:
+        static constexpr uint32_t kNone = ~uint32_t(0);
+
+        std::vector<Node>       nodes;
+        std::vector<uint32_t>   items;   // object indices, ordered by subtree
+        std::vector<uint32_t>   parents; // per node, kNone for the root
+        std::vector<uint32_t>   leafOf;  // per object
+        std::vector<math::AABB> boxes;   // per object
+        std::vector<math::Vec3> centers; // per object, build only
+
+        bool splitNode(std::vector<Node> &out, uint32_t index, int depth);
+        void buildSubtree(std::vector<Node> &out, uint32_t index, int depth);
+        void linkParents();
+
+      public:
+        void build(std::span<const math::AABB> bounds, const Parallel &parallel = {},
+                   int workers = 1);
+        // bounds holds every object, only the moved entries are read
+        void refit(std::span<const uint32_t> moved, std::span<const math::AABB> bounds);
+
+        bool                     empty() const { return nodes.empty(); }
+        uint32_t                 objectCount() const { return uint32_t(boxes.size()); }
+        const math::AABB        &objectBox(uint32_t object) const { return boxes[object]; }
+        const std::vector<Node> &hierarchy() const { return nodes; }
+
+        // fn(object) for every object whose box intersects the frustum
+        template <class Fn> void query(const math::Frustum &f, Fn &&fn) const;
+        // fn(object) for every object whose box intersects the sphere
+        template <class Fn> void query(const math::Sphere &s, Fn &&fn) const;
+        // any object box within the sphere
+        bool overlaps(const math::Sphere &s) const;
+        // nearest object box hit by origin + t * dir, t in [0, tMax]
+        std::optional<Hit> raycast(const math::Vec3 &origin, const math::Vec3 &dir,
+                                   float tMax = FLT_MAX) const;
+    };
+
+    // -1: box outside the frustum, 1: fully inside, 0: crossing
+    inline int classify(const math::Frustum &f, const math::AABB &b)
+    {
+        const math::Vec3 c = b.center(), e = b.extent();
+        int              result = 1;
+        for (const math::Vec4 &p : f.planes)
+        {
+            const float r = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+            const float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            if (d + r < 0.0f)
+                return -1;
+            if (d - r < 0.0f)
+                result = 0;
+        }
+        return result;
+    }
+
+    inline bool intersects(const math::Sphere &s, const math::AABB &b)
+    {
+        const math::Vec3 q{std::clamp(s.center.x, b.min.x, b.max.x),
+                           std::clamp(s.center.y, b.min.y, b.max.y),
+                           std::clamp(s.center.z, b.min.z, b.max.z)};
+        const math::Vec3 d = q - s.center;
+        return math::dot(d, d) <= s.radius * s.radius;
+    }
+
+    template <class Fn> void Bvh::query(const math::Frustum &f, Fn &&fn) const
+    {
+        if (nodes.empty())
+            return;
+
+        uint32_t stack[kMaxDepth];
+        int      top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &n = nodes[stack[--top]];
+            const int   c = classify(f, n.box);
+            if (c < 0)
+                continue;
+            // fully inside: the whole subtree is visible without further tests
+            if (c > 0 || n.left == 0)
+            {
+                for (uint32_t i = n.first; i < n.first + n.count; i++)
+                    if (c > 0 || math::intersects(f, boxes[items[i]]))
+                        fn(items[i]);
+                continue;
+            }
+            stack[top++] = n.left;
+            stack[top++] = n.left + 1;
+        }
+    }
+
+    template <class Fn> void Bvh::query(const math::Sphere &s, Fn &&fn) const
+    {
+        if (nodes.empty())
+            return;
+
+        uint32_t stack[kMaxDepth];
+        int      top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &n = nodes[stack[--top]];
+            if (!intersects(s, n.box))
+                continue;
+            if (n.left == 0)
+            {
+                for (uint32_t i = n.first; i < n.first + n.count; i++)
+                    if (intersects(s, boxes[items[i]]))
+                        fn(items[i]);
+                continue;
+            }
+            stack[top++] = n.left;
+            stack[top++] = n.left + 1;
+        }
+    }
+} // namespace scene
@@ -30,10 +30,23 @@ namespace window
     }
 #undef X
 
-    // (deltaTime, width, height, channels, pixels)
-    using FrameCallback = std::function<bool(float, int, int, int, std::vector<uint8_t>)>;
+    // (deltaTime, width, height, channels, pixels); pixels is the manager's buffer, filled in
+    // place and uploaded after the call
+    using FrameCallback = std::function<bool(float, int, int, int, std::vector<uint8_t> &)>;
     using EventCallback = std::function<void(SDL_Event &)>;
 
+    // locked texture memory of the frame being drawn: rows of pitch bytes, channels bytes per
+    // pixel (byte order R, G, B[, A]); write-only, every pixel must be written
+    // a core::FrameBuffer goes in with fb.resolve(frame.pixels, frame.pitch) (4 channels)
+    struct Frame
+    {
+        uint8_t *pixels;
+        int      pitch;
+        int      width, height, channels;
+    };
+    // (deltaTime, frame)
+    using DirectFrameCallback = std::function<bool(float, Frame &)>;
+
     class Manager
     {
       private:
@@ -42,6 +55,12 @@ namespace window
         SDL_Texture  *texture = nullptr;
         int           width;
         int           height;
+        Uint64        last = 0; // performance counter at the previous frame
+
+        bool  pollEvents(const EventCallback &onEvent);
+        float tick();
+        bool  lock(Frame &frame);
+        void  present();
 
       public:
         int channels = 4;
@@ -51,7 +70,12 @@ namespace window
 
         bool create(const std::string &title, int w, int h, int ch = 4);
         void render(const std::vector<uint8_t> &pixels);
+        // tiled framebuffer of the window's size, resolved straight into the texture
+        void render(const core::FrameBuffer &fb);
         bool loop(const FrameCallback &onFrame, const EventCallback &onEvent = {});
+        // zero-copy loop: onFrame draws straight into the locked streaming texture, no
+        // intermediate buffer and no upload copy
+        bool loopDirect(const DirectFrameCallback &onFrame, const EventCallback &onEvent = {});
         void destroy();
     };
 } // namespace window
@@ -1,11 +1,100 @@
 ﻿#include "asset.h"
+#include "color.h"
 #include "fileIO.h"
+#include <cstring>
 #include <variant>
 
 namespace fs = std::filesystem;
 
 namespace asset
 {
+    namespace
+    {
+        int channelsOf(parser::PixelFormat format)
+        {
+            switch (format)
+            {
+            case parser::PixelFormat::Gray8:
+                return 1;
+            case parser::PixelFormat::GA8:
+                return 2;
+            case parser::PixelFormat::RGB8:
+            case parser::PixelFormat::RGB16:
+                return 3;
+            case parser::PixelFormat::RGBA8:
+            case parser::PixelFormat::RGBA16:
+                return 4;
+            }
+            return 4;
+        }
+
+        // row y as linear RGBA; gray fills rgb, missing alpha is 1. 8 bit sRGB goes through
+        // the array srgb8ToLinear a row at a time, 16 bit samples are big-endian (png, ppm)
+        void linearRow(const parser::ImageBuffer &img, int y, std::vector<float> &values,
+                       math::Vec4 *out)
+        {
+            const int    channels = channelsOf(img.format);
+            const bool   wide = img.format == parser::PixelFormat::RGB16 ||
+                                img.format == parser::PixelFormat::RGBA16;
+            const bool   srgb = img.transFunc == parser::TransferFunc::NonLinear;
+            const size_t n = size_t(img.width) * channels, first = size_t(y) * n;
+            values.resize(n);
+            if (wide)
+            {
+                const uint8_t *p = &img.pixels[2 * first];
+                for (size_t k = 0; k < n; k++)
+                    values[k] = float(p[2 * k] << 8 | p[2 * k + 1]) / 65535.0f;
+            }
+            else if (srgb)
+                color::srgb8ToLinear(&img.pixels[first], values.data(), n);
+            else
+            {
+                for (size_t k = 0; k < n; k++)
+                    values[k] = float(img.pixels[first + k]) / 255.0f;
+            }
+
+            const float *v = values.data();
+            for (int x = 0; x < img.width; x++, v += channels)
+            {
+                math::Vec4 c{0, 0, 0, 1};
+                if (channels <= 2)
+                    c.x = c.y = c.z = v[0];
+                else
+                    c = {v[0], v[1], v[2], 1.0f};
+                if (wide && srgb)
+                    c = color::srgbToLinear(c);
+                if (channels == 2 || channels == 4)
+                {
+                    c.w = v[channels - 1];
+                    // alpha is linear: 8 bit sRGB rows take it from the byte, not the table
+                    if (!wide && srgb)
+                        c.w = img.pixels[first + size_t(x) * channels + channels - 1] / 255.0f;
+                }
+                out[x] = c;
+            }
+        }
+
+        // the smallest format that keeps the image
+        core::Texture::Format formatFor(const parser::ImageBuffer &img)
+        {
+            using Format = core::Texture::Format;
+            const bool srgb = img.transFunc == parser::TransferFunc::NonLinear;
+            switch (img.format)
+            {
+            case parser::PixelFormat::Gray8:
+                return srgb ? Format::RGBA8Srgb : Format::R8;
+            case parser::PixelFormat::GA8:
+            case parser::PixelFormat::RGB8:
+            case parser::PixelFormat::RGBA8:
+                return srgb ? Format::RGBA8Srgb : Format::RGBA8;
+            case parser::PixelFormat::RGB16:
+            case parser::PixelFormat::RGBA16:
+                return Format::RGBA16F;
+            }
+            return Format::RGBA32F;
+        }
+    } // namespace
+
     // todo: 데이터 유효성 확인
     // todo: 함수 분리
     Result<scene::Scene> loader::loadSceneAndResources(const fs::path    &sceneJson,
@@ -18,6 +107,7 @@ namespace asset
         parser::SceneConfig &config = configResult.value();
         scene::Scene         outScene;
         outScene.name = config.name;
+        outScene.settings = config.settings;
 
         // camera
         parser::CameraConfig &cam = config.camera;
@@ -29,8 +119,8 @@ namespace asset
             outScene.addLight(lightCfg);
         }
 
-        // materials
-        // todo: texture ?
+        // materials, with their textures loaded once per file
+        std::unordered_map<std::string, TextureHandle> textures;
         for (const auto &materialCfg : config.materials)
         {
             // load
@@ -38,7 +128,29 @@ namespace asset
             if (!materialResult)
                 return std::unexpected(materialResult.error());
             resource::MaterialKey key{materialCfg.name};
-            core::Material       &material = materialResult.value();
+            core::Material       &material = materialResult.value().material;
+
+            // base color map (map_Kd), relative to the mtl file
+            const std::string &map = materialResult.value().baseColorMap;
+            if (!map.empty())
+            {
+                resource::TextureKey texKey{
+                    (fs::path(materialCfg.file).parent_path() / map).lexically_normal().string()};
+                auto found = textures.find(texKey);
+                if (found == textures.end())
+                {
+                    auto textureResult = loadTexture(texKey);
+                    if (!textureResult)
+                        return std::unexpected(textureResult.error());
+
+                    auto texRegister = mgr.registerTexture(texKey, &textureResult.value());
+                    resource::logRegisterOutcome(texRegister, texKey);
+                    if (resource::isRegisterFailed(texRegister))
+                        return std::unexpected(asset::ErrorCode::OperationFail);
+                    found = textures.emplace(texKey, texRegister.handle).first;
+                }
+                material.baseColorTex = found->second;
+            }
 
             // register
             auto registerResult = mgr.registerMaterial(key, &material);
@@ -88,7 +200,8 @@ namespace asset
         return (parser::obj(text));
     }
 
-    Result<core::Material> loader::loadMaterial(const fs::path &mtlPath, std::string_view name)
+    Result<parser::MaterialEntry> loader::loadMaterial(const fs::path  &mtlPath,
+                                                       std::string_view name)
     {
         std::string text = fileIO::readText(mtlPath);
         auto        result = parser::mtl(text);
@@ -96,7 +209,7 @@ namespace asset
             return std::unexpected(result.error());
 
         parser::MaterialEntries &materials = result.value();
-        return materials[name];
+        return materials[std::string(name)];
     }
 
     Result<parser::MaterialEntries> loader::loadMaterialList(const fs::path &mtlPath)
@@ -109,11 +222,66 @@ namespace asset
     {
         std::vector<std::byte> bytes = fileIO::readBytes(imgPath);
 
-        if (imgPath.extension() == "ppm")
+        if (imgPath.extension() == ".ppm")
             return parser::ppm(bytes);
-        else if (imgPath.extension() == "png")
+        else if (imgPath.extension() == ".png")
             return parser::png(bytes);
         else
             return std::unexpected(ErrorCode::InvalidParam);
     }
-} // namespace asset
\ No newline at end of file
+
+    Result<core::Texture> loader::loadTexture(const fs::path                      &imgPath,
+                                              std::optional<core::Texture::Format> format)
+    {
+        auto imageResult = loadImage(imgPath);
+        if (!imageResult)
+            return std::unexpected(imageResult.error());
+
+        const parser::ImageBuffer &img = imageResult.value();
+        if (img.width <= 0 || img.height <= 0)
+            return std::unexpected(ErrorCode::InvalidFormat);
+
+        // texels are encoded from the image a row at a time, never held as floats all at once;
+        // block formats are compressed from an 8 bit texture with its mips
+        using Format = core::Texture::Format;
+        const Format target = format.value_or(formatFor(img));
+        Format       base = target;
+        if (core::Texture::isCompressed(target))
+        {
+            const bool srgbBlocks = target == Format::BC1Srgb || target == Format::BC3Srgb ||
+                                    target == Format::BC7Srgb;
+            base = target == Format::BC5 ? Format::RG8
+                                         : (srgbBlocks ? Format::RGBA8Srgb : Format::RGBA8);
+        }
+        core::Texture tex;
+        tex.create(img.width, img.height, base);
+
+        const bool srgb = img.transFunc == parser::TransferFunc::NonLinear;
+        const int  channels = channelsOf(img.format);
+        const bool sameBytes =
+            (img.format == parser::PixelFormat::RGBA8 &&
+             tex.format == (srgb ? Format::RGBA8Srgb : Format::RGBA8)) ||
+            (img.format == parser::PixelFormat::Gray8 && !srgb && tex.format == Format::R8);
+        std::vector<float>      values;
+        std::vector<math::Vec4> row(sameBytes ? 0 : img.width);
+        for (int y = 0; y < img.height; y++)
+        {
+            if (!sameBytes)
+            {
+                linearRow(img, y, values, row.data());
+                tex.storeRow(0, y, row.data());
+                continue;
+            }
+            for (int x = 0; x < img.width; x++)
+            {
+                const size_t i = size_t(y) * img.width + x;
+                std::memcpy(tex.bytes(0, x, y), &img.pixels[i * channels], channels);
+            }
+        }
+
+        // mips are built once here, sampling never touches level 0 of a minified texture
+        tex.generateMips();
+        tex.compress(target);
+        return tex;
+    }
+} // namespace asset
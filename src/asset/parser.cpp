@@ -2,6 +2,8 @@
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 #include "asset.h"
+#include <map>
+#include <tuple>
 
 namespace asset
 {
@@ -42,6 +44,8 @@ namespace asset
             sm.material = matHandle;
             sm.idxStart = idxStart;
             sm.idxEnd = idxStart;
+            sm.vtxStart = static_cast<uint32_t>(out.vertices.size());
+            sm.vtxEnd = sm.vtxStart;
             return sm;
         };
 
@@ -92,13 +96,27 @@ namespace asset
         bool          has_open_submesh = false;
         core::Submesh cur{};
 
+        auto vertexPosition = [](const core::Vertex &v) { return v.position; };
+
+        // (v, vn, vt) -> vertex, shared within a submesh so the renderer transforms
+        // each corner once
+        std::map<std::tuple<int, int, int>, uint32_t> vertexOf;
+
         auto flush_current_submesh = [&]()
         {
             if (has_open_submesh)
             {
-                cur.idxEnd = static_cast<uint32_t>(out.indices.size()); // exclusive
+                cur.idxEnd = static_cast<uint32_t>(out.indices.size());  // exclusive
+                cur.vtxEnd = static_cast<uint32_t>(out.vertices.size()); // exclusive
+
+                const auto first = out.vertices.begin() + cur.vtxStart;
+                const auto last = out.vertices.begin() + cur.vtxEnd;
+                for (auto it = first; it != last; ++it)
+                    math::expand(cur.bounds, it->position);
+                cur.sphere = math::boundingSphere(cur.bounds, first, last, vertexPosition);
                 out.subs.push_back(cur);
                 has_open_submesh = false;
+                vertexOf.clear();
             }
         };
 
@@ -138,9 +156,12 @@ namespace asset
                 for (int v = 0; v < fv; ++v)
                 {
                     const tinyobj::index_t idx = msh.indices[face_offset + v];
-                    const core::Vertex     vert = idxToVertex(idx);
-                    out.vertices.push_back(vert);
-                    out.indices.push_back(static_cast<uint32_t>(out.vertices.size() - 1));
+                    const uint32_t         next = static_cast<uint32_t>(out.vertices.size());
+                    auto [it, inserted] = vertexOf.try_emplace(
+                        {idx.vertex_index, idx.normal_index, idx.texcoord_index}, next);
+                    if (inserted)
+                        out.vertices.push_back(idxToVertex(idx));
+                    out.indices.push_back(it->second);
                 }
 
                 face_offset += fv;
@@ -148,6 +169,12 @@ namespace asset
         }
         // 마지막 서브메시 flush
         flush_current_submesh();
+
+        // 컬링용 바운딩 볼륨 (local space)
+        for (const core::Submesh &sm : out.subs)
+            math::expand(out.bounds, sm.bounds);
+        out.sphere = math::boundingSphere(out.bounds, out.vertices.begin(), out.vertices.end(),
+                                          vertexPosition);
         return out;
     }
 
@@ -192,7 +219,7 @@ namespace asset
             }
 
             // entries에 추가
-            entries[materialName] = coreMat;
+            entries[materialName] = {coreMat, tinyMat.diffuse_texname};
         }
 
         return entries;
@@ -295,20 +322,41 @@ namespace asset
                         else if (type_str == "spot")
                         {
                             light.type = scene::LightType::Spot;
+                            light.spot.cosInner = light.spot.cosOuter =
+                                std::cos(math::radians(45.0f));
                         }
                     }
 
-                    // Direction (for directional lights)
+                    // Direction (for directional and spot lights)
                     auto dir_array = light_elem["dir"].get_array();
                     if (dir_array.error() == simdjson::SUCCESS)
                     {
-                        auto it = dir_array.value().begin();
-                        light.directional.dir.x = double(*it++);
-                        light.directional.dir.y = double(*it++);
-                        light.directional.dir.z = double(*it);
+                        math::Vec3 &dir = light.type == scene::LightType::Spot
+                                              ? light.spot.dir
+                                              : light.directional.dir;
+                        auto        it = dir_array.value().begin();
+                        dir.x = double(*it++);
+                        dir.y = double(*it++);
+                        dir.z = double(*it);
+                        if (light.type == scene::LightType::Spot)
+                            dir = math::normalize(dir);
                     }
 
-                    // Position (for point lights)
+                    // Cone half angles in degrees (for spot lights)
+                    double inner_angle, outer_angle;
+                    if (light.type == scene::LightType::Spot &&
+                        light_elem["outer_angle"].get(outer_angle) == simdjson::SUCCESS)
+                    {
+                        light.spot.cosOuter = std::cos(math::radians(float(outer_angle)));
+                        light.spot.cosInner = light.spot.cosOuter;
+                    }
+                    if (light.type == scene::LightType::Spot &&
+                        light_elem["inner_angle"].get(inner_angle) == simdjson::SUCCESS)
+                    {
+                        light.spot.cosInner = std::cos(math::radians(float(inner_angle)));
+                    }
+
+                    // Position (for point and spot lights)
                     auto pos_array = light_elem["pos"].get_array();
                     if (pos_array.error() == simdjson::SUCCESS)
                     {
@@ -335,7 +383,7 @@ namespace asset
                         light.intensity = static_cast<float>(intensity);
                     }
 
-                    // Range (for point lights)
+                    // Range (for point and spot lights)
                     double range;
                     if (light_elem["range"].get(range) == simdjson::SUCCESS)
                     {
@@ -353,6 +401,42 @@ namespace asset
                 }
             }
 
+            // Settings
+            auto settings_elem = doc["settings"];
+            if (settings_elem.error() == simdjson::SUCCESS)
+            {
+                double gamma, exposure;
+                if (settings_elem["gamma"].get(gamma) == simdjson::SUCCESS)
+                {
+                    config.settings.gamma = static_cast<float>(gamma);
+                }
+                if (settings_elem["exposure"].get(exposure) == simdjson::SUCCESS)
+                {
+                    config.settings.exposure = static_cast<float>(exposure);
+                }
+
+                std::string_view tone_view;
+                if (settings_elem["tone_mapping"].get(tone_view) == simdjson::SUCCESS)
+                {
+                    if (tone_view == "ACES")
+                    {
+                        config.settings.toneMapping = scene::ToneMapping::ACES;
+                    }
+                    else if (tone_view == "Reinhard")
+                    {
+                        config.settings.toneMapping = scene::ToneMapping::Reinhard;
+                    }
+                    else if (tone_view == "None")
+                    {
+                        config.settings.toneMapping = scene::ToneMapping::None;
+                    }
+                    else
+                    {
+                        return std::unexpected(ErrorCode::InvalidFormat);
+                    }
+                }
+            }
+
             // Materials
             auto materials_array = doc["materials"].get_array();
             if (materials_array.error() == simdjson::SUCCESS)
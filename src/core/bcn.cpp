@@ -0,0 +1,515 @@
+﻿#include "bcn.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace bcn
+{
+    namespace
+    {
+        // ------------------------------ BC1 / BC4 -----------------------------
+
+        void unpack565(uint16_t c, int rgb[3])
+        {
+            const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            rgb[0] = r << 3 | r >> 2;
+            rgb[1] = g << 2 | g >> 4;
+            rgb[2] = b << 3 | b >> 2;
+        }
+
+        uint16_t pack565(const float rgb[3])
+        {
+            auto q = [](float v, int max)
+            { return std::clamp(int(v * max / 255.0f + 0.5f), 0, max); };
+            return uint16_t(q(rgb[0], 31) << 11 | q(rgb[1], 63) << 5 | q(rgb[2], 31));
+        }
+
+        // four colors always for BC3, otherwise three + transparent black when c0 <= c1
+        void colorPalette(uint16_t c0, uint16_t c1, bool fourColors, int pal[4][4])
+        {
+            unpack565(c0, pal[0]);
+            unpack565(c1, pal[1]);
+            pal[0][3] = pal[1][3] = pal[2][3] = pal[3][3] = 255;
+            for (int c = 0; c < 3; c++)
+            {
+                if (fourColors || c0 > c1)
+                {
+                    pal[2][c] = (2 * pal[0][c] + pal[1][c] + 1) / 3;
+                    pal[3][c] = (pal[0][c] + 2 * pal[1][c] + 1) / 3;
+                }
+                else
+                {
+                    pal[2][c] = (pal[0][c] + pal[1][c] + 1) / 2;
+                    pal[3][c] = 0;
+                }
+            }
+            if (!fourColors && c0 <= c1)
+                pal[3][3] = 0;
+        }
+
+        void decodeColor(const uint8_t *block, uint8_t out[16][4], bool fourColors)
+        {
+            int pal[4][4];
+            colorPalette(uint16_t(block[0] | block[1] << 8), uint16_t(block[2] | block[3] << 8),
+                         fourColors, pal);
+            uint32_t bits;
+            std::memcpy(&bits, block + 4, sizeof(bits));
+            for (int i = 0; i < 16; i++)
+                for (int c = 0; c < 4; c++)
+                    out[i][c] = uint8_t(pal[(bits >> (2 * i)) & 3][c]);
+        }
+
+        void alphaPalette(int a0, int a1, int pal[8])
+        {
+            pal[0] = a0;
+            pal[1] = a1;
+            if (a0 > a1)
+            {
+                for (int i = 1; i <= 6; i++)
+                    pal[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+            }
+            else
+            {
+                for (int i = 1; i <= 4; i++)
+                    pal[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+                pal[6] = 0;
+                pal[7] = 255;
+            }
+        }
+
+        // one channel, 8 bytes: two endpoints + 3 bit indices
+        void decodeBC4(const uint8_t *block, uint8_t out[16][4], int channel)
+        {
+            int pal[8];
+            alphaPalette(block[0], block[1], pal);
+            uint64_t bits = 0;
+            for (int k = 0; k < 6; k++)
+                bits |= uint64_t(block[2 + k]) << (8 * k);
+            for (int i = 0; i < 16; i++)
+                out[i][channel] = uint8_t(pal[(bits >> (3 * i)) & 7]);
+        }
+
+        void encodeBC4(const uint8_t in[16][4], int channel, uint8_t *block)
+        {
+            int lo = 255, hi = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                lo = std::min<int>(lo, in[i][channel]);
+                hi = std::max<int>(hi, in[i][channel]);
+            }
+            // hi > lo: the eight-value palette
+            int pal[8];
+            alphaPalette(hi, lo, pal);
+            uint64_t bits = 0;
+            for (int i = 0; i < 16 && hi > lo; i++)
+            {
+                int best = 0, bestErr = 256;
+                for (int k = 0; k < 8; k++)
+                {
+                    const int err = std::abs(pal[k] - in[i][channel]);
+                    if (err < bestErr)
+                    {
+                        best = k;
+                        bestErr = err;
+                    }
+                }
+                bits |= uint64_t(best) << (3 * i);
+            }
+            block[0] = uint8_t(hi);
+            block[1] = uint8_t(lo);
+            for (int k = 0; k < 6; k++)
+                block[2 + k] = uint8_t(bits >> (8 * k));
+        }
+
+        // ends of the block's colors along their principal axis (channels < n)
+        void principalRange(const uint8_t in[16][4], int n, float lo[4], float hi[4])
+        {
+            float mean[4] = {};
+            for (int i = 0; i < 16; i++)
+                for (int c = 0; c < n; c++)
+                    mean[c] += in[i][c] / 16.0f;
+
+            float cov[4][4] = {};
+            for (int i = 0; i < 16; i++)
+                for (int a = 0; a < n; a++)
+                    for (int b = 0; b < n; b++)
+                        cov[a][b] += (in[i][a] - mean[a]) * (in[i][b] - mean[b]);
+
+            // power iteration
+            float axis[4] = {1, 1, 1, 1};
+            for (int it = 0; it < 8; it++)
+            {
+                float next[4] = {}, len = 0.0f;
+                for (int a = 0; a < n; a++)
+                {
+                    for (int b = 0; b < n; b++)
+                        next[a] += cov[a][b] * axis[b];
+                    len = std::max(len, std::fabs(next[a]));
+                }
+                if (len == 0.0f)
+                    break;
+                for (int a = 0; a < n; a++)
+                    axis[a] = next[a] / len;
+            }
+            float len2 = 0.0f;
+            for (int a = 0; a < n; a++)
+                len2 += axis[a] * axis[a];
+
+            float tMin = 0.0f, tMax = 0.0f;
+            for (int i = 0; i < 16 && len2 > 0.0f; i++)
+            {
+                float t = 0.0f;
+                for (int c = 0; c < n; c++)
+                    t += (in[i][c] - mean[c]) * axis[c];
+                tMin = std::min(tMin, t / len2);
+                tMax = std::max(tMax, t / len2);
+            }
+            for (int c = 0; c < n; c++)
+            {
+                lo[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+                hi[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+            }
+        }
+
+        void encodeColor(const uint8_t in[16][4], uint8_t *block)
+        {
+            float lo[4], hi[4];
+            principalRange(in, 3, lo, hi);
+            uint16_t c0 = pack565(hi), c1 = pack565(lo);
+            if (c0 < c1)
+                std::swap(c0, c1);
+
+            // c0 > c1: four colors in either format; c0 == c1: index 0 is exact
+            int pal[4][4];
+            colorPalette(c0, c1, true, pal);
+            uint32_t bits = 0;
+            for (int i = 0; i < 16 && c0 != c1; i++)
+            {
+                int best = 0, bestErr = INT32_MAX;
+                for (int k = 0; k < 4; k++)
+                {
+                    int err = 0;
+                    for (int c = 0; c < 3; c++)
+                        err += (pal[k][c] - in[i][c]) * (pal[k][c] - in[i][c]);
+                    if (err < bestErr)
+                    {
+                        best = k;
+                        bestErr = err;
+                    }
+                }
+                bits |= uint32_t(best) << (2 * i);
+            }
+            block[0] = uint8_t(c0);
+            block[1] = uint8_t(c0 >> 8);
+            block[2] = uint8_t(c1);
+            block[3] = uint8_t(c1 >> 8);
+            std::memcpy(block + 4, &bits, sizeof(bits));
+        }
+
+        // --------------------------------- BC7 --------------------------------
+
+        struct Mode
+        {
+            uint8_t subsets, partitionBits, rotationBits, indexSelBits;
+            uint8_t colorBits, alphaBits, endpointPBits, sharedPBits;
+            uint8_t indexBits, index2Bits;
+        };
+
+        constexpr Mode kModes[8] = {
+            {3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+            {3, 6, 0, 0, 5, 0, 0, 0, 2, 0}, {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+            {1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+            {1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+        };
+
+        // subset of pixel i: bit i (two subsets), bits 2i..2i+1 (three subsets)
+        constexpr uint16_t kPartition2[64] = {
+            0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80,
+            0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000, 0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310,
+            0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c, 0xaaaa,
+            0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc,
+            0x6996, 0xc33c, 0x9966, 0x0660, 0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6,
+            0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+        };
+        constexpr uint32_t kPartition3[64] = {
+            0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0,
+            0x5a5a5050, 0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4,
+            0xa9a59450, 0x2a0a4250, 0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454,
+            0x6a6a4040, 0xa4a45000, 0x1a1a0500, 0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400,
+            0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200, 0xa9a58000, 0x5090a0a8, 0xa8a09050,
+            0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50, 0x500aa550, 0xaaaa4444,
+            0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600, 0xaa444444,
+            0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+            0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44,
+            0x2a4a5254,
+        };
+
+        // anchor pixels (index stored with one bit less) of subsets 1 and 2; subset 0: pixel 0
+        constexpr uint8_t kAnchor2[64] = {
+            15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 2,  8,  2,  2,  8,
+            8,  15, 2,  8,  2,  2,  8,  8,  2,  2,  15, 15, 6,  8,  2,  8,  15, 15, 2,  8,  2,  2,
+            2,  15, 15, 6,  6,  2,  6,  8,  15, 15, 2,  2,  15, 15, 15, 15, 15, 2,  2,  15,
+        };
+        constexpr uint8_t kAnchor3a[64] = {
+            3,  3,  15, 15, 8,  3,  15, 15, 8,  8,  6,  6,  6,  5,  3,  3,  3,  3,  8,  15, 3,  3,
+            6,  10, 5,  8,  8,  6,  8,  5,  15, 15, 8,  15, 3,  5,  6,  10, 8,  15, 15, 3,  15, 5,
+            15, 15, 15, 15, 3,  15, 5,  5,  5,  8,  5,  10, 5,  10, 8,  13, 15, 12, 3,  3,
+        };
+        constexpr uint8_t kAnchor3b[64] = {
+            15, 8,  8,  3,  15, 15, 3,  8,  15, 15, 15, 15, 15, 15, 15, 8,  15, 8,  15, 3,  15, 8,
+            15, 8,  3,  15, 6,  10, 15, 15, 10, 8,  15, 3,  15, 10, 10, 8,  9,  10, 6,  15, 8,  15,
+            3,  6,  6,  8,  15, 3,  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3,  15, 15, 8,
+        };
+
+        constexpr uint8_t kWeights2[4] = {0, 21, 43, 64};
+        constexpr uint8_t kWeights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+        constexpr uint8_t kWeights4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                           34, 38, 43, 47, 51, 55, 60, 64};
+
+        const uint8_t *weightsFor(int bits)
+        {
+            return bits == 2 ? kWeights2 : (bits == 3 ? kWeights3 : kWeights4);
+        }
+
+        int interpolate(int e0, int e1, int w) { return ((64 - w) * e0 + w * e1 + 32) >> 6; }
+
+        // bits are packed from the lowest bit of byte 0 up
+        struct BitReader
+        {
+            const uint8_t *p;
+            int            pos;
+
+            uint32_t read(int n)
+            {
+                uint32_t v = 0;
+                for (int i = 0; i < n; i++, pos++)
+                    v |= uint32_t((p[pos >> 3] >> (pos & 7)) & 1) << i;
+                return v;
+            }
+        };
+
+        struct BitWriter
+        {
+            uint8_t *p;
+            int      pos;
+
+            void write(uint32_t v, int n)
+            {
+                for (int i = 0; i < n; i++, pos++)
+                    p[pos >> 3] |= uint8_t(((v >> i) & 1) << (pos & 7));
+            }
+        };
+
+        // n bit endpoint -> 8 bits, top bits replicated into the low ones
+        int expand(int v, int bits)
+        {
+            const int x = v << (8 - bits);
+            return x | x >> bits;
+        }
+    } // namespace
+
+    void decodeBC1(const uint8_t *block, uint8_t out[16][4]) { decodeColor(block, out, false); }
+
+    void encodeBC1(const uint8_t in[16][4], uint8_t *block) { encodeColor(in, block); }
+
+    void decodeBC3(const uint8_t *block, uint8_t out[16][4])
+    {
+        decodeColor(block + 8, out, true);
+        decodeBC4(block, out, 3);
+    }
+
+    void encodeBC3(const uint8_t in[16][4], uint8_t *block)
+    {
+        encodeBC4(in, 3, block);
+        encodeColor(in, block + 8);
+    }
+
+    void decodeBC5(const uint8_t *block, uint8_t out[16][4])
+    {
+        decodeBC4(block, out, 0);
+        decodeBC4(block + 8, out, 1);
+        for (int i = 0; i < 16; i++)
+        {
+            out[i][2] = 0;
+            out[i][3] = 255;
+        }
+    }
+
+    void encodeBC5(const uint8_t in[16][4], uint8_t *block)
+    {
+        encodeBC4(in, 0, block);
+        encodeBC4(in, 1, block + 8);
+    }
+
+    void decodeBC7(const uint8_t *block, uint8_t out[16][4])
+    {
+        int mode = 0;
+        while (mode < 8 && !((block[0] >> mode) & 1))
+            mode++;
+        if (mode == 8) // reserved: transparent black
+        {
+            std::memset(out, 0, 16 * 4);
+            return;
+        }
+
+        const Mode &m = kModes[mode];
+        BitReader   bits{block, mode + 1};
+        const int   partition = bits.read(m.partitionBits);
+        const int   rotation = bits.read(m.rotationBits);
+        const int   indexSel = bits.read(m.indexSelBits);
+
+        // endpoints 2s, 2s + 1 of subset s; channel by channel, then the p-bits
+        int       ep[6][4];
+        const int n = 2 * m.subsets;
+        for (int c = 0; c < 3; c++)
+            for (int e = 0; e < n; e++)
+                ep[e][c] = bits.read(m.colorBits);
+        for (int e = 0; e < n; e++)
+            ep[e][3] = m.alphaBits ? bits.read(m.alphaBits) : 255;
+
+        int colorBits = m.colorBits, alphaBits = m.alphaBits;
+        if (m.endpointPBits || m.sharedPBits)
+        {
+            int p[6];
+            for (int e = 0; e < n; e++)
+                p[e] = m.endpointPBits ? bits.read(1) : (e & 1 ? p[e - 1] : bits.read(1));
+            for (int e = 0; e < n; e++)
+                for (int c = 0; c < (m.alphaBits ? 4 : 3); c++)
+                    ep[e][c] = ep[e][c] << 1 | p[e];
+            colorBits++;
+            alphaBits += m.alphaBits ? 1 : 0;
+        }
+        for (int e = 0; e < n; e++)
+        {
+            for (int c = 0; c < 3; c++)
+                ep[e][c] = expand(ep[e][c], colorBits);
+            if (m.alphaBits)
+                ep[e][3] = expand(ep[e][3], alphaBits);
+        }
+
+        auto subsetOf = [&](int i)
+        {
+            if (m.subsets == 2)
+                return int((kPartition2[partition] >> i) & 1);
+            if (m.subsets == 3)
+                return int((kPartition3[partition] >> (2 * i)) & 3);
+            return 0;
+        };
+        auto isAnchor = [&](int i)
+        {
+            return i == 0 || (m.subsets == 2 && i == kAnchor2[partition]) ||
+                   (m.subsets == 3 && (i == kAnchor3a[partition] || i == kAnchor3b[partition]));
+        };
+
+        int index[16], index2[16] = {};
+        for (int i = 0; i < 16; i++)
+            index[i] = bits.read(m.indexBits - isAnchor(i));
+        for (int i = 0; i < 16 && m.index2Bits; i++)
+            index2[i] = bits.read(m.index2Bits - (i == 0));
+
+        // modes 4, 5: color and alpha use separate index sets, swapped by indexSel
+        const uint8_t *colorW = weightsFor(m.indexBits), *alphaW = colorW;
+        const int     *colorIdx = index, *alphaIdx = index;
+        if (m.index2Bits)
+        {
+            alphaW = weightsFor(m.index2Bits);
+            alphaIdx = index2;
+            if (indexSel)
+            {
+                std::swap(colorW, alphaW);
+                std::swap(colorIdx, alphaIdx);
+            }
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int *e0 = ep[2 * subsetOf(i)], *e1 = e0 + 4;
+            int        c[4];
+            for (int k = 0; k < 3; k++)
+                c[k] = interpolate(e0[k], e1[k], colorW[colorIdx[i]]);
+            c[3] = interpolate(e0[3], e1[3], alphaW[alphaIdx[i]]);
+            if (rotation)
+                std::swap(c[3], c[rotation - 1]);
+            for (int k = 0; k < 4; k++)
+                out[i][k] = uint8_t(c[k]);
+        }
+    }
+
+    void encodeBC7(const uint8_t in[16][4], uint8_t *block)
+    {
+        float lo[4], hi[4];
+        principalRange(in, 4, lo, hi);
+
+        // 7 bit endpoint + p-bit: the p-bit with the smaller error over all channels
+        auto quantize = [](const float v[4], int q[4], int &p)
+        {
+            float best = -1.0f;
+            for (int pb = 0; pb < 2; pb++)
+            {
+                int   t[4];
+                float err = 0.0f;
+                for (int c = 0; c < 4; c++)
+                {
+                    t[c] = std::clamp(int((v[c] - pb) * 0.5f + 0.5f), 0, 127);
+                    const float d = float(t[c] << 1 | pb) - v[c];
+                    err += d * d;
+                }
+                if (best < 0.0f || err < best)
+                {
+                    best = err;
+                    p = pb;
+                    std::copy(t, t + 4, q);
+                }
+            }
+        };
+        int q[2][4], p[2] = {0, 0};
+        quantize(lo, q[0], p[0]);
+        quantize(hi, q[1], p[1]);
+
+        int e[2][4];
+        for (int k = 0; k < 2; k++)
+            for (int c = 0; c < 4; c++)
+                e[k][c] = q[k][c] << 1 | p[k];
+
+        int index[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestErr = INT32_MAX;
+            for (int k = 0; k < 16; k++)
+            {
+                int err = 0;
+                for (int c = 0; c < 4; c++)
+                {
+                    const int d = interpolate(e[0][c], e[1][c], kWeights4[k]) - in[i][c];
+                    err += d * d;
+                }
+                if (err < bestErr)
+                {
+                    best = k;
+                    bestErr = err;
+                }
+            }
+            index[i] = best;
+        }
+        // pixel 0 is stored with 3 bits: swap the endpoints when its index needs the fourth
+        if (index[0] & 8)
+        {
+            std::swap(q[0], q[1]);
+            std::swap(p[0], p[1]);
+            for (int &i : index)
+                i = 15 - i;
+        }
+
+        std::memset(block, 0, 16);
+        BitWriter bits{block, 0};
+        bits.write(1u << 6, 7);
+        for (int c = 0; c < 4; c++)
+            for (int k = 0; k < 2; k++)
+                bits.write(q[k][c], 7);
+        bits.write(p[0], 1);
+        bits.write(p[1], 1);
+        for (int i = 0; i < 16; i++)
+            bits.write(index[i], i == 0 ? 3 : 4);
+    }
+} // namespace bcn
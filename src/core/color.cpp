@@ -0,0 +1,112 @@
+﻿#include "color.h"
+#include <array>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace color
+{
+    const float *srgb8ToLinearTable() noexcept
+    {
+        static const auto table = []
+        {
+            std::array<float, 256> t;
+            for (int i = 0; i < 256; i++)
+                t[i] = srgbToLinear(i / 255.0f);
+            return t;
+        }();
+        return table.data();
+    }
+
+    const LinearToSrgb8Table &linearToSrgb8Table() noexcept
+    {
+        using T = LinearToSrgb8Table;
+        static const T table = []
+        {
+            // in double, so codes and thresholds agree at the bucket edges
+            auto encode = [](double l)
+            {
+                return l <= 0.0031308 ? 12.92 * l : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            };
+            auto decode = [](double s)
+            {
+                return s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4);
+            };
+            auto start = [](int i) // first value of bucket i
+            {
+                return i == 0 ? 0.0f : std::bit_cast<float>((T::kFirst + i - 1) << 15);
+            };
+
+            T t{};
+            for (int i = 0; i < T::kBuckets; i++)
+            {
+                const int    code = int(encode(start(i)) * 255.0 + 0.5);
+                const double next = decode((code + 0.5) / 255.0);
+                const double end = i + 1 < T::kBuckets ? start(i + 1) : 1.0;
+                t.code[i] = uint8_t(code);
+                t.threshold[i] = code < 255 && next < end ? float(next) : 2.0f;
+                if (t.threshold[i] == 2.0f)
+                    continue;
+                // the nearest float to the boundary may be on either side of it
+                auto roundsUp = [&](float l) { return encode(l) * 255.0 + 0.5 >= code + 1; };
+                float &thr = t.threshold[i];
+                while (!roundsUp(thr))
+                    thr = std::nextafter(thr, 2.0f);
+                while (roundsUp(std::nextafter(thr, 0.0f)))
+                    thr = std::nextafter(thr, 0.0f);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    void srgb8ToLinear(const uint8_t *in, float *out, size_t count) noexcept
+    {
+        const float *lut = srgb8ToLinearTable();
+        size_t       i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i s = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i)));
+            _mm256_storeu_ps(out + i, _mm256_i32gather_ps(lut, s, 4));
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = lut[in[i]];
+    }
+
+    void linearToSrgb8(const float *in, uint8_t *out, size_t count) noexcept
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        using T = LinearToSrgb8Table;
+        const T      &t = linearToSrgb8Table();
+        const __m256  below = _mm256_set1_ps(T::kBelowOne);
+        const __m256i first = _mm256_set1_epi32(int(T::kFirst) - 1);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 8 <= count; i += 8)
+        {
+            // max(x, 0) first: NaN -> 0
+            const __m256  l = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i),
+                                                          _mm256_setzero_ps()), below);
+            const __m256i top = _mm256_srli_epi32(_mm256_castps_si256(l), 15);
+            const __m256i b = _mm256_max_epi32(_mm256_sub_epi32(top, first),
+                                               _mm256_setzero_si256());
+            const __m256  thr = _mm256_i32gather_ps(t.threshold, b, 4);
+            const int    *codes = reinterpret_cast<const int *>(t.code);
+            __m256i       code = _mm256_i32gather_epi32(codes, b, 1);
+            code = _mm256_and_si256(code, _mm256_set1_epi32(0xff));
+            // compare mask is -1: subtracting it adds one
+            const __m256 up = _mm256_cmp_ps(l, thr, _CMP_GE_OQ);
+            code = _mm256_sub_epi32(code, _mm256_castps_si256(up));
+
+            const __m256i w = _mm256_packus_epi32(code, code);
+            const __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w, w), order);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), _mm256_castsi256_si128(bytes));
+        }
+#endif
+        for (; i < count; i++)
+            out[i] = linearToSrgb8(in[i]);
+    }
+} // namespace color
@@ -0,0 +1,104 @@
+﻿#include "core.h"
+
+namespace core
+{
+    namespace
+    {
+        // fn(DepthCodec<format>{})
+        template <class Fn>
+        decltype(auto) withCodec(DepthFormat format, Fn &&fn)
+        {
+            switch (format)
+            {
+            case DepthFormat::D32FReversed:
+                return fn(DepthCodec<DepthFormat::D32FReversed>{});
+            case DepthFormat::D24:
+                return fn(DepthCodec<DepthFormat::D24>{});
+            case DepthFormat::D16:
+                return fn(DepthCodec<DepthFormat::D16>{});
+            default:
+                return fn(DepthCodec<DepthFormat::D32F>{});
+            }
+        }
+
+        size_t bytesPerPixel(DepthFormat format)
+        {
+            return withCodec(format, [](auto codec) { return size_t(decltype(codec)::kBytes); });
+        }
+    } // namespace
+
+    void DepthPlane::eval(float out[64]) const
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            const float row = z + float(y) * dzdy;
+            for (int x = 0; x < 8; x++)
+                out[y * 8 + x] = row + float(x) * dzdx;
+        }
+    }
+
+    // one spare byte at the end for the 4-byte loads of D24
+    DepthBuffer::DepthBuffer(int w, int h, DepthFormat f, bool compress)
+        : width(w), height(h), format(f), compression(compress), layout(w, h),
+          pixels(layout.pixelCount() * bytesPerPixel(f) + 1),
+          hizCols((w + kHiZBlock - 1) / kHiZBlock), hizRows((h + kHiZBlock - 1) / kHiZBlock),
+          blocks(hizCols * hizRows)
+    {
+        clear(farDepth());
+    }
+
+    uint32_t DepthBuffer::key(float depth) const
+    {
+        const float z = reversedZ() ? -depth : depth;
+        return withCodec(format, [&](auto codec) { return decltype(codec)::key(z); });
+    }
+
+    void DepthBuffer::clearRect(int x0, int y0, int x1, int y1, float depth)
+    {
+        if (x0 >= x1 || y0 >= y1)
+            return;
+        const uint32_t k = key(depth);
+        const Block    cleared{k, k, {reversedZ() ? -depth : depth, 0.0f, 0.0f}, compression};
+        if (!compression)
+            withCodec(format,
+                      [&](auto codec)
+                      {
+                          using Codec = decltype(codec);
+                          uint8_t pixel[4];
+                          Codec::store(pixel, k);
+                          fillTiles<Codec::kBytes>(pixels.data(), layout, x0, y0, x1, y1, pixel);
+                      });
+
+        const int bx0 = x0 / kHiZBlock, bx1 = (x1 + kHiZBlock - 1) / kHiZBlock;
+        for (int by = y0 / kHiZBlock; by < (y1 + kHiZBlock - 1) / kHiZBlock; by++)
+            std::fill(&blocks[by * hizCols + bx0], &blocks[by * hizCols + bx1], cleared);
+    }
+
+    float DepthBuffer::at(int x, int y) const
+    {
+        const Block &b = block(x / kHiZBlock, y / kHiZBlock);
+        return withCodec(format,
+                         [&](auto codec)
+                         {
+                             using Codec = decltype(codec);
+                             if (!b.compressed)
+                                 return Codec::depth(Codec::load(
+                                     pixels.data() + layout.index(x, y) * Codec::kBytes));
+                             float z[64];
+                             b.plane.eval(z);
+                             return Codec::depth(Codec::key(z[y % kHiZBlock * 8 + x % kHiZBlock]));
+                         });
+    }
+
+    void DepthBuffer::decompress()
+    {
+        withCodec(format,
+                  [&](auto codec)
+                  {
+                      for (int by = 0; by < hizRows; by++)
+                          for (int bx = 0; bx < hizCols; bx++)
+                              if (block(bx, by).compressed)
+                                  expand<decltype(codec)>(bx, by);
+                  });
+    }
+} // namespace core
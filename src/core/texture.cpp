@@ -0,0 +1,814 @@
+﻿#include "bcn.h"
+#include "color.h"
+#include "core.h"
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace core
+{
+    namespace
+    {
+        using Format = Texture::Format;
+
+        // level of w x h texels appended to data, padded to whole tiles
+        Texture::Level addLevel(std::vector<uint8_t> &data, Format f, int w, int h)
+        {
+            const int    tilesX = (w + Texture::kTile - 1) / Texture::kTile;
+            const int    tilesY = (h + Texture::kTile - 1) / Texture::kTile;
+            const size_t tiles = size_t(tilesX) * tilesY;
+            const size_t first = data.size() / Texture::bytesPerTile(f) * 16;
+            data.resize(data.size() + tiles * Texture::bytesPerTile(f));
+            return {w, h, tilesX, first};
+        }
+
+        using Wrap = Sampler::Wrap;
+
+        // texels i0, i1 around coordinate t (in [0, 1] over n texels) and the weight of i1;
+        // nearest: i0 alone
+        struct Footprint
+        {
+            int   i0, i1;
+            float frac;
+        };
+
+        Footprint footprint(float t, int n, Wrap wrap, bool nearest)
+        {
+            if (wrap == Wrap::Repeat)
+                t -= std::floor(t);
+            else if (wrap == Wrap::Mirror)
+            {
+                t -= 2.0f * std::floor(t * 0.5f);
+                t = std::min(t, 2.0f - t);
+            }
+            else
+                t = std::clamp(t, 0.0f, 1.0f);
+
+            const float x = nearest ? t * n : t * n - 0.5f;
+            const float fl = std::floor(x);
+            const int   i = int(fl);
+            if (wrap != Wrap::Repeat) // mirrored: the texel across the edge is the edge one
+                return {std::clamp(i, 0, n - 1), std::clamp(i + 1, 0, n - 1),
+                        nearest ? 0.0f : x - fl};
+            // t in [0, 1): i in [-1, n], n only when t * n rounds up
+            const int i0 = i < 0 ? i + n : i >= n ? i - n : i;
+            return {i0, i0 + 1 == n ? 0 : i0 + 1, nearest ? 0.0f : x - fl};
+        }
+
+        // ------------------------------ encoding ------------------------------
+
+        uint8_t toUnorm8(float v) { return uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+        template <Format F> math::Vec4 decode(const uint8_t *p)
+        {
+            constexpr float k = 1.0f / 255.0f;
+            if constexpr (F == Format::RGBA32F)
+            {
+                math::Vec4 c;
+                std::memcpy(&c, p, sizeof(c));
+                return c;
+            }
+            else if constexpr (F == Format::RGBA16F)
+            {
+                uint16_t   h[4];
+                math::Vec4 c;
+                std::memcpy(h, p, sizeof(h));
+                math::halfToFloat4(h, &c.x);
+                return c;
+            }
+            else if constexpr (F == Format::RGBA8)
+                return {p[0] * k, p[1] * k, p[2] * k, p[3] * k};
+            else if constexpr (F == Format::RGBA8Srgb)
+            {
+                const float *lut = color::srgb8ToLinearTable();
+                return {lut[p[0]], lut[p[1]], lut[p[2]], p[3] * k};
+            }
+            else if constexpr (F == Format::RG8)
+                return {p[0] * k, p[1] * k, 0.0f, 1.0f};
+            else
+                return {p[0] * k, p[0] * k, p[0] * k, 1.0f};
+        }
+
+        void encode(Format f, const math::Vec4 &c, uint8_t *p)
+        {
+            switch (f)
+            {
+            case Format::RGBA32F:
+                std::memcpy(p, &c, sizeof(c));
+                break;
+            case Format::RGBA16F:
+            {
+                uint16_t h[4];
+                math::floatToHalf4(&c.x, h);
+                std::memcpy(p, h, sizeof(h));
+                break;
+            }
+            case Format::RGBA8:
+                p[0] = toUnorm8(c.x);
+                p[1] = toUnorm8(c.y);
+                p[2] = toUnorm8(c.z);
+                p[3] = toUnorm8(c.w);
+                break;
+            case Format::RGBA8Srgb:
+                p[0] = color::linearToSrgb8(c.x);
+                p[1] = color::linearToSrgb8(c.y);
+                p[2] = color::linearToSrgb8(c.z);
+                p[3] = toUnorm8(c.w);
+                break;
+            case Format::RG8:
+                p[0] = toUnorm8(c.x);
+                p[1] = toUnorm8(c.y);
+                break;
+            case Format::R8:
+                p[0] = toUnorm8(c.x);
+                break;
+            default: // block compressed: whole blocks only, see Texture::compress
+                break;
+            }
+        }
+
+        // ------------------------------ BCn blocks ----------------------------
+
+        uint64_t nextRevision()
+        {
+            static std::atomic<uint64_t> next{1};
+            return next++;
+        }
+
+        bool isSrgb(Format f)
+        {
+            return f == Format::RGBA8Srgb || f == Format::BC1Srgb || f == Format::BC3Srgb ||
+                   f == Format::BC7Srgb;
+        }
+
+        // Decoded blocks of the last few fetches, per thread: neighbouring pixels read the
+        // same blocks, so most fetches skip the decode. Direct-mapped on the block address;
+        // the texture's revision tells a reused address from the block that was there.
+        struct BlockCache
+        {
+            static constexpr int kEntries = 64; // 2^6, see the slot hash
+
+            struct Entry
+            {
+                const uint8_t *block = nullptr;
+                uint64_t       revision = 0;
+                math::Vec4     texels[16]; // raster order
+            };
+            Entry entries[kEntries];
+        };
+
+        const math::Vec4 *decodedBlock(const Texture &t, const uint8_t *block)
+        {
+            thread_local BlockCache cache;
+            // blocks a row of tiles apart must not share a slot: hash the block number
+            const uint64_t     slot = uintptr_t(block) / Texture::bytesPerTile(t.format);
+            BlockCache::Entry &e = cache.entries[(slot * 0x9e3779b97f4a7c15ull) >> 58];
+            if (e.block == block && e.revision == t.revision)
+                return e.texels;
+
+            uint8_t rgba[16][4];
+            switch (t.format)
+            {
+            case Format::BC1:
+            case Format::BC1Srgb:
+                bcn::decodeBC1(block, rgba);
+                break;
+            case Format::BC3:
+            case Format::BC3Srgb:
+                bcn::decodeBC3(block, rgba);
+                break;
+            case Format::BC5:
+                bcn::decodeBC5(block, rgba);
+                break;
+            default:
+                bcn::decodeBC7(block, rgba);
+                break;
+            }
+            const float *rgb = isSrgb(t.format) ? color::srgb8ToLinearTable() : nullptr;
+            constexpr float k = 1.0f / 255.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                const uint8_t *p = rgba[i];
+                e.texels[i] = rgb ? math::Vec4{rgb[p[0]], rgb[p[1]], rgb[p[2]], p[3] * k}
+                                  : math::Vec4{p[0] * k, p[1] * k, p[2] * k, p[3] * k};
+            }
+            e.block = block;
+            e.revision = t.revision;
+            return e.texels;
+        }
+
+        math::Vec4 blockTexel(const Texture &t, int level, int x, int y)
+        {
+            return decodedBlock(t, t.bytes(level, x, y))[(y & 3) * 4 + (x & 3)];
+        }
+
+        // ------------------------------ filtering -----------------------------
+
+        // sum of w[i] * texel p[i] over a 2x2 footprint
+#if defined(__SSE2__)
+        // one texel in a register; the wide formats unpack without going through scalars
+        template <Format F> __m128 load(const uint8_t *p)
+        {
+            if constexpr (F == Format::RGBA32F)
+                return _mm_loadu_ps(reinterpret_cast<const float *>(p));
+#if defined(__F16C__)
+            else if constexpr (F == Format::RGBA16F)
+                return _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+#endif
+            else if constexpr (F == Format::RGBA8)
+            {
+                int32_t bits;
+                std::memcpy(&bits, p, sizeof(bits));
+                const __m128i zero = _mm_setzero_si128();
+                __m128i       v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero);
+                v = _mm_unpacklo_epi16(v, zero);
+                return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+            }
+            else
+            {
+                const math::Vec4 c = decode<F>(p);
+                return _mm_setr_ps(c.x, c.y, c.z, c.w);
+            }
+        }
+
+        template <Format F> math::Vec4 blend(const uint8_t *const p[4], const float w[4])
+        {
+            __m128 sum = _mm_mul_ps(load<F>(p[0]), _mm_set1_ps(w[0]));
+            for (int i = 1; i < 4; i++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(load<F>(p[i]), _mm_set1_ps(w[i])));
+            alignas(16) float out[4];
+            _mm_store_ps(out, sum);
+            return {out[0], out[1], out[2], out[3]};
+        }
+#else
+        template <Format F> math::Vec4 blend(const uint8_t *const p[4], const float w[4])
+        {
+            math::Vec4 sum = decode<F>(p[0]) * w[0];
+            for (int i = 1; i < 4; i++)
+                sum += decode<F>(p[i]) * w[i];
+            return sum;
+        }
+#endif
+
+#if defined(__AVX2__)
+        // ------------------------------ batches -------------------------------
+
+        // formats gatherTexels reads straight from data
+        constexpr bool batchFormat(Format f)
+        {
+#if defined(__F16C__)
+            if (f == Format::RGBA16F)
+                return true;
+#endif
+            return f == Format::RGBA32F || f == Format::RGBA8 || f == Format::RGBA8Srgb ||
+                   f == Format::RG8 || f == Format::R8;
+        }
+
+#if defined(__F16C__)
+        // eight halves in the low 16 bits of lo's and hi's words -> lo, hi as floats
+        void halvesToFloat8(__m256i lo, __m256i hi, __m256 &a, __m256 &b)
+        {
+            // packus works per 128 bit lane: reorder the quarters to lo, lo, hi, hi
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+            a = _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+            b = _mm256_cvtph_ps(_mm256_extracti128_si256(packed, 1));
+        }
+#endif
+
+        // footprint() of eight lanes, n texels per lane
+        void footprint8(__m256 t, __m256i n, Wrap wrap, bool nearest, __m256i &i0, __m256i &i1,
+                        __m256 &frac)
+        {
+            const __m256 two = _mm256_set1_ps(2.0f);
+            if (wrap == Wrap::Repeat)
+                t = _mm256_sub_ps(t, _mm256_floor_ps(t));
+            else if (wrap == Wrap::Mirror)
+            {
+                const __m256 tiles = _mm256_floor_ps(_mm256_mul_ps(t, _mm256_set1_ps(0.5f)));
+                t = _mm256_sub_ps(t, _mm256_mul_ps(two, tiles));
+                t = _mm256_min_ps(t, _mm256_sub_ps(two, t));
+            }
+            else
+                t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+
+            __m256 x = _mm256_mul_ps(t, _mm256_cvtepi32_ps(n));
+            if (!nearest)
+                x = _mm256_sub_ps(x, _mm256_set1_ps(0.5f));
+            const __m256  fl = _mm256_floor_ps(x);
+            const __m256i i = _mm256_cvttps_epi32(fl);
+            const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+            const __m256i last = _mm256_sub_epi32(n, one);
+            frac = nearest ? _mm256_setzero_ps() : _mm256_sub_ps(x, fl);
+            if (wrap != Wrap::Repeat)
+            {
+                i0 = _mm256_min_epi32(_mm256_max_epi32(i, zero), last);
+                i1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(i, one), zero), last);
+                return;
+            }
+            i0 = _mm256_add_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(zero, i), n));
+            i0 = _mm256_sub_epi32(i0, _mm256_and_si256(_mm256_cmpgt_epi32(i0, last), n));
+            i1 = _mm256_add_epi32(i0, one);
+            i1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(i1, n), i1);
+        }
+
+        // one int field of levels[level] per lane (the low half of offset)
+        __m256i levelField(const Texture &t, __m256i level, size_t field)
+        {
+            static_assert(sizeof(Texture::Level) % 4 == 0 && alignof(Texture::Level) >= 4);
+            const int *base = reinterpret_cast<const int *>(t.levels.data()) + field / 4;
+            const __m256i stride = _mm256_set1_epi32(sizeof(Texture::Level) / 4);
+            return _mm256_i32gather_epi32(base, _mm256_mullo_epi32(level, stride), 4);
+        }
+
+        // Texture::index of eight lanes
+        __m256i texelIndex(__m256i x, __m256i y, __m256i tilesX, __m256i offset)
+        {
+            const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+            const __m256i tile = _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_srli_epi32(y, 2), tilesX), _mm256_srli_epi32(x, 2));
+            const __m256i inTile = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(x, one),
+                                _mm256_slli_epi32(_mm256_and_si256(y, one), 1)),
+                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, two), 1),
+                                _mm256_slli_epi32(_mm256_and_si256(y, two), 2)));
+            return _mm256_add_epi32(offset, _mm256_add_epi32(_mm256_slli_epi32(tile, 4), inTile));
+        }
+
+        // linear rgba of texel index per lane; total texels must stay below 2^29
+        template <Format F> void gatherTexels(const uint8_t *data, __m256i index, __m256 c[4])
+        {
+            const __m256 k = _mm256_set1_ps(1.0f / 255.0f);
+            if constexpr (F == Format::RGBA32F)
+            {
+                const float  *p = reinterpret_cast<const float *>(data);
+                const __m256i i4 = _mm256_slli_epi32(index, 2);
+                for (int ch = 0; ch < 4; ch++)
+                    c[ch] = _mm256_i32gather_ps(p, _mm256_add_epi32(i4, _mm256_set1_epi32(ch)), 4);
+                return;
+            }
+#if defined(__F16C__)
+            if constexpr (F == Format::RGBA16F)
+            {
+                // two words per texel: r | g << 16, b | a << 16
+                const int    *words = reinterpret_cast<const int *>(data);
+                const __m256i i2 = _mm256_slli_epi32(index, 1);
+                const __m256i rg = _mm256_i32gather_epi32(words, i2, 4);
+                const __m256i ba =
+                    _mm256_i32gather_epi32(words, _mm256_add_epi32(i2, _mm256_set1_epi32(1)), 4);
+                const __m256i low = _mm256_set1_epi32(0xffff);
+                halvesToFloat8(_mm256_and_si256(rg, low), _mm256_srli_epi32(rg, 16), c[0], c[1]);
+                halvesToFloat8(_mm256_and_si256(ba, low), _mm256_srli_epi32(ba, 16), c[2], c[3]);
+                return;
+            }
+#endif
+
+            const int *words = reinterpret_cast<const int *>(data);
+            __m256i    bits;
+            if constexpr (F == Format::RGBA8 || F == Format::RGBA8Srgb)
+                bits = _mm256_i32gather_epi32(words, index, 4);
+            else
+            {
+                // the aligned word holding the texel: never past the end, levels are whole
+                // tiles of 16 bytes or more
+                const __m256i byte = F == Format::RG8 ? _mm256_slli_epi32(index, 1) : index;
+                bits = _mm256_i32gather_epi32(words, _mm256_srli_epi32(byte, 2), 4);
+                const __m256i within = _mm256_and_si256(byte, _mm256_set1_epi32(3));
+                bits = _mm256_srlv_epi32(bits, _mm256_slli_epi32(within, 3));
+            }
+            const __m256i mask = _mm256_set1_epi32(0xff);
+            const __m256i r = _mm256_and_si256(bits, mask);
+            const __m256i g = _mm256_and_si256(_mm256_srli_epi32(bits, 8), mask);
+            const __m256  one = _mm256_set1_ps(1.0f);
+            if constexpr (F == Format::RG8)
+            {
+                c[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(r), k);
+                c[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(g), k);
+                c[2] = _mm256_setzero_ps();
+                c[3] = one;
+                return;
+            }
+            if constexpr (F == Format::R8)
+            {
+                c[0] = c[1] = c[2] = _mm256_mul_ps(_mm256_cvtepi32_ps(r), k);
+                c[3] = one;
+                return;
+            }
+            const __m256i b = _mm256_and_si256(_mm256_srli_epi32(bits, 16), mask);
+            const __m256i a = _mm256_srli_epi32(bits, 24);
+            c[3] = _mm256_mul_ps(_mm256_cvtepi32_ps(a), k);
+            if constexpr (F == Format::RGBA8Srgb)
+            {
+                const float *lut = color::srgb8ToLinearTable();
+                c[0] = _mm256_i32gather_ps(lut, r, 4);
+                c[1] = _mm256_i32gather_ps(lut, g, 4);
+                c[2] = _mm256_i32gather_ps(lut, b, 4);
+            }
+            else
+            {
+                c[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(r), k);
+                c[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(g), k);
+                c[2] = _mm256_mul_ps(_mm256_cvtepi32_ps(b), k);
+            }
+        }
+
+        // Texture::filtered of eight lanes, each at its own level
+        template <Format F>
+        void filtered8(const Texture &t, const Sampler &s, __m256 u, __m256 v, __m256i level,
+                       __m256 out[4])
+        {
+            using Level = Texture::Level;
+            const __m256i w = levelField(t, level, offsetof(Level, width));
+            const __m256i h = levelField(t, level, offsetof(Level, height));
+            const __m256i tilesX = levelField(t, level, offsetof(Level, tilesX));
+            const __m256i offset = levelField(t, level, offsetof(Level, offset));
+
+            const bool nearest = s.filter == Sampler::Filter::Nearest;
+            __m256i    x0, x1, y0, y1;
+            __m256     fx, fy;
+            footprint8(u, w, s.wrapU, nearest, x0, x1, fx);
+            footprint8(v, h, s.wrapV, nearest, y0, y1, fy);
+
+            gatherTexels<F>(t.data.data(), texelIndex(x0, y0, tilesX, offset), out);
+            if (nearest)
+                return;
+
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 gx = _mm256_sub_ps(one, fx), gy = _mm256_sub_ps(one, fy);
+            const __m256 w00 = _mm256_mul_ps(gx, gy);
+            for (int ch = 0; ch < 4; ch++)
+                out[ch] = _mm256_mul_ps(out[ch], w00);
+
+            const __m256i xs[3] = {x1, x0, x1}, ys[3] = {y0, y1, y1};
+            const __m256  ws[3] = {_mm256_mul_ps(fx, gy), _mm256_mul_ps(gx, fy),
+                                   _mm256_mul_ps(fx, fy)};
+            for (int i = 0; i < 3; i++)
+            {
+                __m256 c[4];
+                gatherTexels<F>(t.data.data(), texelIndex(xs[i], ys[i], tilesX, offset), c);
+                for (int ch = 0; ch < 4; ch++)
+                    out[ch] = _mm256_add_ps(out[ch], _mm256_mul_ps(c[ch], ws[i]));
+            }
+        }
+
+        template <Format F>
+        void gatherBatch(const Texture &t, const Sampler &s, __m256 u, __m256 v, __m256 lod,
+                         __m256 out[4])
+        {
+            const __m256i maxLevel = _mm256_set1_epi32(int(t.levels.size()) - 1);
+            if (s.mip == Sampler::Mip::None)
+                return filtered8<F>(t, s, u, v, _mm256_setzero_si256(), out);
+            if (s.mip == Sampler::Mip::Nearest)
+            {
+                const __m256i level = _mm256_cvttps_epi32(_mm256_add_ps(lod, _mm256_set1_ps(0.5f)));
+                return filtered8<F>(t, s, u, v, _mm256_min_epi32(level, maxLevel), out);
+            }
+
+            const __m256  fl = _mm256_floor_ps(lod);
+            const __m256  frac = _mm256_sub_ps(lod, fl);
+            const __m256i l0 = _mm256_cvttps_epi32(fl);
+            filtered8<F>(t, s, u, v, l0, out);
+            // lanes on a whole level skip the second one; mostly all of them at magnification
+            if (_mm256_movemask_ps(_mm256_cmp_ps(frac, _mm256_setzero_ps(), _CMP_GT_OQ)) == 0)
+                return;
+            __m256 next[4];
+            const __m256i l1 = _mm256_add_epi32(l0, _mm256_set1_epi32(1));
+            filtered8<F>(t, s, u, v, _mm256_min_epi32(l1, maxLevel), next);
+            for (int ch = 0; ch < 4; ch++)
+            {
+                const __m256 d = _mm256_sub_ps(next[ch], out[ch]);
+                out[ch] = _mm256_add_ps(out[ch], _mm256_mul_ps(d, frac));
+            }
+        }
+
+        void gatherBatch(const Texture &t, const Sampler &s, const float *u, const float *v,
+                         const float *lod, float *r, float *g, float *b, float *a)
+        {
+            const float  maxLod = float(t.levels.size() - 1);
+            const __m256 U = _mm256_loadu_ps(u);
+            __m256       V = _mm256_loadu_ps(v);
+            if (t.origin == Texture::Origin::TopLeft)
+                V = _mm256_sub_ps(_mm256_set1_ps(1.0f), V);
+            const __m256 L = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(lod), _mm256_setzero_ps()),
+                                           _mm256_set1_ps(maxLod));
+            __m256 c[4];
+            switch (t.format)
+            {
+            case Format::RGBA32F:
+                gatherBatch<Format::RGBA32F>(t, s, U, V, L, c);
+                break;
+#if defined(__F16C__)
+            case Format::RGBA16F:
+                gatherBatch<Format::RGBA16F>(t, s, U, V, L, c);
+                break;
+#endif
+            case Format::RGBA8:
+                gatherBatch<Format::RGBA8>(t, s, U, V, L, c);
+                break;
+            case Format::RGBA8Srgb:
+                gatherBatch<Format::RGBA8Srgb>(t, s, U, V, L, c);
+                break;
+            case Format::RG8:
+                gatherBatch<Format::RG8>(t, s, U, V, L, c);
+                break;
+            default:
+                gatherBatch<Format::R8>(t, s, U, V, L, c);
+                break;
+            }
+            _mm256_storeu_ps(r, c[0]);
+            _mm256_storeu_ps(g, c[1]);
+            _mm256_storeu_ps(b, c[2]);
+            _mm256_storeu_ps(a, c[3]);
+        }
+#endif
+    } // namespace
+
+    void Texture::create(int w, int h, Format f)
+    {
+        width = w;
+        height = h;
+        format = f;
+        revision = nextRevision();
+        data.clear();
+        levels.assign(1, addLevel(data, f, w, h));
+    }
+
+    void Texture::assign(int w, int h, const math::Vec4 *texels, Format f)
+    {
+        create(w, h, f);
+        for (int y = 0; y < h; y++)
+            storeRow(0, y, texels + size_t(y) * w);
+    }
+
+    math::Vec4 Texture::texel(int level, int x, int y) const
+    {
+        if (isCompressed(format))
+            return blockTexel(*this, level, x, y);
+
+        const uint8_t *p = bytes(level, x, y);
+        switch (format)
+        {
+        case Format::RGBA32F:
+            return decode<Format::RGBA32F>(p);
+        case Format::RGBA16F:
+            return decode<Format::RGBA16F>(p);
+        case Format::RGBA8:
+            return decode<Format::RGBA8>(p);
+        case Format::RGBA8Srgb:
+            return decode<Format::RGBA8Srgb>(p);
+        case Format::RG8:
+            return decode<Format::RG8>(p);
+        case Format::R8:
+            return decode<Format::R8>(p);
+        default:
+            return {};
+        }
+    }
+
+    void Texture::store(int level, int x, int y, const math::Vec4 &c)
+    {
+        if (!isCompressed(format))
+            encode(format, c, bytes(level, x, y));
+    }
+
+    void Texture::storeRow(int level, int y, const math::Vec4 *texels)
+    {
+        if (isCompressed(format))
+            return;
+        const int w = levels[level].width;
+        if (format != Format::RGBA8Srgb)
+        {
+            for (int x = 0; x < w; x++)
+                encode(format, texels[x], bytes(level, x, y));
+            return;
+        }
+
+        // rgb through the array linearToSrgb8 (AVX2), alpha stays linear
+        static_assert(sizeof(math::Vec4) == 4 * sizeof(float));
+        constexpr int kChunk = 64;
+        uint8_t       px[kChunk][4];
+        for (int x0 = 0; x0 < w; x0 += kChunk)
+        {
+            const int n = std::min(kChunk, w - x0);
+            color::linearToSrgb8(&texels[x0].x, &px[0][0], 4 * size_t(n));
+            for (int i = 0; i < n; i++)
+            {
+                px[i][3] = toUnorm8(texels[x0 + i].w);
+                std::memcpy(bytes(level, x0 + i, y), px[i], 4);
+            }
+        }
+    }
+
+    void Texture::compress(Format f)
+    {
+        if (!isCompressed(f) || isCompressed(format) || levels.empty())
+            return;
+
+        std::vector<uint8_t> blocks;
+        std::vector<Level>   packed;
+        const bool           srgb = isSrgb(f);
+        for (int level = 0; level < int(levels.size()); level++)
+        {
+            const Level &l = levels[level];
+            packed.push_back(addLevel(blocks, f, l.width, l.height));
+            const int tilesY = (l.height + kTile - 1) / kTile;
+            for (int ty = 0; ty < tilesY; ty++)
+            {
+                for (int tx = 0; tx < l.tilesX; tx++)
+                {
+                    // texels past the edge repeat the last row / column
+                    math::Vec4 c[16];
+                    uint8_t    rgba[16][4];
+                    for (int i = 0; i < 16; i++)
+                    {
+                        const int x = std::min(tx * kTile + (i & 3), l.width - 1);
+                        const int y = std::min(ty * kTile + (i >> 2), l.height - 1);
+                        c[i] = texel(level, x, y);
+                    }
+                    if (srgb) // the whole block at once, alpha fixed up below
+                        color::linearToSrgb8(&c[0].x, &rgba[0][0], 64);
+                    for (int i = 0; i < 16; i++)
+                    {
+                        if (!srgb)
+                        {
+                            rgba[i][0] = toUnorm8(c[i].x);
+                            rgba[i][1] = toUnorm8(c[i].y);
+                            rgba[i][2] = toUnorm8(c[i].z);
+                        }
+                        rgba[i][3] = toUnorm8(c[i].w);
+                    }
+
+                    uint8_t *block = &blocks[(packed.back().offset / 16 +
+                                              size_t(ty) * l.tilesX + tx) *
+                                             bytesPerTile(f)];
+                    switch (f)
+                    {
+                    case Format::BC1:
+                    case Format::BC1Srgb:
+                        bcn::encodeBC1(rgba, block);
+                        break;
+                    case Format::BC3:
+                    case Format::BC3Srgb:
+                        bcn::encodeBC3(rgba, block);
+                        break;
+                    case Format::BC5:
+                        bcn::encodeBC5(rgba, block);
+                        break;
+                    default:
+                        bcn::encodeBC7(rgba, block);
+                        break;
+                    }
+                }
+            }
+        }
+        format = f;
+        revision = nextRevision();
+        data = std::move(blocks);
+        levels = std::move(packed);
+    }
+
+    void Texture::generateMips()
+    {
+        if (levels.empty() || isCompressed(format))
+            return;
+        if (levels.size() > 1)
+            data.resize(levels[1].offset / 16 * bytesPerTile(format));
+        levels.resize(1);
+
+        // odd sizes drop the last column / row, like a GPU box filter
+        std::vector<math::Vec4> row;
+        for (int src = 0; levels[src].width > 1 || levels[src].height > 1; src++)
+        {
+            const int sw = levels[src].width, sh = levels[src].height;
+            const int w = std::max(sw / 2, 1), h = std::max(sh / 2, 1);
+            levels.push_back(addLevel(data, format, w, h));
+            row.resize(w);
+            for (int y = 0; y < h; y++)
+            {
+                const int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                for (int x = 0; x < w; x++)
+                {
+                    const int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                    const math::Vec4 sum = texel(src, x0, y0) + texel(src, x1, y0) +
+                                           texel(src, x0, y1) + texel(src, x1, y1);
+                    row[x] = sum * 0.25f;
+                }
+                storeRow(src + 1, y, row.data());
+            }
+        }
+    }
+
+    float Texture::lod(math::Vec2 dx, math::Vec2 dy) const
+    {
+        // longest side of the pixel footprint, in level 0 texels
+        const math::Vec2 tx{dx.x * width, dx.y * height};
+        const math::Vec2 ty{dy.x * width, dy.y * height};
+        const float      rho2 = std::max(math::length2(tx), math::length2(ty));
+        const float      maxLod = float(levels.size() - 1);
+        return rho2 > 1.0f ? std::min(0.5f * std::log2(rho2), maxLod) : 0.0f;
+    }
+
+    math::Vec4 Texture::filtered(const Sampler &s, int level, math::Vec2 uv) const
+    {
+        const Level    &l = levels[level];
+        const bool      nearest = s.filter == Sampler::Filter::Nearest;
+        const float     v = origin == Origin::TopLeft ? 1.0f - uv.y : uv.y;
+        const Footprint fx = footprint(uv.x, l.width, s.wrapU, nearest);
+        const Footprint fy = footprint(v, l.height, s.wrapV, nearest);
+        if (nearest)
+            return texel(level, fx.i0, fy.i0);
+
+        const int      x0 = fx.i0, x1 = fx.i1, y0 = fy.i0, y1 = fy.i1;
+        const float    tx = fx.frac, ty = fy.frac;
+        const uint8_t *p[4] = {bytes(level, x0, y0), bytes(level, x1, y0), bytes(level, x0, y1),
+                               bytes(level, x1, y1)};
+        const float    w[4] = {(1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty,
+                               tx * ty};
+        if (isCompressed(format))
+        {
+            // mostly all four texels are in one block: one cache lookup
+            const int         xs[4] = {x0, x1, x0, x1}, ys[4] = {y0, y0, y1, y1};
+            const math::Vec4 *texels = nullptr;
+            math::Vec4        sum{0, 0, 0, 0};
+            for (int i = 0; i < 4; i++)
+            {
+                if (i == 0 || p[i] != p[i - 1])
+                    texels = decodedBlock(*this, p[i]);
+                sum += texels[(ys[i] & 3) * 4 + (xs[i] & 3)] * w[i];
+            }
+            return sum;
+        }
+
+        switch (format)
+        {
+        case Format::RGBA32F:
+            return blend<Format::RGBA32F>(p, w);
+        case Format::RGBA16F:
+            return blend<Format::RGBA16F>(p, w);
+        case Format::RGBA8:
+            return blend<Format::RGBA8>(p, w);
+        case Format::RGBA8Srgb:
+            return blend<Format::RGBA8Srgb>(p, w);
+        case Format::RG8:
+            return blend<Format::RG8>(p, w);
+        case Format::R8:
+            return blend<Format::R8>(p, w);
+        default:
+            return {};
+        }
+    }
+
+    math::Vec4 Texture::sampleLod(const Sampler &s, math::Vec2 uv, float lod) const
+    {
+        const float maxLod = float(levels.size() - 1);
+        const float level = std::clamp(lod, 0.0f, maxLod);
+        if (s.mip == Sampler::Mip::None)
+            return filtered(s, 0, uv);
+        if (s.mip == Sampler::Mip::Nearest)
+            return filtered(s, int(level + 0.5f), uv);
+
+        const int   l0 = int(level);
+        const float t = level - l0;
+        if (t == 0.0f)
+            return filtered(s, l0, uv);
+        return filtered(s, l0, uv) * (1.0f - t) + filtered(s, l0 + 1, uv) * t;
+    }
+
+    void Texture::sample8(const Sampler &s, const float *u, const float *v, const float *lod,
+                          Texels<8> &out) const
+    {
+        sampleBatch(s, u, v, lod, out.r, out.g, out.b, out.a);
+    }
+
+    void Texture::sample16(const Sampler &s, const float *u, const float *v, const float *lod,
+                           Texels<16> &out) const
+    {
+        // two groups of eight: the AVX2 kernel's width
+        sampleBatch(s, u, v, lod, out.r, out.g, out.b, out.a);
+        sampleBatch(s, u + 8, v + 8, lod + 8, out.r + 8, out.g + 8, out.b + 8, out.a + 8);
+    }
+
+    void Texture::sampleBatch(const Sampler &s, const float *u, const float *v, const float *lod,
+                              float *r, float *g, float *b, float *a) const
+    {
+#if defined(__AVX2__)
+        if (batchFormat(format))
+        {
+            gatherBatch(*this, s, u, v, lod, r, g, b, a);
+            return;
+        }
+#endif
+        for (int i = 0; i < 8; i++)
+        {
+            const math::Vec4 c = sampleLod(s, {u[i], v[i]}, lod[i]);
+            r[i] = c.x;
+            g[i] = c.y;
+            b[i] = c.z;
+            a[i] = c.w;
+        }
+    }
+} // namespace core
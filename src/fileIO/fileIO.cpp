@@ -74,4 +74,14 @@ namespace fileIO
         return true;
     }
 
+    bool writePPM(const std::string &path, const core::FrameBuffer &fb)
+    {
+        return writePPM(path, fb.width, fb.height, fb.linear());
+    }
+
+    bool writePNG(const std::string &path, const core::FrameBuffer &fb)
+    {
+        return writePNG(path, fb.width, fb.height, fb.linear());
+    }
+
 } // namespace fileIO
\ No newline at end of file
@@ -0,0 +1,59 @@
+﻿#include "math/mat.h"
+
+namespace math
+{
+Mat4 Mat4::identity()
+{
+	Mat4 M{};
+	M.m[0][0] = 1.0f;
+	M.m[1][1] = 1.0f;
+	M.m[2][2] = 1.0f;
+	M.m[3][3] = 1.0f;
+	return M;
+}
+
+// row-vector: translation lives in the last row
+Mat4 Mat4::translation(Vec3 t)
+{
+	Mat4 M = identity();
+	M.m[3][0] = t.x;
+	M.m[3][1] = t.y;
+	M.m[3][2] = t.z;
+	return M;
+}
+
+Mat4 Mat4::scale(Vec3 s)
+{
+	Mat4 M = identity();
+	M.m[0][0] = s.x;
+	M.m[1][1] = s.y;
+	M.m[2][2] = s.z;
+	return M;
+}
+
+Vec4 Mat4::mul_point(Vec3 p) const
+{
+	return {p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+			p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+			p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2],
+			p.x * m[0][3] + p.y * m[1][3] + p.z * m[2][3] + m[3][3]};
+}
+
+Vec4 Mat4::mul_vector(Vec3 v) const
+{
+	return {v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0],
+			v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1],
+			v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2],
+			v.x * m[0][3] + v.y * m[1][3] + v.z * m[2][3]};
+}
+
+Mat4 Mat4::operator*(const Mat4 &r) const
+{
+	Mat4 out{};
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			out.m[i][j] = m[i][0] * r.m[0][j] + m[i][1] * r.m[1][j] + m[i][2] * r.m[2][j]
+						  + m[i][3] * r.m[3][j];
+	return out;
+}
+} // namespace math
@@ -1,15 +1,826 @@
 ﻿#include "renderer.h"
+#include <atomic>
+#include <cfloat>
 
 namespace renderer
 {
+    namespace
+    {
+        math::Mat4 rotationXYZ(const math::Vec3 &deg)
+        {
+            return math::rotateX(math::radians(deg.x)) * math::rotateY(math::radians(deg.y))
+                   * math::rotateZ(math::radians(deg.z));
+        }
+
+        // inverse of (R * T), camera has no scale
+        math::Mat4 viewMatrix(const scene::Camera &cam)
+        {
+            return math::Mat4::translation(-cam.pos) * math::rotateZ(-math::radians(cam.rot.z))
+                   * math::rotateY(-math::radians(cam.rot.y))
+                   * math::rotateX(-math::radians(cam.rot.x));
+        }
+
+        // local bounds under M against a world-space frustum; unknown (empty) bounds are kept
+        bool inFrustum(const math::Frustum &f, const math::AABB &box, const math::Sphere &sphere,
+                       const math::Mat4 &M)
+        {
+            if (box.empty())
+                return true;
+            if (sphere.radius >= 0.0f && !math::intersects(f, math::transform(sphere, M)))
+                return false;
+            return math::intersects(f, math::transform(box, M));
+        }
+
+        // procedural meshes may come without bounds
+        math::AABB localBounds(const core::Mesh &mesh)
+        {
+            if (!mesh.bounds.empty())
+                return mesh.bounds;
+            math::AABB box;
+            for (const core::Vertex &v : mesh.vertices)
+                math::expand(box, v.position);
+            return box;
+        }
+
+        bool sameVec(const math::Vec3 &a, const math::Vec3 &b)
+        {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+
+        bool sameMat(const math::Mat4 &a, const math::Mat4 &b)
+        {
+            return std::equal(&a.m[0][0], &a.m[0][0] + 16, &b.m[0][0]);
+        }
+
+        constexpr int      kOcclusionScale = 4;            // occlusion buffer = framebuffer / 4
+        constexpr int      kMaxOccluders = 32;             // largest visible objects
+        constexpr float    kMinOccluderArea = 1.0f / 100;  // of the occlusion buffer
+        constexpr uint32_t kMaxOccluderTriangles = 65536;  // per frame
+
+        // screen-space bounds (pixels, depth) of a box under the clip matrix M;
+        // false when part of the box lies in front of the near plane (vp.reversedZ: M is a
+        // reversed-Z projection, near at z = w)
+        bool projectBox(const math::AABB &box, const math::Mat4 &M, const math::Viewport &vp,
+                        math::Vec3 &lo, math::Vec3 &hi)
+        {
+            lo = {FLT_MAX, FLT_MAX, FLT_MAX};
+            hi = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+            for (int i = 0; i < 8; i++)
+            {
+                const math::Vec3 p{(i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y,
+                                   (i & 4) ? box.max.z : box.min.z};
+                const math::Vec4 c = M.mul_point(p);
+                if (c.w <= 0.0f || (vp.reversedZ ? c.z > c.w : c.z < -c.w))
+                    return false;
+                const float      invW = 1.0f / c.w;
+                const math::Vec3 s = vp.ndcToScreen({c.x * invW, c.y * invW, c.z * invW});
+                lo = {std::min(lo.x, s.x), std::min(lo.y, s.y), std::min(lo.z, s.z)};
+                hi = {std::max(hi.x, s.x), std::max(hi.y, s.y), std::max(hi.z, s.z)};
+            }
+            return true;
+        }
+
+        // nearest depth and covering pixel rect of a world box
+        OcclusionRect screenRect(const math::AABB &box, const math::Mat4 &VP,
+                                 const math::Viewport &vp)
+        {
+            OcclusionRect r{0, 0, -1, -1, 1.0f, false, false};
+            math::Vec3    lo, hi;
+            if (!projectBox(box, VP, vp, lo, hi))
+                return r;
+            // every buffer pixel the projected box touches
+            r.x0 = int(std::floor(std::max(lo.x, -1.0f)));
+            r.y0 = int(std::floor(std::max(lo.y, -1.0f)));
+            r.x1 = int(std::floor(std::min(hi.x, float(vp.w))));
+            r.y1 = int(std::floor(std::min(hi.y, float(vp.h))));
+            r.zMin = std::min(lo.z, 1.0f);
+            r.valid = true;
+            return r;
+        }
+    } // namespace
+
+    Renderer::Renderer() = default;
+    Renderer::~Renderer() = default;
+
+    // brings objects / objectBounds / bvh up to date with the scene; the comparison is a
+    // linear scan split over the workers, the BVH is only rebuilt on structural changes
+    void Renderer::syncScene(const scene::Scene &scn)
+    {
+        const uint32_t    count = static_cast<uint32_t>(scn.objects.size());
+        const bool        rebuild = bvh.empty() || objects.size() != count;
+        std::atomic<bool> remesh{false};
+        objects.resize(count);
+        objectBounds.resize(count);
+        moved.resize(workers);
+
+        pool.run(
+            [&](int w)
+            {
+                std::vector<uint32_t> &out = moved[w];
+                out.clear();
+
+                const uint32_t begin = uint64_t(count) * w / workers;
+                const uint32_t end = uint64_t(count) * (w + 1) / workers;
+                for (uint32_t i = begin; i < end; i++)
+                {
+                    const scene::Object &obj = scn.objects[i];
+                    ObjectState         &st = objects[i];
+                    if (!rebuild && st.mesh.id == obj.mesh.id && sameVec(st.pos, obj.pos) &&
+                        sameVec(st.rot, obj.rot) && sameVec(st.scale, obj.scale))
+                        continue;
+                    if (st.mesh.id != obj.mesh.id)
+                        remesh = true;
+
+                    const math::Mat4 R = rotationXYZ(obj.rot);
+                    const math::Vec3 inv{1.0f / obj.scale.x, 1.0f / obj.scale.y,
+                                         1.0f / obj.scale.z};
+                    st.mesh = obj.mesh;
+                    st.pos = obj.pos;
+                    st.rot = obj.rot;
+                    st.scale = obj.scale;
+                    st.M = math::Mat4::scale(obj.scale) * R * math::Mat4::translation(obj.pos);
+                    st.N = math::Mat4::scale(inv) * R;
+                    const core::Mesh &mesh = resources->getMesh(obj.mesh);
+                    objectBounds[i] = math::transform(localBounds(mesh), st.M);
+                    out.push_back(i);
+                }
+            });
+
+        sceneChanged = rebuild || remesh;
+        if (rebuild || remesh)
+            bvh.build(objectBounds, [&](const WorkerPool::Job &fn) { pool.run(fn); }, workers);
+        else
+            for (const std::vector<uint32_t> &m : moved)
+            {
+                sceneChanged |= !m.empty();
+                bvh.refit(m, objectBounds);
+            }
+    }
+
+    // rasterizes the largest visible objects into the occlusion buffer, then drops every
+    // other visible object whose screen rect lies behind them; occluder triangles are
+    // projected serially and rasterized by workers that each own a band of tile rows
+    void Renderer::occlusionPass(const math::Mat4 &VP, int width, int height)
+    {
+        const int ow = (width + kOcclusionScale - 1) / kOcclusionScale;
+        const int oh = (height + kOcclusionScale - 1) / kOcclusionScale;
+        if (occlusion.getWidth() != ow || occlusion.getHeight() != oh)
+            occlusion.resize(ow, oh);
+        else
+            occlusion.clear();
+        const math::Viewport ovp{0, 0, ow, oh};
+
+        const uint32_t count = static_cast<uint32_t>(visible.size());
+        rects.resize(count);
+        pool.run(
+            [&](int w)
+            {
+                const uint32_t begin = uint64_t(count) * w / workers;
+                const uint32_t end = uint64_t(count) * (w + 1) / workers;
+                for (uint32_t k = begin; k < end; k++)
+                    rects[k] = screenRect(objectBounds[visible[k]], VP, ovp);
+            });
+
+        // occluders: the largest rects, kept sorted by area
+        uint32_t occluders[kMaxOccluders];
+        float    areas[kMaxOccluders];
+        int      occluderCount = 0;
+        for (uint32_t k = 0; k < count; k++)
+        {
+            const OcclusionRect &r = rects[k];
+            if (!r.valid)
+                continue;
+            const float area = float(std::min(r.x1, ow - 1) - std::max(r.x0, 0) + 1) *
+                               float(std::min(r.y1, oh - 1) - std::max(r.y0, 0) + 1);
+            if (area < kMinOccluderArea * ow * oh)
+                continue;
+            if (occluderCount == kMaxOccluders && area <= areas[kMaxOccluders - 1])
+                continue;
+
+            int i = std::min(occluderCount, kMaxOccluders - 1);
+            for (; i > 0 && areas[i - 1] < area; i--)
+            {
+                areas[i] = areas[i - 1];
+                occluders[i] = occluders[i - 1];
+            }
+            areas[i] = area;
+            occluders[i] = k;
+            occluderCount = std::min(occluderCount + 1, kMaxOccluders);
+        }
+        if (occluderCount == 0)
+            return;
+
+        occluderTris.clear();
+        uint32_t budget = kMaxOccluderTriangles;
+        for (int o = 0; o < occluderCount && budget > 0; o++)
+        {
+            const ObjectState &obj = objects[visible[occluders[o]]];
+            const core::Mesh  &mesh = resources->getMesh(obj.mesh);
+            const math::Mat4   MVP = obj.M * VP;
+            rects[occluders[o]].valid = false; // never tested against itself
+
+            for (const core::Submesh &sub : mesh.subs)
+            {
+                // see-through surfaces occlude nothing, one-sided back faces are invisible
+                bool doubleSided = false;
+                if (sub.material.id != 0)
+                {
+                    const core::Material &mat = resources->getMaterial(sub.material);
+                    if (mat.opacity < 1.0f)
+                        continue;
+                    doubleSided = mat.doubleSided;
+                }
+                uint32_t vtxStart = sub.vtxStart, vtxEnd = sub.vtxEnd;
+                if (vtxEnd <= vtxStart)
+                {
+                    vtxStart = 0;
+                    vtxEnd = static_cast<uint32_t>(mesh.vertices.size());
+                }
+
+                occluderClip.resize(vtxEnd - vtxStart);
+                for (uint32_t v = vtxStart; v < vtxEnd; v++)
+                    occluderClip[v - vtxStart] = MVP.mul_point(mesh.vertices[v].position);
+
+                for (uint32_t i = sub.idxStart; i + 2 < sub.idxEnd && budget > 0; i += 3)
+                {
+                    math::Vec3 ndc[3];
+                    bool       clipped = false;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        const math::Vec4 &c = occluderClip[mesh.indices[i + k] - vtxStart];
+                        clipped |= c.w <= 0.0f || c.z < -c.w || c.z > c.w;
+                        ndc[k] = {c.x / c.w, c.y / c.w, c.z / c.w};
+                    }
+                    // skipping an occluder triangle is always safe
+                    if (clipped)
+                        continue;
+                    const float area = (ndc[1].x - ndc[0].x) * (ndc[2].y - ndc[0].y) -
+                                       (ndc[1].y - ndc[0].y) * (ndc[2].x - ndc[0].x);
+                    if (area == 0.0f || (!doubleSided && area < 0.0f))
+                        continue;
+
+                    for (int k = 0; k < 3; k++)
+                        occluderTris.push_back(ovp.ndcToScreen(ndc[k]));
+                    budget--;
+                }
+            }
+        }
+
+        // every band sees the triangles in the same order: the result matches a serial pass
+        const int tileRows = occlusion.getTileRows();
+        pool.run(
+            [&](int w)
+            {
+                const int rowBegin = tileRows * w / workers;
+                const int rowEnd = tileRows * (w + 1) / workers;
+                if (rowBegin == rowEnd)
+                    return;
+                for (size_t i = 0; i + 2 < occluderTris.size(); i += 3)
+                    occlusion.renderTriangle(occluderTris[i], occluderTris[i + 1],
+                                             occluderTris[i + 2], rowBegin, rowEnd);
+            });
+
+        pool.run(
+            [&](int w)
+            {
+                const uint32_t begin = uint64_t(count) * w / workers;
+                const uint32_t end = uint64_t(count) * (w + 1) / workers;
+                for (uint32_t k = begin; k < end; k++)
+                {
+                    OcclusionRect &r = rects[k];
+                    r.hidden = r.valid && occlusion.occluded(r.x0, r.y0, r.x1, r.y1, r.zMin);
+                }
+            });
+        uint32_t kept = 0;
+        for (uint32_t k = 0; k < count; k++)
+            if (!rects[k].hidden)
+                visible[kept++] = visible[k];
+        visible.resize(kept);
+    }
+
+    // depth-only maps of the castShadow lights: views are placed serially, then each worker
+    // takes whole views, gathers their casters from the BVH and rasterizes them with no FS;
+    // a view is redrawn only when it or the scene changed
+    void Renderer::shadowPass(const scene::Camera &cam, float aspect)
+    {
+        shadows.lights.clear();
+        fsu.shadows = &shadows;
+        fsu.shadowOf.assign(fsu.lights.size(), -1);
+        fsu.localShadowOf.assign(fsu.localLights.size(), -1);
+
+        const int cascades = std::max(config.shadowCascades, 1);
+        uint32_t  viewCount = 0;
+        for (const scene::Light &light : fsu.lights)
+            if (light.castShadow && light.type == scene::LightType::Directional)
+                viewCount += cascades;
+        for (const scene::Light &light : fsu.localLights)
+            if (light.castShadow && light.type == scene::LightType::Point)
+                viewCount += 6;
+        shadows.views.resize(viewCount);
+        if (viewCount == 0)
+            return;
+
+        const math::AABB sceneBox = bvh.empty() ? math::AABB{} : bvh.hierarchy()[0].box;
+        const math::Mat4 camWorld = rotationXYZ(cam.rot) * math::Mat4::translation(cam.pos);
+        const math::Vec4 forward = camWorld.mul_vector({0, 0, -1});
+        shadows.eye = cam.pos;
+        shadows.forward = math::normalize({forward.x, forward.y, forward.z});
+        const float      distance = std::min(config.shadowDistance, cam.zfar);
+        uint32_t         first = 0;
+        for (uint32_t i = 0; i < fsu.lights.size(); i++)
+        {
+            const scene::Light &light = fsu.lights[i];
+            if (!light.castShadow || light.type != scene::LightType::Directional)
+                continue;
+            cascadeViews(cam, camWorld, aspect, distance, light.directional.dir, sceneBox,
+                         config.shadowMapSize, &shadows.views[first], cascades);
+            fsu.shadowOf[i] = static_cast<int>(shadows.lights.size());
+            shadows.lights.push_back({first, static_cast<uint32_t>(cascades)});
+            first += cascades;
+        }
+        for (uint32_t i = 0; i < fsu.localLights.size(); i++)
+        {
+            const scene::Light &light = fsu.localLights[i];
+            if (!light.castShadow || light.type != scene::LightType::Point)
+                continue;
+            cubeViews(light.point.pos, light.point.range, config.pointShadowMapSize,
+                      &shadows.views[first]);
+            fsu.localShadowOf[i] = static_cast<int>(shadows.lights.size());
+            shadows.lights.push_back({first, 6});
+            first += 6;
+        }
+
+        shadowVerts.resize(workers);
+        std::atomic<uint32_t> nextView{0};
+        pool.run(
+            [&](int w)
+            {
+                std::vector<shader::VSOut> &clip = shadowVerts[w];
+                RasterTriangle              tris[kMaxClippedTriangles];
+                for (uint32_t vi = nextView++; vi < viewCount; vi = nextView++)
+                {
+                    ShadowView         &view = shadows.views[vi];
+                    const math::Frustum frustum = math::frustumFromMatrix(view.VP);
+
+                    // a view no visible object reaches is never sampled
+                    bool receivers = false;
+                    for (uint32_t k = 0; k < visible.size() && !receivers; k++)
+                    {
+                        const math::AABB &box = objectBounds[visible[k]];
+                        if (view.sliceFar < 0.0f)
+                        {
+                            receivers = math::intersects(frustum, box);
+                            continue;
+                        }
+                        // camera depth range of the box
+                        const math::Vec3 e = box.extent(), &f = shadows.forward;
+                        const float      d = math::dot(box.center() - shadows.eye, f);
+                        const float      r =
+                            std::fabs(e.x * f.x) + std::fabs(e.y * f.y) + std::fabs(e.z * f.z);
+                        receivers = d + r >= view.sliceNear && d - r <= view.sliceFar;
+                    }
+                    if (!receivers)
+                    {
+                        view.rendered = false;
+                        continue;
+                    }
+                    if (view.rendered && !sceneChanged && sameMat(view.VP, view.renderedVP))
+                        continue;
+
+                    const int            size = view.depth.width;
+                    const math::Viewport vp{0, 0, size, size};
+                    const TileRect       rect{0, 0, size, size};
+                    view.depth.clear(1.0f);
+                    view.casters.clear();
+                    bvh.query(frustum, [&](uint32_t o) { view.casters.push_back(o); });
+                    view.rendered = true;
+                    view.renderedVP = view.VP;
+
+                    for (uint32_t o : view.casters)
+                    {
+                        const ObjectState &obj = objects[o];
+                        const core::Mesh  &mesh = resources->getMesh(obj.mesh);
+                        const math::Mat4   MVP = obj.M * view.VP;
+                        for (const core::Submesh &sub : mesh.subs)
+                        {
+                            bool doubleSided = false;
+                            if (sub.material.id != 0)
+                            {
+                                const core::Material &mat = resources->getMaterial(sub.material);
+                                if (mat.opacity < 1.0f)
+                                    continue;
+                                doubleSided = mat.doubleSided;
+                            }
+                            uint32_t vtxStart = sub.vtxStart, vtxEnd = sub.vtxEnd;
+                            if (vtxEnd <= vtxStart)
+                            {
+                                vtxStart = 0;
+                                vtxEnd = static_cast<uint32_t>(mesh.vertices.size());
+                            }
+
+                            // positions only, the rest of VSOut is never read
+                            clip.resize(vtxEnd - vtxStart);
+                            for (uint32_t v = vtxStart; v < vtxEnd; v++)
+                                clip[v - vtxStart].clip_pos =
+                                    MVP.mul_point(mesh.vertices[v].position);
+                            const shader::VSOut *base = clip.data() - vtxStart;
+
+                            // one-sided casters draw their back faces: the stored depth lies
+                            // behind the lit surface, which keeps it from shadowing itself
+                            for (uint32_t t = sub.idxStart; t + 2 < sub.idxEnd; t += 3 * 64)
+                            {
+                                const int       count = std::min(64u, (sub.idxEnd - t) / 3);
+                                const uint32_t *idx = &mesh.indices[t];
+                                const uint64_t  front =
+                                    doubleSided ? 0 : frontFaceMask(base, idx, count);
+                                for (int k = 0; k < count; k++)
+                                {
+                                    if ((front >> k) & 1)
+                                        continue;
+                                    const uint32_t *tri = idx + 3 * k;
+                                    const int       n = setupTriangle(base[tri[0]], base[tri[1]],
+                                                                      base[tri[2]], vp, tris);
+                                    for (int p = 0; p < n; p++)
+                                        rasterizeDepth(tris[p], rect, view.depth);
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
+    // shared frame setup: workers, tiles, clears, draw list and uniforms
+    int Renderer::beginFrame(const scene::Scene &scn, core::FrameBuffer &fb,
+                             core::DepthBuffer &db)
+    {
+        // passes write both buffers without bounds checks
+        if (db.width != fb.width || db.height != fb.height)
+            return static_cast<int>(ErrorCode::InvalidParam);
+
+        workers = config.workerCount;
+        if (workers <= 0)
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        pool.resize(workers);
+        grid.init(fb.width, fb.height, config.tileSize);
+        bins.resize(workers);
+        draws.clear();
+        triCount = 0;
+        vtxCount = 0;
+
+        // tone mapped frames shade into hdr, the resolve writes every pixel of fb
+        const scene::Settings &settings = scn.settings;
+        hdrOut = settings.toneMapping != scene::ToneMapping::None || settings.exposure != 1.0f;
+        fsu.gamma = settings.gamma;
+        fsu.hdr = hdrOut;
+        if (hdrOut)
+        {
+            if (hdr.width != fb.width || hdr.height != fb.height || hdr.format != config.hdrFormat)
+                hdr.resize(fb.width, fb.height, config.hdrFormat);
+            toneMapper.configure(settings.exposure, settings.toneMapping, fsu.gamma);
+        }
+        if (config.deferred && (vis.width != fb.width || vis.height != fb.height))
+            vis.resize(fb.width, fb.height);
+
+        // multisampling: the visibility buffer keeps one id per pixel, deferred frames don't
+        sampleCount = config.deferred
+                          ? 1
+                          : int(std::bit_floor(unsigned(std::clamp(config.msaaSamples, 1, 8))));
+        if (sampleCount > 1)
+        {
+            const bool stale = std::any_of(sampleDepth.begin(), sampleDepth.end(),
+                                           [&](const core::DepthBuffer &d)
+                                           {
+                                               return d.width != db.width ||
+                                                      d.height != db.height ||
+                                                      d.format != db.format ||
+                                                      d.compression != db.compression;
+                                           });
+            if (stale || int(sampleDepth.size()) != sampleCount - 1)
+            {
+                sampleDepth.clear();
+                for (int s = 1; s < sampleCount; s++)
+                    sampleDepth.emplace_back(db.width, db.height, db.format, db.compression);
+            }
+            depthSamples.assign(1, &db);
+            for (core::DepthBuffer &d : sampleDepth)
+                depthSamples.push_back(&d);
+
+            using SF = SampleStore::Format;
+            const SF format = !hdrOut ? SF::RGBA8
+                              : hdr.format == core::HdrBuffer::Format::RGBA32F ? SF::RGBA32F
+                                                                                : SF::RGBA16F;
+            sampleColor.reset(sampleCount, format, fb.layout.pixelCount(), grid.count());
+        }
+        else
+            sampleDepth.clear();
+        // color, depth and ids are cleared per tile, see clearTile()
+        tileCleared.assign(grid.count(), 0);
+        if (!resources)
+        {
+            finishClears(fb, db); // still hand back cleared buffers
+            return static_cast<int>(ErrorCode::InvalidParam);
+        }
+        syncScene(scn);
+
+        // draw list
+        const scene::Camera &cam = scn.camera;
+        const math::Mat4     V = viewMatrix(cam);
+        const float          aspect = float(fb.width) / fb.height;
+        const math::Mat4     P = math::perspective(cam.fovY, aspect, cam.znear, cam.zfar);
+        const math::Mat4     VP = V * P;
+        const math::Frustum  frustum = math::frustumFromMatrix(VP);
+        // reversed-Z buffers are drawn with the matching projection; culling and occlusion
+        // keep the standard one, the frustum is the same
+        const bool           reversedZ = db.reversedZ();
+        const math::Mat4     drawP =
+            reversedZ ? math::perspective(cam.fovY, aspect, cam.znear, cam.zfar, true) : P;
+        const math::Mat4     drawVP = V * drawP;
+        viewport = {0, 0, fb.width, fb.height, reversedZ};
+
+        // objects (then their submeshes) outside the frustum never reach the vertex pass;
+        // visible objects are drawn in scene order
+        visible.clear();
+        bvh.query(frustum, [&](uint32_t i) { visible.push_back(i); });
+        std::sort(visible.begin(), visible.end());
+        if (config.occlusionCulling && !visible.empty())
+            occlusionPass(VP, fb.width, fb.height);
+
+        for (uint32_t i : visible)
+        {
+            const ObjectState &obj = objects[i];
+            const core::Mesh  &mesh = resources->getMesh(obj.mesh);
+            const math::Mat4  &M = obj.M;
+
+            shader::VSUniform vsu;
+            vsu.M = M;
+            vsu.V = V;
+            vsu.P = drawP;
+            vsu.N = obj.N;
+            vsu.MVP = vsu.M * drawVP;
+
+            for (const core::Submesh &sub : mesh.subs)
+            {
+                if (mesh.subs.size() > 1 && !inFrustum(frustum, sub.bounds, sub.sphere, M))
+                    continue;
+
+                // material looked up once per submesh, not per triangle
+                math::Vec4           color{1, 1, 1, 1};
+                const core::Texture *texture = nullptr;
+                core::Sampler        sampler;
+                bool                 cullBack = true;
+                if (sub.material.id != 0)
+                {
+                    const core::Material &mat = resources->getMaterial(sub.material);
+                    color = {mat.baseColor.x, mat.baseColor.y, mat.baseColor.z, mat.opacity};
+                    cullBack = !mat.doubleSided;
+                    sampler = mat.sampler;
+                    if (mat.baseColorTex.id != 0)
+                        texture = &resources->getTexture(mat.baseColorTex);
+                    if (texture && texture->levels.empty())
+                        texture = nullptr;
+                }
+                uint32_t vtxStart = sub.vtxStart, vtxEnd = sub.vtxEnd;
+                if (vtxEnd <= vtxStart)
+                {
+                    vtxStart = 0;
+                    vtxEnd = static_cast<uint32_t>(mesh.vertices.size());
+                }
+
+                draws.push_back({&mesh, &sub, vsu, color, texture, sampler, triCount, vtxStart,
+                                 vtxEnd, vtxCount, cullBack});
+                triCount += (sub.idxEnd - sub.idxStart) / 3;
+                vtxCount += vtxEnd - vtxStart;
+            }
+        }
+        vtxCache.resize(vtxCount);
+
+        // point and spot lights go to the tiles (lightPass); the others have no range to cull by
+        fsu.lights.clear();
+        fsu.localLights.clear();
+        lightRects.clear();
+        for (const scene::Light &light : scn.lights)
+        {
+            const bool spot = light.type == scene::LightType::Spot;
+            if (light.type != scene::LightType::Point && !spot)
+            {
+                fsu.lights.push_back(light);
+                continue;
+            }
+            // off screen or reaching no object: contributes nothing
+            const math::Sphere s =
+                spot ? math::coneBounds(light.spot.pos, light.spot.dir, light.spot.range,
+                                        light.spot.cosOuter)
+                     : math::Sphere{light.point.pos, light.point.range};
+            if (!math::intersects(frustum, s) || !bvh.overlaps(s))
+                continue;
+
+            // view-space box of the sphere or cone; crossing the near plane covers the screen
+            math::AABB box;
+            if (spot)
+            {
+                const math::Vec4 p = V.mul_point(light.spot.pos);
+                const math::Vec4 d = V.mul_vector(light.spot.dir);
+                box = math::coneBox({p.x, p.y, p.z}, {d.x, d.y, d.z}, light.spot.range,
+                                    light.spot.cosOuter);
+            }
+            else
+            {
+                const math::Vec4 c = V.mul_point(s.center);
+                const float      r = s.radius;
+                box = {{c.x - r, c.y - r, c.z - r}, {c.x + r, c.y + r, c.z + r}};
+            }
+            math::Vec3 lo, hi;
+            LightRect  rect{0, 0, fb.width - 1, fb.height - 1, -FLT_MAX, FLT_MAX};
+            // depths as the rasterizer sees them (negated under reversed-Z)
+            if (projectBox(box, drawP, viewport, lo, hi))
+                rect = {int(std::floor(lo.x)), int(std::floor(lo.y)), int(std::floor(hi.x)),
+                        int(std::floor(hi.y)), reversedZ ? -hi.z : lo.z,
+                        reversedZ ? -lo.z : hi.z};
+            fsu.localLights.push_back(light);
+            lightRects.push_back(rect);
+        }
+        shadowPass(cam, aspect);
+        return static_cast<int>(ErrorCode::OK);
+    }
+
+    std::optional<uint32_t> Renderer::pick(const scene::Camera &cam, int x, int y) const
+    {
+        // pixel center -> view-space direction (camera looks down -z) -> world
+        const float tanY = std::tan(math::radians(cam.fovY) * 0.5f);
+        const float tanX = tanY * float(viewport.w) / viewport.h;
+        const float ndcX = (x + 0.5f - viewport.x) / viewport.w * 2.0f - 1.0f;
+        const float ndcY = 1.0f - (y + 0.5f - viewport.y) / viewport.h * 2.0f;
+        const math::Vec4 d = rotationXYZ(cam.rot).mul_vector({ndcX * tanX, ndcY * tanY, -1.0f});
+
+        const std::optional<scene::Bvh::Hit> hit =
+            bvh.raycast(cam.pos, math::normalize({d.x, d.y, d.z}));
+        if (!hit)
+            return std::nullopt;
+        return hit->object;
+    }
+
+    // triangle of a draw from the post-transform cache
+    // (more than one triangle when clipping split it)
+    int Renderer::assemble(const DrawItem &d, uint32_t meshTri, RasterTriangle *tris) const
+    {
+        const uint32_t      *idx = &d.mesh->indices[meshTri * 3];
+        const shader::VSOut *v = &vtxCache[d.vtxBase - d.vtxStart];
+        // samples of the standard patterns lie within half a pixel of the center
+        const int reach = sampleCount > 1 ? math::kSubpixelOne / 2 : 0;
+        return setupTriangle(v[idx[0]], v[idx[1]], v[idx[2]], viewport, tris, reach);
+    }
+
+    // triangle assembly & binning: each worker takes a contiguous slice of triangles
+    void Renderer::geometryPass()
+    {
+        pool.run(
+            [&](int w)
+            {
+                TileBins<RasterTriangle> &out = bins[w];
+                out.reset(grid.count());
+
+                const uint32_t begin = uint64_t(triCount) * w / workers;
+                const uint32_t end = uint64_t(triCount) * (w + 1) / workers;
+
+                RasterTriangle tris[kMaxClippedTriangles];
+                for (uint32_t di = 0; di < draws.size(); di++)
+                {
+                    const DrawItem &d = draws[di];
+                    const uint32_t  n = (d.sub->idxEnd - d.sub->idxStart) / 3;
+                    const uint32_t  lo = std::max(begin, d.triStart);
+                    const uint32_t  hi = std::min(end, d.triStart + n);
+                    const shader::VSOut *v = &vtxCache[d.vtxBase - d.vtxStart];
+
+                    // up to 64 triangles at a time: back faces dropped in bulk, then set up
+                    for (uint32_t t = lo; t < hi; t += 64)
+                    {
+                        const uint32_t meshTri0 = d.sub->idxStart / 3 + (t - d.triStart);
+                        const int      batch = static_cast<int>(std::min(hi - t, 64u));
+                        uint64_t       mask = ~uint64_t(0) >> (64 - batch);
+                        if (d.cullBack)
+                            mask &= frontFaceMask(v, &d.mesh->indices[meshTri0 * 3], batch);
+
+                        while (mask)
+                        {
+                            const uint32_t meshTri = meshTri0 + std::countr_zero(mask);
+                            mask &= mask - 1;
+
+                            const int count = assemble(d, meshTri, tris);
+                            for (int i = 0; i < count; i++)
+                            {
+                                RasterTriangle &tri = tris[i];
+                                tri.instance = di;
+                                tri.triangle = meshTri;
+                                out.push(tri, grid, tri.minX, tri.minY, tri.maxX, tri.maxY);
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
+    // Forward+ light culling: the binned triangles bound the depths a tile can show,
+    // a tile lists the point lights whose screen rect and depth range overlap it
+    void Renderer::lightPass()
+    {
+        shader::LightTiles &tiles = fsu.tiles;
+        tiles.tileSize = grid.tileSize;
+        tiles.cols = grid.cols;
+        tiles.lists.resize(grid.count());
+
+        std::atomic<int> nextTile{0};
+        pool.run(
+            [&](int)
+            {
+                for (int tile = nextTile++; tile < grid.count(); tile = nextTile++)
+                {
+                    std::vector<uint32_t> &list = tiles.lists[tile];
+                    list.clear();
+                    if (lightRects.empty())
+                        continue;
+
+                    float zMin = FLT_MAX, zMax = -FLT_MAX;
+                    for (const TileBins<RasterTriangle> &b : bins)
+                    {
+                        for (uint32_t i : b.tiles[tile])
+                        {
+                            zMin = std::min(zMin, b.tris[i].zMin);
+                            zMax = std::max(zMax, b.tris[i].zMax);
+                        }
+                    }
+                    if (zMin > zMax)
+                        continue;
+
+                    const TileRect rect = grid.rect(tile);
+                    for (uint32_t l = 0; l < lightRects.size(); l++)
+                    {
+                        const LightRect &r = lightRects[l];
+                        if (r.x1 >= rect.x0 && r.x0 < rect.x1 && r.y1 >= rect.y0 &&
+                            r.y0 < rect.y1 && r.zMax >= zMin && r.zMin <= zMax)
+                            list.push_back(l);
+                    }
+                }
+            });
+    }
+
+    void Renderer::clearTile(int tile, core::FrameBuffer &fb, core::DepthBuffer &db)
+    {
+        const TileRect   r = grid.rect(tile);
+        const math::Vec4 black{0.0f, 0.0f, 0.0f, 1.0f};
+        if (hdrOut)
+            hdr.clearRect(r.x0, r.y0, r.x1, r.y1, black);
+        else
+            fb.clearRect(r.x0, r.y0, r.x1, r.y1, black);
+        db.clearRect(r.x0, r.y0, r.x1, r.y1, db.farDepth());
+        for (core::DepthBuffer &d : sampleDepth)
+            d.clearRect(r.x0, r.y0, r.x1, r.y1, d.farDepth());
+        if (config.deferred)
+            vis.clearRect(r.x0, r.y0, r.x1, r.y1);
+        tileCleared[tile] = 1;
+    }
+
+    // tiles no triangle reached: the clear goes out in one parallel sweep
+    void Renderer::finishClears(core::FrameBuffer &fb, core::DepthBuffer &db)
+    {
+        std::atomic<int> nextTile{0};
+        pool.run(
+            [&](int)
+            {
+                for (int tile = nextTile++; tile < grid.count(); tile = nextTile++)
+                    if (!tileCleared[tile])
+                        clearTile(tile, fb, db);
+            });
+    }
+
+    void Renderer::resolvePass(core::FrameBuffer &fb)
+    {
+        // a job per 64x64 tile, one span of both buffers (padding included)
+        constexpr size_t kSpan = core::TiledLayout::kTile * core::TiledLayout::kTile;
+        const int        tiles = fb.layout.tilesX * fb.layout.tilesY;
+        std::atomic<int> nextTile{0};
+        pool.run(
+            [&](int)
+            {
+                for (int t = nextTile.fetch_add(1); t < tiles; t = nextTile.fetch_add(1))
+                    toneMapper.resolve(hdr, fb, t * kSpan, kSpan);
+            });
+    }
+
     int Renderer::render(const scene::Scene &scn, core::FrameBuffer &fb,
                          core::DepthBuffer &db)
     {
-        return 0;
+        if (!vs && !fs)
+            return render(scn, fb, db, shader::DefaultVS{}, shader::DefaultFS{});
+        // runtime shaders: indirect call per vertex / fragment
+        return render(scn, fb, db, vs ? vs : shader::VS(shader::defaultVS),
+                      fs ? fs : shader::FS(shader::defaultFS));
     }
 
-    void Renderer::setVertexShader(const shader::VS &vs) {}
+    void Renderer::setVertexShader(const shader::VS &vs) { this->vs = vs; }
+
+    void Renderer::setFragmentShader(const shader::FS &fs) { this->fs = fs; }
 
-    void Renderer::setFragmentShader(const shader::FS &vs) {}
+    void Renderer::setResourceManager(const resource::Manager &mgr) { resources = &mgr; }
 
 }; // namespace renderer
@@ -0,0 +1,185 @@
+﻿#include "renderer/msaa.h"
+#include "math/half.h"
+#include <bit>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace renderer
+{
+    namespace
+    {
+        using Format = SampleStore::Format;
+
+        // dst <- average of the count (2, 4 or 8) pixels at src
+        template <Format F> void average(const uint8_t *src, int count, uint8_t *dst);
+
+#if defined(__SSE2__)
+        // 16-bit channel sums, two pixels per step, rounded
+        template <> void average<Format::RGBA8>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i       sum = zero;
+            for (int s = 0; s < count; s += 2)
+            {
+                const __m128i two = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + s * 4));
+                sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(two, zero));
+            }
+            sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+            sum = _mm_add_epi16(sum, _mm_set1_epi16(int16_t(count / 2)));
+            sum = _mm_srl_epi16(sum, _mm_cvtsi32_si128(std::countr_zero(unsigned(count))));
+            const int32_t p = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+            std::memcpy(dst, &p, sizeof(p));
+        }
+
+        template <> void average<Format::RGBA16F>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int s = 0; s < count; s++)
+            {
+                uint16_t h[4];
+                float    c[4];
+                std::memcpy(h, src + s * 8, sizeof(h));
+                math::halfToFloat4(h, c);
+                sum = _mm_add_ps(sum, _mm_loadu_ps(c));
+            }
+            float c[4];
+            _mm_storeu_ps(c, _mm_mul_ps(sum, _mm_set1_ps(1.0f / float(count))));
+            uint16_t h[4];
+            math::floatToHalf4(c, h);
+            std::memcpy(dst, h, sizeof(h));
+        }
+
+        template <> void average<Format::RGBA32F>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int s = 0; s < count; s++)
+                sum = _mm_add_ps(sum, _mm_loadu_ps(reinterpret_cast<const float *>(src + s * 16)));
+            _mm_storeu_ps(reinterpret_cast<float *>(dst),
+                          _mm_mul_ps(sum, _mm_set1_ps(1.0f / float(count))));
+        }
+#else
+        template <> void average<Format::RGBA8>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            for (int ch = 0; ch < 4; ch++)
+            {
+                int sum = count / 2;
+                for (int s = 0; s < count; s++)
+                    sum += src[s * 4 + ch];
+                dst[ch] = uint8_t(sum / count);
+            }
+        }
+
+        template <> void average<Format::RGBA16F>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            float sum[4] = {};
+            for (int s = 0; s < count; s++)
+            {
+                uint16_t h[4];
+                float    c[4];
+                std::memcpy(h, src + s * 8, sizeof(h));
+                math::halfToFloat4(h, c);
+                for (int ch = 0; ch < 4; ch++)
+                    sum[ch] += c[ch];
+            }
+            for (int ch = 0; ch < 4; ch++)
+                sum[ch] *= 1.0f / float(count);
+            uint16_t h[4];
+            math::floatToHalf4(sum, h);
+            std::memcpy(dst, h, sizeof(h));
+        }
+
+        template <> void average<Format::RGBA32F>(const uint8_t *src, int count, uint8_t *dst)
+        {
+            float sum[4] = {};
+            for (int s = 0; s < count; s++)
+            {
+                float c[4];
+                std::memcpy(c, src + s * 16, sizeof(c));
+                for (int ch = 0; ch < 4; ch++)
+                    sum[ch] += c[ch];
+            }
+            for (int ch = 0; ch < 4; ch++)
+                sum[ch] *= 1.0f / float(count);
+            std::memcpy(dst, sum, sizeof(sum));
+        }
+#endif
+
+        template <Format F>
+        void resolveRecords(std::vector<uint8_t> &pool, std::vector<uint32_t> &fragment,
+                            size_t recordSize, int samples, int bpp, uint8_t *target)
+        {
+            for (size_t r = 0; r < pool.size(); r += recordSize)
+            {
+                uint32_t pixel;
+                std::memcpy(&pixel, &pool[r], sizeof(pixel));
+                // stale: the pixel was covered whole again after the record was made
+                if (fragment[pixel] != r)
+                    continue;
+                average<F>(&pool[r + sizeof(pixel)], samples, target + size_t(pixel) * bpp);
+                fragment[pixel] = SampleStore::kNone;
+            }
+            pool.clear();
+        }
+    } // namespace
+
+    void SampleStore::reset(int samples, Format format, size_t pixelCount, int tiles)
+    {
+        this->samples = samples;
+        this->format = format;
+        bpp = format == Format::RGBA8 ? 4 : format == Format::RGBA16F ? 8 : 16;
+        recordSize = sizeof(uint32_t) + size_t(samples) * bpp;
+        // resolve() hands every record back, fragment stays kNone between frames
+        if (fragment.size() != pixelCount)
+            fragment.assign(pixelCount, kNone);
+        pools.resize(tiles);
+    }
+
+    void SampleStore::write(int tile, uint8_t *target, size_t pixel, uint32_t mask,
+                            const uint8_t *px)
+    {
+        uint8_t  *dst = target + pixel * bpp;
+        uint32_t &f = fragment[pixel];
+        if (mask == fullMask())
+        {
+            std::memcpy(dst, px, bpp);
+            f = kNone;
+            return;
+        }
+
+        std::vector<uint8_t> &pool = pools[tile];
+        if (f == kNone)
+        {
+            // the pixel's one color goes to every sample first
+            f = uint32_t(pool.size());
+            pool.resize(pool.size() + recordSize);
+            const uint32_t p = uint32_t(pixel);
+            std::memcpy(&pool[f], &p, sizeof(p));
+            for (int s = 0; s < samples; s++)
+                std::memcpy(&pool[f + sizeof(p) + s * bpp], dst, bpp);
+        }
+        uint8_t *record = &pool[f + sizeof(uint32_t)];
+        for (; mask; mask &= mask - 1)
+            std::memcpy(record + std::countr_zero(mask) * bpp, px, bpp);
+    }
+
+    void SampleStore::resolve(int tile, uint8_t *target)
+    {
+        std::vector<uint8_t> &pool = pools[tile];
+        if (pool.empty())
+            return;
+        switch (format)
+        {
+        case Format::RGBA16F:
+            return resolveRecords<Format::RGBA16F>(pool, fragment, recordSize, samples, bpp,
+                                                   target);
+        case Format::RGBA32F:
+            return resolveRecords<Format::RGBA32F>(pool, fragment, recordSize, samples, bpp,
+                                                   target);
+        default:
+            return resolveRecords<Format::RGBA8>(pool, fragment, recordSize, samples, bpp,
+                                                 target);
+        }
+    }
+} // namespace renderer
@@ -0,0 +1,255 @@
+﻿#include "renderer/occlusion.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace renderer
+{
+    namespace
+    {
+        constexpr uint32_t kFullRow = ~uint32_t(0);
+
+#if !defined(__AVX2__)
+        // inside test of one edge: a * col + r > 0, col = pixel column in the tile
+        // returns the row's bits for columns [start, 32) (a > 0) or [0, end] (a < 0)
+        uint32_t spanMask(float a, float invA, float r)
+        {
+            if (a == 0.0f)
+                return r > 0.0f ? kFullRow : 0u;
+            const float t = std::clamp(-r * invA, -2.0f, 34.0f);
+            if (a > 0.0f)
+            {
+                const int start = std::clamp(int(std::floor(t)) + 1, 0, 32);
+                return uint32_t(uint64_t(kFullRow) << start);
+            }
+            const int end = std::clamp(int(std::ceil(t)) - 1, -1, 31);
+            return uint32_t(uint64_t(kFullRow) >> (31 - end));
+        }
+#endif
+    } // namespace
+
+    void OcclusionBuffer::resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        tilesX = (w + kTileW - 1) / kTileW;
+        tilesY = (h + kTileH - 1) / kTileH;
+        tiles.resize(size_t(tilesX) * tilesY);
+        clear();
+    }
+
+    void OcclusionBuffer::clear()
+    {
+        for (Tile &t : tiles)
+        {
+            std::fill(std::begin(t.mask), std::end(t.mask), 0u);
+            t.z0 = 1.0f;
+            t.z1 = 0.0f;
+        }
+    }
+
+    // add coverage cov at max depth z to the tile's working layer; a full working layer
+    // becomes the new reference layer
+    void OcclusionBuffer::merge(Tile &t, int tx, int ty, const uint32_t cov[kTileH], float z)
+    {
+        if (z >= t.z0)
+            return;
+
+        uint32_t any = 0, used = 0;
+        for (int r = 0; r < kTileH; r++)
+        {
+            any |= cov[r];
+            used |= t.mask[r];
+        }
+        if (!any)
+            return;
+
+        // the new triangle is nearer the reference depth than the working layer:
+        // start a new working layer rather than pushing z1 back
+        if (used && z - t.z1 > t.z0 - z)
+        {
+            std::fill(std::begin(t.mask), std::end(t.mask), 0u);
+            t.z1 = 0.0f;
+        }
+        t.z1 = std::max(t.z1, z);
+
+        // pixels outside the buffer count as covered
+        const int      cols = std::min(kTileW, width - tx * kTileW);
+        const int      rows = std::min(kTileH, height - ty * kTileH);
+        const uint32_t outside = cols == kTileW ? 0u : (kFullRow << cols);
+
+        bool full = true;
+        for (int r = 0; r < kTileH; r++)
+        {
+            t.mask[r] |= cov[r];
+            full &= r >= rows || (t.mask[r] | outside) == kFullRow;
+        }
+        if (full)
+        {
+            t.z0 = t.z1;
+            t.z1 = 0.0f;
+            std::fill(std::begin(t.mask), std::end(t.mask), 0u);
+        }
+    }
+
+    void OcclusionBuffer::renderTriangle(const math::Vec3 &p0, const math::Vec3 &p1,
+                                         const math::Vec3 &p2, int rowBegin, int rowEnd)
+    {
+        const math::Vec3 *p[3] = {&p0, &p1, &p2};
+
+        // edge i is opposite to vertex i, positive inside for either winding
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; i++)
+        {
+            const math::Vec3 &s = *p[(i + 1) % 3], &e = *p[(i + 2) % 3];
+            a[i] = s.y - e.y;
+            b[i] = e.x - s.x;
+            c[i] = s.x * e.y - s.y * e.x;
+        }
+        float area = a[0] * p0.x + b[0] * p0.y + c[0];
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                a[i] = -a[i];
+                b[i] = -b[i];
+                c[i] = -c[i];
+            }
+            area = -area;
+        }
+
+        // depth plane z = zA * x + zB * y + zC, clamped to the triangle's max
+        const float invArea = 1.0f / area;
+        const float zA = (a[0] * p0.z + a[1] * p1.z + a[2] * p2.z) * invArea;
+        const float zB = (b[0] * p0.z + b[1] * p1.z + b[2] * p2.z) * invArea;
+        const float zC = (c[0] * p0.z + c[1] * p1.z + c[2] * p2.z) * invArea;
+        const float zMax = std::max({p0.z, p1.z, p2.z});
+
+        // pixels that can be inside
+        const float minX = std::min({p0.x, p1.x, p2.x}), maxX = std::max({p0.x, p1.x, p2.x});
+        const float minY = std::min({p0.y, p1.y, p2.y}), maxY = std::max({p0.y, p1.y, p2.y});
+        const int   x0 = std::max(int(std::floor(minX)), 0);
+        const int   x1 = std::min(int(std::ceil(maxX)), width - 1);
+        const int   y0 = std::max(int(std::floor(minY)), 0);
+        const int   y1 = std::min(int(std::ceil(maxY)), height - 1);
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        // coverage is conservative: each edge is pulled in by half a pixel along both axes, so
+        // e > 0 at a pixel center means the whole pixel square is inside the triangle
+        float invA[3], cIn[3];
+        for (int i = 0; i < 3; i++)
+        {
+            invA[i] = a[i] != 0.0f ? 1.0f / a[i] : 0.0f;
+            cIn[i] = c[i] - 0.5f * (std::fabs(a[i]) + std::fabs(b[i]));
+        }
+
+        const int tyEnd = std::min(y1 / kTileH + 1, rowEnd);
+        for (int ty = std::max(y0 / kTileH, rowBegin); ty < tyEnd; ty++)
+        {
+            const float ty0 = float(ty * kTileH);
+            for (int tx = x0 / kTileW; tx <= x1 / kTileW; tx++)
+            {
+                const float tx0 = float(tx * kTileW);
+
+                // farthest plane depth over the tile rect
+                const float zt = zC + zA * (zA > 0.0f ? tx0 + kTileW : tx0) +
+                                 zB * (zB > 0.0f ? ty0 + kTileH : ty0);
+                const float z = std::min(zt, zMax);
+
+                alignas(32) uint32_t cov[kTileH];
+#if defined(__AVX2__)
+                // 8 lanes = 8 rows, each lane builds its row's 32-bit mask with variable shifts
+                const __m256 yc = _mm256_add_ps(_mm256_set1_ps(ty0 + 0.5f),
+                                                _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+                const __m256i ones = _mm256_set1_epi32(-1);
+                __m256i       m = ones;
+                for (int i = 0; i < 3; i++)
+                {
+                    // r = e at the row's first pixel center
+                    const __m256 r = _mm256_add_ps(
+                        _mm256_mul_ps(_mm256_set1_ps(b[i]), yc),
+                        _mm256_set1_ps(cIn[i] + a[i] * (tx0 + 0.5f)));
+                    if (a[i] == 0.0f)
+                    {
+                        const __m256 in = _mm256_cmp_ps(r, _mm256_setzero_ps(), _CMP_GT_OQ);
+                        m = _mm256_and_si256(m, _mm256_castps_si256(in));
+                        continue;
+                    }
+                    __m256 t = _mm256_mul_ps(r, _mm256_set1_ps(-invA[i]));
+                    t = _mm256_min_ps(_mm256_max_ps(t, _mm256_set1_ps(-2.0f)),
+                                      _mm256_set1_ps(34.0f));
+                    if (a[i] > 0.0f)
+                    {
+                        __m256i start = _mm256_cvtps_epi32(
+                            _mm256_add_ps(_mm256_floor_ps(t), _mm256_set1_ps(1.0f)));
+                        start = _mm256_max_epi32(start, _mm256_setzero_si256());
+                        m = _mm256_and_si256(m, _mm256_sllv_epi32(ones, start));
+                    }
+                    else
+                    {
+                        __m256i end = _mm256_cvtps_epi32(
+                            _mm256_sub_ps(_mm256_ceil_ps(t), _mm256_set1_ps(1.0f)));
+                        end = _mm256_max_epi32(end, _mm256_set1_epi32(-1));
+                        end = _mm256_min_epi32(end, _mm256_set1_epi32(31));
+                        const __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(31), end);
+                        m = _mm256_and_si256(m, _mm256_srlv_epi32(ones, shift));
+                    }
+                }
+                _mm256_store_si256(reinterpret_cast<__m256i *>(cov), m);
+#else
+                for (int row = 0; row < kTileH; row++)
+                {
+                    const float yc = ty0 + row + 0.5f;
+                    uint32_t    m = kFullRow;
+                    for (int i = 0; i < 3; i++)
+                        m &= spanMask(a[i], invA[i], b[i] * yc + cIn[i] + a[i] * (tx0 + 0.5f));
+                    cov[row] = m;
+                }
+#endif
+                // rows past the buffer edge are never covered
+                for (int row = std::max(height - ty * kTileH, 0); row < kTileH; row++)
+                    cov[row] = 0;
+                merge(tiles[ty * tilesX + tx], tx, ty, cov, z);
+            }
+        }
+    }
+
+    bool OcclusionBuffer::occluded(int x0, int y0, int x1, int y1, float zMin) const
+    {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width - 1);
+        y1 = std::min(y1, height - 1);
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        for (int ty = y0 / kTileH; ty <= y1 / kTileH; ty++)
+        {
+            const int r0 = std::max(y0 - ty * kTileH, 0);
+            const int r1 = std::min(y1 - ty * kTileH, kTileH - 1);
+            for (int tx = x0 / kTileW; tx <= x1 / kTileW; tx++)
+            {
+                const Tile &t = tiles[ty * tilesX + tx];
+                if (zMin <= std::min(t.z0, t.z1))
+                    return false;
+                if (zMin > t.z0)
+                    continue;
+
+                // between the layers: hidden only where the working layer covers the rect
+                const int      c0 = std::max(x0 - tx * kTileW, 0);
+                const int      c1 = std::min(x1 - tx * kTileW, kTileW - 1);
+                const uint32_t cols = uint32_t(uint64_t(kFullRow) << c0) &
+                                      uint32_t(uint64_t(kFullRow) >> (31 - c1));
+                for (int r = r0; r <= r1; r++)
+                    if ((t.mask[r] & cols) != cols)
+                        return false;
+            }
+        }
+        return true;
+    }
+} // namespace renderer
@@ -0,0 +1,76 @@
+﻿#include "renderer/pool.h"
+
+namespace renderer
+{
+    void WorkerPool::resize(int count)
+    {
+        if (count < 1)
+            count = 1;
+        if (count == size())
+            return;
+
+        stop();
+        stopping = false;
+        for (int i = 1; i < count; i++)
+            threads.emplace_back(&WorkerPool::workerMain, this, i, generation);
+    }
+
+    void WorkerPool::run(const Job &fn)
+    {
+        if (threads.empty())
+        {
+            fn(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = &fn;
+            pending = static_cast<int>(threads.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        fn(0);
+
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+    void WorkerPool::workerMain(int worker, uint64_t seen)
+    {
+        while (true)
+        {
+            const Job *fn;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                fn = job;
+            }
+
+            (*fn)(worker);
+
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+    }
+
+    void WorkerPool::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &t : threads)
+            t.join();
+        threads.clear();
+    }
+} // namespace renderer
@@ -0,0 +1,482 @@
+﻿#include "renderer/raster.h"
+#include <cstddef>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace renderer
+{
+    namespace
+    {
+        constexpr uint64_t kFullBlock = ~uint64_t(0);
+        constexpr int32_t  kOne = math::kSubpixelOne;
+        constexpr int32_t  kHalf = kOne / 2;
+        constexpr int      kSmallTriangle = 64; // bbox pixels rasterized without blocks
+        // vertices beyond this many pixels from the origin are not representable:
+        // edge deltas must stay below 2^19 subpixels for the 32-bit block stepping
+        constexpr float kMaxCoord = 16384.0f;
+        // x/y are only clipped once a vertex leaves the viewport by more than this;
+        // viewport + guard band must stay inside kMaxCoord
+        constexpr float kGuardBand = 4096.0f;
+        constexpr int   kMaxClipVertices = 3 + 6; // one extra vertex per clip plane
+
+        // clip-space half-spaces, a vertex is inside when dist() >= 0
+        // (reversed-Z: near and far trade places, the clipped volume is the same)
+        enum ClipPlane
+        {
+            kNear,
+            kFar,
+            kLeft,
+            kRight,
+            kTop,
+            kBottom,
+            kPlaneCount
+        };
+
+        // gx / gy: guard band edges in NDC, zLow: 0 when ndc z starts at 0 (reversed-Z), else 1
+        float dist(const math::Vec4 &c, int plane, float gx, float gy, float zLow)
+        {
+            switch (plane)
+            {
+            case kNear:
+                return c.z + zLow * c.w;
+            case kFar:
+                return c.w - c.z;
+            case kLeft:
+                return c.x + gx * c.w;
+            case kRight:
+                return gx * c.w - c.x;
+            case kTop:
+                return gy * c.w - c.y;
+            default:
+                return c.y + gy * c.w;
+            }
+        }
+
+        // attributes are linear in clip space, so clipped vertices are plain lerps
+        shader::VSOut lerp(const shader::VSOut &a, const shader::VSOut &b, float t)
+        {
+            shader::VSOut o;
+            o.clip_pos = a.clip_pos + (b.clip_pos - a.clip_pos) * t;
+            o.world_pos = a.world_pos + (b.world_pos - a.world_pos) * t;
+            o.world_nrm = a.world_nrm + (b.world_nrm - a.world_nrm) * t;
+            o.color = a.color + (b.color - a.color) * t;
+            o.uv = a.uv + (b.uv - a.uv) * t;
+            return o;
+        }
+
+        // 8x8 mask of one edge crossing the block; base = e at the block's first sample
+        // |e| inside a crossed block is bounded by (|a| + |b|) * 7 pixels, so 32 bits suffice
+        uint64_t edgeMask(const math::EdgeFx &e, int32_t base)
+        {
+            const int32_t a = e.a * kOne, b = e.b * kOne; // one pixel step
+            uint64_t      mask = 0;
+#if defined(__AVX512F__)
+            // 16 lanes = two block rows per step
+            const __m512i lx = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7);
+            const __m512i ly = _mm512_setr_epi32(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+            __m512i       w = _mm512_add_epi32(
+                _mm512_set1_epi32(base),
+                _mm512_add_epi32(_mm512_mullo_epi32(_mm512_set1_epi32(a), lx),
+                                 _mm512_mullo_epi32(_mm512_set1_epi32(b), ly)));
+            const __m512i step = _mm512_set1_epi32(2 * b);
+            const __m512i thresh = _mm512_set1_epi32(-e.bias);
+            for (int y = 0; y < 8; y += 2)
+            {
+                mask |= uint64_t(_mm512_cmpgt_epi32_mask(w, thresh)) << (y * 8);
+                w = _mm512_add_epi32(w, step);
+            }
+#elif defined(__AVX2__)
+            // 8 lanes = one block row per step
+            const __m256i lx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            __m256i       w = _mm256_add_epi32(_mm256_set1_epi32(base),
+                                               _mm256_mullo_epi32(_mm256_set1_epi32(a), lx));
+            const __m256i step = _mm256_set1_epi32(b);
+            const __m256i thresh = _mm256_set1_epi32(-e.bias);
+            for (int y = 0; y < 8; y++)
+            {
+                const __m256i in = _mm256_cmpgt_epi32(w, thresh);
+                mask |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(in))) << (y * 8);
+                w = _mm256_add_epi32(w, step);
+            }
+#else
+            for (int y = 0; y < 8; y++, base += b)
+            {
+                int32_t w = base;
+                for (int x = 0; x < 8; x++, w += a)
+                    if (w + e.bias > 0)
+                        mask |= uint64_t(1) << (y * 8 + x);
+            }
+#endif
+            return mask;
+        }
+
+        // clipped triangle (w > 0, inside the guard band) -> screen
+        bool setupScreen(const shader::VSOut *const v[3], const math::Viewport &vp, int reach,
+                         RasterTriangle &out)
+        {
+            int32_t X[3], Y[3];
+            for (int i = 0; i < 3; i++)
+            {
+                const math::Vec4 &c = v[i]->clip_pos;
+                const float       invW = 1.0f / c.w;
+                math::Vec3        s = vp.ndcToScreen({c.x * invW, c.y * invW, c.z * invW});
+
+                X[i] = math::to_fixed(s.x);
+                Y[i] = math::to_fixed(s.y);
+                out.z[i] = vp.reversedZ ? -s.z : s.z;
+                out.invW[i] = invW;
+                out.attr[i] = *v[i];
+            }
+
+            // edge(p0, p1, p2) on the snapped vertices
+            int64_t area =
+                int64_t(X[2] - X[0]) * (Y[1] - Y[0]) - int64_t(Y[2] - Y[0]) * (X[1] - X[0]);
+            if (area == 0)
+                return false;
+            // back faces only get here for double-sided materials:
+            // flip CCW triangles so inside_cw holds for both windings
+            if (area < 0)
+            {
+                std::swap(X[1], X[2]);
+                std::swap(Y[1], Y[2]);
+                std::swap(out.z[1], out.z[2]);
+                std::swap(out.invW[1], out.invW[2]);
+                std::swap(out.attr[1], out.attr[2]);
+                area = -area;
+            }
+            out.zMin = std::min({out.z[0], out.z[1], out.z[2]});
+            out.zMax = std::max({out.z[0], out.z[1], out.z[2]});
+            out.invArea = 1.0f / float(area);
+            out.e[0] = math::edge_fx(X[1], Y[1], X[2], Y[2]);
+            out.e[1] = math::edge_fx(X[2], Y[2], X[0], Y[0]);
+            out.e[2] = math::edge_fx(X[0], Y[0], X[1], Y[1]);
+
+            // z = sum(e_i * z_i) / area and every e_i is linear in the pixel position
+            const float scale = out.invArea * kOne;
+            auto        slope = [&](int32_t s0, int32_t s1, int32_t s2)
+            {
+                return (float(s0) * out.z[0] + float(s1) * out.z[1] + float(s2) * out.z[2]) *
+                       scale;
+            };
+            out.dzdx = slope(out.e[0].a, out.e[1].a, out.e[2].a);
+            out.dzdy = slope(out.e[0].b, out.e[1].b, out.e[2].b);
+
+            // pixels whose center (x * 16 + 8) lies inside the fixed-point bbox grown by reach
+            const int32_t minX = std::min({X[0], X[1], X[2]}) - reach;
+            const int32_t maxX = std::max({X[0], X[1], X[2]}) + reach;
+            const int32_t minY = std::min({Y[0], Y[1], Y[2]}) - reach;
+            const int32_t maxY = std::max({Y[0], Y[1], Y[2]}) + reach;
+
+            out.minX = std::max((minX - kHalf + kOne - 1) >> math::kSubpixelBits, vp.x);
+            out.minY = std::max((minY - kHalf + kOne - 1) >> math::kSubpixelBits, vp.y);
+            out.maxX = std::min((maxX - kHalf) >> math::kSubpixelBits, vp.x + vp.w - 1);
+            out.maxY = std::min((maxY - kHalf) >> math::kSubpixelBits, vp.y + vp.h - 1);
+            return (out.minX <= out.maxX && out.minY <= out.maxY);
+        }
+    } // namespace
+
+    int setupTriangle(const shader::VSOut &v0, const shader::VSOut &v1, const shader::VSOut &v2,
+                      const math::Viewport &vp, RasterTriangle *out, int reach)
+    {
+        const float guard =
+            std::min(kGuardBand, kMaxCoord - 1.0f - float(std::max(vp.x + vp.w, vp.y + vp.h)));
+        const float gx = 1.0f + 2.0f * guard / vp.w;
+        const float gy = 1.0f + 2.0f * guard / vp.h;
+        const float zLow = vp.reversedZ ? 0.0f : 1.0f;
+
+        const shader::VSOut *v[3] = {&v0, &v1, &v2};
+        uint32_t             outside[3] = {0, 0, 0}; // planes each vertex is outside of
+        for (int i = 0; i < 3; i++)
+            for (int p = 0; p < kPlaneCount; p++)
+                if (dist(v[i]->clip_pos, p, gx, gy, zLow) < 0.0f)
+                    outside[i] |= 1u << p;
+
+        if (outside[0] & outside[1] & outside[2])
+            return 0;
+        if (!(outside[0] | outside[1] | outside[2]))
+            return setupScreen(v, vp, reach, out[0]) ? 1 : 0;
+
+        // Sutherland-Hodgman against the planes the triangle actually crosses
+        shader::VSOut poly[2][kMaxClipVertices];
+        int           n = 3, cur = 0;
+        for (int i = 0; i < 3; i++)
+            poly[0][i] = *v[i];
+
+        const uint32_t crossed = outside[0] | outside[1] | outside[2];
+        for (int p = 0; p < kPlaneCount && n >= 3; p++)
+        {
+            if (!(crossed & (1u << p)))
+                continue;
+
+            const shader::VSOut *src = poly[cur];
+            shader::VSOut       *dst = poly[cur ^ 1];
+            int                  m = 0;
+            for (int i = 0; i < n; i++)
+            {
+                const shader::VSOut &a = src[i], &b = src[(i + 1) % n];
+                const float          da = dist(a.clip_pos, p, gx, gy, zLow);
+                const float          db = dist(b.clip_pos, p, gx, gy, zLow);
+                if (da >= 0.0f)
+                    dst[m++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    dst[m++] = lerp(a, b, da / (da - db));
+            }
+            n = m;
+            cur ^= 1;
+        }
+
+        // fan, same winding as the source triangle
+        int count = 0;
+        for (int i = 1; i + 1 < n; i++)
+        {
+            const shader::VSOut *tri[3] = {&poly[cur][0], &poly[cur][i], &poly[cur][i + 1]};
+            if (setupScreen(tri, vp, reach, out[count]))
+                count++;
+        }
+        return count;
+    }
+
+    uint64_t frontFaceMask(const shader::VSOut *v, const uint32_t *idx, int count)
+    {
+        static_assert(offsetof(shader::VSOut, clip_pos) == 0);
+        static_assert(sizeof(shader::VSOut) % sizeof(float) == 0);
+
+        // det | x0 y0 w0 |
+        //     | x1 y1 w1 |
+        //     | x2 y2 w2 |
+        uint64_t mask = 0;
+        int      i = 0;
+#if defined(__AVX512F__)
+        // 16 triangles per step, vertex attributes gathered straight from the cache
+        const float  *base = &v[0].clip_pos.x;
+        const __m512i lane3 = _mm512_mullo_epi32(
+            _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+            _mm512_set1_epi32(3));
+        const __m512i stride = _mm512_set1_epi32(sizeof(shader::VSOut) / sizeof(float));
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512 x[3], y[3], w[3];
+            for (int k = 0; k < 3; k++)
+            {
+                const int    *tri = reinterpret_cast<const int *>(idx + 3 * i + k);
+                const __m512i vi = _mm512_i32gather_epi32(lane3, tri, 4);
+                const __m512i off = _mm512_mullo_epi32(vi, stride);
+                x[k] = _mm512_i32gather_ps(off, base + 0, 4);
+                y[k] = _mm512_i32gather_ps(off, base + 1, 4);
+                w[k] = _mm512_i32gather_ps(off, base + 3, 4);
+            }
+            const __m512 c0 = _mm512_fmsub_ps(y[1], w[2], _mm512_mul_ps(y[2], w[1]));
+            const __m512 c1 = _mm512_fmsub_ps(x[1], w[2], _mm512_mul_ps(x[2], w[1]));
+            const __m512 c2 = _mm512_fmsub_ps(x[1], y[2], _mm512_mul_ps(x[2], y[1]));
+            const __m512 det = _mm512_fmadd_ps(
+                w[0], c2, _mm512_fmsub_ps(x[0], c0, _mm512_mul_ps(y[0], c1)));
+            mask |= uint64_t(_mm512_cmp_ps_mask(det, _mm512_setzero_ps(), _CMP_GT_OQ)) << i;
+        }
+#elif defined(__AVX2__)
+        // 8 triangles per step, vertex attributes gathered straight from the cache
+        const float  *base = &v[0].clip_pos.x;
+        const __m256i lane3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+        const __m256i stride = _mm256_set1_epi32(sizeof(shader::VSOut) / sizeof(float));
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x[3], y[3], w[3];
+            for (int k = 0; k < 3; k++)
+            {
+                const int    *tri = reinterpret_cast<const int *>(idx + 3 * i + k);
+                const __m256i vi = _mm256_i32gather_epi32(tri, lane3, 4);
+                const __m256i off = _mm256_mullo_epi32(vi, stride);
+                x[k] = _mm256_i32gather_ps(base + 0, off, 4);
+                y[k] = _mm256_i32gather_ps(base + 1, off, 4);
+                w[k] = _mm256_i32gather_ps(base + 3, off, 4);
+            }
+            const __m256 c0 = _mm256_sub_ps(_mm256_mul_ps(y[1], w[2]), _mm256_mul_ps(y[2], w[1]));
+            const __m256 c1 = _mm256_sub_ps(_mm256_mul_ps(x[1], w[2]), _mm256_mul_ps(x[2], w[1]));
+            const __m256 c2 = _mm256_sub_ps(_mm256_mul_ps(x[1], y[2]), _mm256_mul_ps(x[2], y[1]));
+            const __m256 det = _mm256_add_ps(
+                _mm256_sub_ps(_mm256_mul_ps(x[0], c0), _mm256_mul_ps(y[0], c1)),
+                _mm256_mul_ps(w[0], c2));
+            const __m256 front = _mm256_cmp_ps(det, _mm256_setzero_ps(), _CMP_GT_OQ);
+            mask |= uint64_t(_mm256_movemask_ps(front)) << i;
+        }
+#endif
+        for (; i < count; i++)
+        {
+            const math::Vec4 &p0 = v[idx[3 * i]].clip_pos;
+            const math::Vec4 &p1 = v[idx[3 * i + 1]].clip_pos;
+            const math::Vec4 &p2 = v[idx[3 * i + 2]].clip_pos;
+            const float       c0 = p1.y * p2.w - p2.y * p1.w;
+            const float       c1 = p1.x * p2.w - p2.x * p1.w;
+            const float       c2 = p1.x * p2.y - p2.x * p1.y;
+            if (p0.x * c0 - p0.y * c1 + p0.w * c2 > 0.0f)
+                mask |= uint64_t(1) << i;
+        }
+        return mask;
+    }
+
+    bool pixelInside(const RasterTriangle &tri, int x, int y)
+    {
+        const int32_t px = x * kOne + kHalf, py = y * kOne + kHalf;
+        for (const math::EdgeFx &e : tri.e)
+            if (!e.inside(e.eval(px, py)))
+                return false;
+        return true;
+    }
+
+    const SamplePattern &samplePattern(int count)
+    {
+        static const SamplePattern k1{1, {0}, {0}};
+        static const SamplePattern k2{2, {4, -4}, {4, -4}};
+        static const SamplePattern k4{4, {-2, 6, -6, 2}, {-6, -2, 2, 6}};
+        static const SamplePattern k8{
+            8, {1, -1, 5, -3, -5, -7, 3, 7}, {-3, 3, 1, -5, 5, -1, 7, -7}};
+        switch (count)
+        {
+        case 2:
+            return k2;
+        case 4:
+            return k4;
+        case 8:
+            return k8;
+        default:
+            return k1;
+        }
+    }
+
+    uint64_t blockCoverage(const RasterTriangle &tri, int bx, int by, int ox, int oy)
+    {
+        // fixed-point samples of the block: first pixel center + [0, 7] pixels
+        const int32_t     fx = bx * kOne + kHalf + ox, fy = by * kOne + kHalf + oy;
+        constexpr int32_t span = 7 * kOne;
+
+        // trivial reject / accept per edge from the corner that maximizes / minimizes it;
+        // only edges crossing the block are evaluated per sample
+        uint64_t mask = kFullBlock;
+        for (const math::EdgeFx &e : tri.e)
+        {
+            const int64_t hi = e.eval(e.a > 0 ? fx + span : fx, e.b > 0 ? fy + span : fy);
+            if (!e.inside(hi))
+                return 0;
+            const int64_t lo = e.eval(e.a > 0 ? fx : fx + span, e.b > 0 ? fy : fy + span);
+            if (e.inside(lo))
+                continue;
+            mask &= edgeMask(e, static_cast<int32_t>(e.eval(fx, fy)));
+        }
+        return mask;
+    }
+
+    core::DepthPlane blockPlane(const RasterTriangle &tri, int bx, int by)
+    {
+        // barycentrics at the block, not the triangle's plane from afar: keeps the relative
+        // precision of small (far, reversed-Z) depths
+        const math::Vec3 b = pixelBarycentric(tri, bx, by);
+        return {b.x * tri.z[0] + b.y * tri.z[1] + b.z * tri.z[2], tri.dzdx, tri.dzdy};
+    }
+
+    void rasterizeDepth(const RasterTriangle &tri, const TileRect &rect, core::DepthBuffer &db)
+    {
+        const int x0 = std::max(tri.minX, rect.x0), x1 = std::min(tri.maxX, rect.x1 - 1);
+        const int y0 = std::max(tri.minY, rect.y0), y1 = std::min(tri.maxY, rect.y1 - 1);
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        const float      dzdx = tri.dzdx, dzdy = tri.dzdy;
+        float           *depth = db.floats();
+        const math::Vec3 b = pixelBarycentric(tri, x0, y0);
+        const float      z0 = b.x * tri.z[0] + b.y * tri.z[1] + b.z * tri.z[2];
+
+        // a few pixels (the common case in a shadow map): walk the bbox with stepped edges
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) <= kSmallTriangle)
+        {
+            const int32_t px = x0 * kOne + kHalf, py = y0 * kOne + kHalf;
+            int64_t       row[3];
+            for (int i = 0; i < 3; i++)
+                row[i] = tri.e[i].eval(px, py) + tri.e[i].bias; // inside: > 0
+            float zRow = z0;
+            for (int y = y0; y <= y1; y++)
+            {
+                int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+                float   z = zRow;
+                for (int x = x0; x <= x1; x++)
+                {
+                    if (w0 > 0 && w1 > 0 && w2 > 0)
+                    {
+                        float &d = depth[db.layout.index(x, y)];
+                        d = std::min(d, z);
+                    }
+                    w0 += int64_t(tri.e[0].a) * kOne;
+                    w1 += int64_t(tri.e[1].a) * kOne;
+                    w2 += int64_t(tri.e[2].a) * kOne;
+                    z += dzdx;
+                }
+                for (int i = 0; i < 3; i++)
+                    row[i] += int64_t(tri.e[i].b) * kOne;
+                zRow += dzdy;
+            }
+            return;
+        }
+
+        for (int by = y0 >> 3; by <= y1 >> 3; by++)
+        {
+            for (int bx = x0 >> 3; bx <= x1 >> 3; bx++)
+            {
+                uint64_t mask = blockCoverage(tri, bx * 8, by * 8);
+                if (mask == 0)
+                    continue;
+                mask &= rectMask(bx * 8, by * 8, x0, y0, x1, y1);
+                float *const block = depth + db.layout.index(bx * 8, by * 8);
+                while (mask)
+                {
+                    const int bit = std::countr_zero(mask);
+                    mask &= mask - 1;
+
+                    const int   x = bx * 8 + (bit & 7), y = by * 8 + (bit >> 3);
+                    const float z = z0 + float(x - x0) * dzdx + float(y - y0) * dzdy;
+                    float      &d = block[bit];
+                    d = std::min(d, z);
+                }
+            }
+        }
+    }
+
+    math::Vec3 pixelBarycentric(const RasterTriangle &tri, int x, int y)
+    {
+        const int32_t px = x * kOne + kHalf, py = y * kOne + kHalf;
+        return {float(tri.e[0].eval(px, py)) * tri.invArea,
+                float(tri.e[1].eval(px, py)) * tri.invArea,
+                float(tri.e[2].eval(px, py)) * tri.invArea};
+    }
+
+    shader::FSIn interpolate(const RasterTriangle &tri, int x, int y)
+    {
+        const math::Vec3 b = pixelBarycentric(tri, x, y);
+
+        // perspective-correct weights
+        float       p0 = b.x * tri.invW[0], p1 = b.y * tri.invW[1], p2 = b.z * tri.invW[2];
+        const float norm = 1.0f / (p0 + p1 + p2);
+        p0 *= norm;
+        p1 *= norm;
+        p2 *= norm;
+
+        const shader::VSOut *a = tri.attr;
+        shader::FSIn         in;
+        in.world_pos = a[0].world_pos * p0 + a[1].world_pos * p1 + a[2].world_pos * p2;
+        in.nrm = a[0].world_nrm * p0 + a[1].world_nrm * p1 + a[2].world_nrm * p2;
+        in.color = a[0].color * p0 + a[1].color * p1 + a[2].color * p2;
+        in.uv = a[0].uv * p0 + a[1].uv * p1 + a[2].uv * p2;
+
+        // analytic uv derivatives: b / w is linear in screen space, so per pixel step
+        // d(uv) = sum(d(b_i / w_i) * (uv_i - uv)) / sum(b_i / w_i)
+        const float      step = kOne * tri.invArea * norm;
+        const math::Vec2 d0 = (a[0].uv - in.uv) * tri.invW[0];
+        const math::Vec2 d1 = (a[1].uv - in.uv) * tri.invW[1];
+        const math::Vec2 d2 = (a[2].uv - in.uv) * tri.invW[2];
+        in.duvdx = (d0 * float(tri.e[0].a) + d1 * float(tri.e[1].a) + d2 * float(tri.e[2].a)) *
+                   step;
+        in.duvdy = (d0 * float(tri.e[0].b) + d1 * float(tri.e[1].b) + d2 * float(tri.e[2].b)) *
+                   step;
+        in.x = x;
+        in.y = y;
+        return in;
+    }
+} // namespace renderer
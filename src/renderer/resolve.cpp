@@ -0,0 +1,223 @@
+﻿#include "renderer/resolve.h"
+#include "color.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace renderer
+{
+    namespace
+    {
+        using Format = core::HdrBuffer::Format;
+        using Curve = scene::ToneMapping;
+
+        constexpr float kLutScale = float(ToneMapper::kLutSize - 1);
+
+#if defined(__SSE2__)
+        // one pixel, linear rgba
+        template <Format F> __m128 load1(const uint8_t *p)
+        {
+            if constexpr (F == Format::RGBA32F)
+                return _mm_loadu_ps(reinterpret_cast<const float *>(p));
+#if defined(__F16C__)
+            else
+                return _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+#else
+            else
+            {
+                uint16_t h[4];
+                float    f[4];
+                std::memcpy(h, p, sizeof(h));
+                math::halfToFloat4(h, f);
+                return _mm_loadu_ps(f);
+            }
+#endif
+        }
+
+        // rgb through the curve, alpha kept; clamped to [0, 1] (NaN -> 0)
+        template <Curve C> __m128 toneMap(__m128 c, __m128 scale)
+        {
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+            __m128       x = _mm_max_ps(_mm_mul_ps(c, scale), zero);
+            if constexpr (C == Curve::Reinhard)
+                x = _mm_div_ps(x, _mm_add_ps(x, one));
+            else if constexpr (C == Curve::ACES)
+            {
+                // x (2.51 x + 0.03) / (x (2.43 x + 0.59) + 0.14)
+                const __m128 a = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f));
+                const __m128 b = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f));
+                const __m128 num = _mm_mul_ps(x, a);
+                const __m128 den = _mm_add_ps(_mm_mul_ps(x, b), _mm_set1_ps(0.14f));
+                x = _mm_div_ps(num, den);
+            }
+            const __m128 alpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+            x = _mm_or_ps(_mm_andnot_ps(alpha, x), _mm_and_ps(alpha, _mm_max_ps(c, zero)));
+            return _mm_min_ps(x, one);
+        }
+
+        template <Format F, Curve C>
+        uint32_t packPixel(const uint8_t *src, __m128 scale, const int32_t *lut)
+        {
+            const __m128 t = toneMap<C>(load1<F>(src), scale);
+            alignas(16) int32_t i[4];
+            const __m128        s = _mm_mul_ps(_mm_sqrt_ps(t), _mm_set1_ps(kLutScale));
+            _mm_store_si128(reinterpret_cast<__m128i *>(i),
+                            _mm_cvttps_epi32(_mm_add_ps(s, _mm_set1_ps(0.5f))));
+            const int32_t a = _mm_cvtsi128_si32(_mm_cvttps_epi32(_mm_add_ps(
+                _mm_mul_ps(_mm_shuffle_ps(t, t, 0xff), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f))));
+            return uint32_t(lut[i[0]]) | uint32_t(lut[i[1]]) << 8 | uint32_t(lut[i[2]]) << 16 |
+                   uint32_t(a) << 24;
+        }
+
+#if defined(__AVX2__) && defined(__F16C__)
+        // two pixels
+        template <Format F> __m256 load2(const uint8_t *p)
+        {
+            if constexpr (F == Format::RGBA32F)
+                return _mm256_loadu_ps(reinterpret_cast<const float *>(p));
+            else
+                return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        }
+
+        template <Curve C> __m256 toneMap(__m256 c, __m256 scale)
+        {
+            const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+            __m256       x = _mm256_max_ps(_mm256_mul_ps(c, scale), zero);
+            if constexpr (C == Curve::Reinhard)
+                x = _mm256_div_ps(x, _mm256_add_ps(x, one));
+            else if constexpr (C == Curve::ACES)
+            {
+                const __m256 a = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(2.51f)),
+                                               _mm256_set1_ps(0.03f));
+                const __m256 b = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(2.43f)),
+                                               _mm256_set1_ps(0.59f));
+                const __m256 num = _mm256_mul_ps(x, a);
+                const __m256 den = _mm256_add_ps(_mm256_mul_ps(x, b), _mm256_set1_ps(0.14f));
+                x = _mm256_div_ps(num, den);
+            }
+            x = _mm256_blend_ps(x, _mm256_max_ps(c, zero), 0x88); // alpha lanes
+            return _mm256_min_ps(x, one);
+        }
+
+        // eight bytes per lane pair -> 8 bit rgba of two pixels
+        template <Format F, Curve C>
+        __m256i packPixels2(const uint8_t *src, __m256 scale, const int32_t *lut)
+        {
+            const __m256  t = toneMap<C>(load2<F>(src), scale);
+            const __m256  half = _mm256_set1_ps(0.5f);
+            const __m256i i = _mm256_cvttps_epi32(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(t), _mm256_set1_ps(kLutScale)), half));
+            const __m256i a = _mm256_cvttps_epi32(
+                _mm256_add_ps(_mm256_mul_ps(t, _mm256_set1_ps(255.0f)), half));
+            return _mm256_blend_epi32(_mm256_i32gather_epi32(lut, i, 4), a, 0x88);
+        }
+#endif
+
+        template <Format F, Curve C>
+        void resolveSpan(const uint8_t *src, uint8_t *dst, size_t count, float exposure,
+                         const int32_t *lut)
+        {
+            constexpr size_t bpp = F == Format::RGBA32F ? 16 : 8;
+            size_t           i = 0;
+#if defined(__AVX2__) && defined(__F16C__)
+            // four pixels per step, packed 32 -> 16 -> 8 bits (in-lane), then put in order
+            const __m256  scale8 = _mm256_setr_ps(exposure, exposure, exposure, 1.0f, exposure,
+                                                  exposure, exposure, 1.0f);
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            for (; i + 4 <= count; i += 4)
+            {
+                const __m256i p01 = packPixels2<F, C>(src + i * bpp, scale8, lut);
+                const __m256i p23 = packPixels2<F, C>(src + (i + 2) * bpp, scale8, lut);
+                const __m256i w = _mm256_packus_epi32(p01, p23); // lanes: 0 2 | 1 3
+                const __m256i b = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(w, w), order);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                                 _mm256_castsi256_si128(b));
+            }
+#endif
+            const __m128 scale = _mm_setr_ps(exposure, exposure, exposure, 1.0f);
+            for (; i < count; i++)
+            {
+                const uint32_t p = packPixel<F, C>(src + i * bpp, scale, lut);
+                std::memcpy(dst + i * 4, &p, sizeof(p));
+            }
+        }
+#else
+        template <Format F, Curve C>
+        void resolveSpan(const uint8_t *src, uint8_t *dst, size_t count, float exposure,
+                         const int32_t *lut)
+        {
+            constexpr size_t bpp = F == Format::RGBA32F ? 16 : 8;
+            for (size_t i = 0; i < count; i++, src += bpp, dst += 4)
+            {
+                float c[4];
+                if constexpr (F == Format::RGBA32F)
+                    std::memcpy(c, src, sizeof(c));
+                else
+                {
+                    uint16_t h[4];
+                    std::memcpy(h, src, sizeof(h));
+                    math::halfToFloat4(h, c);
+                }
+                for (int ch = 0; ch < 3; ch++)
+                {
+                    float x = c[ch] * exposure;
+                    x = x > 0.0f ? x : 0.0f;
+                    if constexpr (C == Curve::Reinhard)
+                        x = color::reinhard(x);
+                    else if constexpr (C == Curve::ACES)
+                        x = color::acesFilm(x);
+                    x = std::min(x, 1.0f);
+                    dst[ch] = uint8_t(lut[int(std::sqrt(x) * kLutScale + 0.5f)]);
+                }
+                const float a = c[3] > 0.0f ? std::min(c[3], 1.0f) : 0.0f;
+                dst[3] = uint8_t(a * 255.0f + 0.5f);
+            }
+        }
+#endif
+
+        template <Format F>
+        void resolveSpan(Curve curve, const uint8_t *src, uint8_t *dst, size_t count,
+                         float exposure, const int32_t *lut)
+        {
+            switch (curve)
+            {
+            case Curve::Reinhard:
+                return resolveSpan<F, Curve::Reinhard>(src, dst, count, exposure, lut);
+            case Curve::ACES:
+                return resolveSpan<F, Curve::ACES>(src, dst, count, exposure, lut);
+            default:
+                return resolveSpan<F, Curve::None>(src, dst, count, exposure, lut);
+            }
+        }
+    } // namespace
+
+    void ToneMapper::configure(float exposure, scene::ToneMapping curve, float gamma)
+    {
+        this->exposure = exposure;
+        this->curve = curve;
+        gamma = gamma > 0.0f ? gamma : 1.0f;
+        if (gamma == this->gamma)
+            return;
+        this->gamma = gamma;
+        lut.resize(kLutSize);
+        for (int i = 0; i < kLutSize; i++)
+        {
+            const float x = float(i) / kLutScale;
+            lut[i] = int32_t(std::pow(x * x, 1.0f / gamma) * 255.0f + 0.5f);
+        }
+    }
+
+    void ToneMapper::resolve(const core::HdrBuffer &src, core::FrameBuffer &dst, size_t first,
+                             size_t count) const
+    {
+        const uint8_t *in = src.color.data() + first * src.bytesPerPixel();
+        uint8_t       *out = dst.color.data() + first * 4;
+        if (src.format == Format::RGBA32F)
+            resolveSpan<Format::RGBA32F>(curve, in, out, count, exposure, lut.data());
+        else
+            resolveSpan<Format::RGBA16F>(curve, in, out, count, exposure, lut.data());
+    }
+} // namespace renderer
@@ -4,17 +4,9 @@ namespace renderer
 {
     namespace shader
     {
-        VSOut defaultVS(const VSIn &)
-        {
-            VSOut out;
-            return out;
-        }
+        VSOut defaultVS(const VSIn &in, const VSUniform &u) { return DefaultVS{}(in, u); }
 
-        FSOut defaultFS(const FSIn &)
-        {
-            FSOut out;
-            return out;
-        }
+        FSOut defaultFS(const FSIn &in, const FSUniform &u) { return DefaultFS{}(in, u); }
 
     } // namespace shader
 } // namespace renderer
@@ -0,0 +1,108 @@
+﻿#include "renderer/shadow.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace renderer
+{
+    namespace
+    {
+        // log/uniform blend of the cascade split distances
+        constexpr float kSplitLambda = 0.75f;
+
+        void resizeView(ShadowView &v, int size)
+        {
+            if (v.depth.width != size || v.depth.height != size)
+            {
+                v.depth = core::DepthBuffer(size, size, core::DepthFormat::D32F, false);
+                v.rendered = false;
+            }
+        }
+
+        // any vector not parallel to dir
+        math::Vec3 upFor(const math::Vec3 &dir)
+        {
+            return std::fabs(dir.y) > 0.99f ? math::Vec3{1, 0, 0} : math::Vec3{0, 1, 0};
+        }
+    } // namespace
+
+    void cascadeViews(const scene::Camera &cam, const math::Mat4 &camWorld, float aspect,
+                      float distance, const math::Vec3 &dir, const math::AABB &scene,
+                      int size, ShadowView *views, int count)
+    {
+        const float tanY = std::tan(math::radians(cam.fovY) * 0.5f);
+        const float tanX = tanY * aspect;
+        const float n = cam.znear, f = std::max(distance, n * 2.0f);
+
+        // light space without translation, so snapping below moves in whole texels
+        const math::Vec3 d = math::normalize(dir);
+        const math::Mat4 L = math::lookAt({0, 0, 0}, d, upFor(d));
+
+        // scene depth range along the light: casters outside the camera still shadow it
+        float sceneNear = FLT_MAX, sceneFar = -FLT_MAX;
+        for (int i = 0; i < 8 && !scene.empty(); i++)
+        {
+            const math::Vec3 p{(i & 1) ? scene.max.x : scene.min.x,
+                               (i & 2) ? scene.max.y : scene.min.y,
+                               (i & 4) ? scene.max.z : scene.min.z};
+            const float      z = -L.mul_point(p).z;
+            sceneNear = std::min(sceneNear, z);
+            sceneFar = std::max(sceneFar, z);
+        }
+
+        float d0 = n;
+        for (int c = 0; c < count; c++)
+        {
+            const float t = float(c + 1) / count;
+            const float d1 =
+                kSplitLambda * n * std::pow(f / n, t) + (1.0f - kSplitLambda) * (n + (f - n) * t);
+
+            // sphere around the slice's corners: the view does not change as the camera turns
+            math::Vec3 corners[8];
+            math::Vec3 center{0, 0, 0};
+            for (int i = 0; i < 8; i++)
+            {
+                const float      z = (i & 4) ? d1 : d0;
+                const math::Vec4 w = camWorld.mul_point(
+                    {(i & 1 ? 1.0f : -1.0f) * tanX * z, (i & 2 ? 1.0f : -1.0f) * tanY * z, -z});
+                corners[i] = {w.x, w.y, w.z};
+                center += corners[i] * 0.125f;
+            }
+            float radius = 0.0f;
+            for (const math::Vec3 &p : corners)
+                radius = std::max(radius, math::length(p - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            ShadowView &v = views[c];
+            resizeView(v, size);
+            v.sliceNear = d0;
+            v.sliceFar = d1;
+            v.texel = 2.0f * radius / (size - 2);
+
+            // one texel of margin around the slice absorbs the snapping
+            const math::Vec4 lc = L.mul_point(center);
+            const float      cx = std::floor(lc.x / v.texel) * v.texel;
+            const float      cy = std::floor(lc.y / v.texel) * v.texel;
+            const float      half = radius + v.texel;
+            const float      zNear = std::min(-lc.z - radius, sceneNear);
+            const float      zFar = std::max(-lc.z + radius, sceneFar);
+            v.VP = L * math::orthographic(cx - half, cx + half, cy - half, cy + half, zNear, zFar);
+            d0 = d1;
+        }
+    }
+
+    void cubeViews(const math::Vec3 &pos, float range, int size, ShadowView *views)
+    {
+        static const math::Vec3 kAxes[6] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                                            {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+        const math::Mat4        P = math::perspective(90.0f, 1.0f, range * 0.01f, range);
+        for (int i = 0; i < 6; i++)
+        {
+            ShadowView &v = views[i];
+            resizeView(v, size);
+            v.VP = math::lookAt(pos, pos + kAxes[i], upFor(kAxes[i])) * P;
+            v.sliceNear = v.sliceFar = -1.0f;
+            v.texel = 2.0f / size;
+        }
+    }
+} // namespace renderer
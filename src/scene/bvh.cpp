@@ -0,0 +1,334 @@
+﻿#include "scene/bvh.h"
+#include <atomic>
+
+namespace scene
+{
+    namespace
+    {
+        constexpr int      kBins = 16;
+        constexpr uint32_t kLeafSize = 4;
+        // past this depth splits fall back to the median, so the tree stays
+        // within the traversal stack (kMaxDepth) for any object count
+        constexpr int kMaxSahDepth = 32;
+
+        float area(const math::AABB &b)
+        {
+            const math::Vec3 e = b.max - b.min;
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        float axisOf(const math::Vec3 &v, int axis)
+        {
+            return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+        }
+    } // namespace
+
+    // one level: nodes[index] (first/count set) gets its box and either stays a leaf
+    // or is split in two children appended to out; false when it stays a leaf
+    bool Bvh::splitNode(std::vector<Node> &out, uint32_t index, int depth)
+    {
+        const uint32_t first = out[index].first, count = out[index].count;
+        const uint32_t end = first + count;
+
+        math::AABB box, cbox;
+        for (uint32_t i = first; i < end; i++)
+        {
+            math::expand(box, boxes[items[i]]);
+            math::expand(cbox, centers[items[i]]);
+        }
+        out[index].box = box;
+        out[index].left = 0;
+        if (count <= kLeafSize)
+            return false;
+
+        // binned SAH over the axis of largest centroid spread
+        const math::Vec3 ext = cbox.max - cbox.min;
+        const int        axis = (ext.x >= ext.y && ext.x >= ext.z) ? 0 : (ext.y >= ext.z ? 1 : 2);
+        const float      lo = axisOf(cbox.min, axis), span = axisOf(ext, axis);
+
+        uint32_t mid = first + count / 2;
+        bool     sah = false;
+        if (span > 0.0f && depth < kMaxSahDepth)
+        {
+            math::AABB binBox[kBins];
+            uint32_t   binCount[kBins] = {};
+            const float scale = kBins / span;
+            auto        binOf = [&](uint32_t object)
+            { return std::min(int((axisOf(centers[object], axis) - lo) * scale), kBins - 1); };
+            for (uint32_t i = first; i < end; i++)
+            {
+                const int b = binOf(items[i]);
+                binCount[b]++;
+                math::expand(binBox[b], boxes[items[i]]);
+            }
+
+            // cost of splitting after bin i: area(left) * n(left) + area(right) * n(right)
+            float      rightCost[kBins];
+            math::AABB acc;
+            uint32_t   n = 0;
+            for (int i = kBins - 1; i > 0; i--)
+            {
+                math::expand(acc, binBox[i]);
+                n += binCount[i];
+                rightCost[i] = n ? area(acc) * n : 0.0f;
+            }
+            float bestCost = FLT_MAX;
+            int   bestSplit = -1;
+            acc = {};
+            n = 0;
+            for (int i = 0; i < kBins - 1; i++)
+            {
+                math::expand(acc, binBox[i]);
+                n += binCount[i];
+                if (n == 0 || n == count)
+                    continue;
+                const float cost = area(acc) * n + rightCost[i + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = i;
+                }
+            }
+
+            // a leaf is cheaper than the best split (traversal step ~ one box test)
+            if (bestSplit >= 0 && count <= 2 * kLeafSize && bestCost >= area(box) * count)
+                return false;
+            if (bestSplit >= 0)
+            {
+                const uint32_t *pivot =
+                    std::partition(&items[first], &items[first] + count,
+                                   [&](uint32_t object) { return binOf(object) <= bestSplit; });
+                mid = uint32_t(pivot - items.data());
+                sah = true;
+            }
+        }
+        if (!sah)
+            std::nth_element(&items[first], &items[mid], &items[first] + count,
+                             [&](uint32_t a, uint32_t b)
+                             { return axisOf(centers[a], axis) < axisOf(centers[b], axis); });
+
+        const uint32_t left = uint32_t(out.size());
+        out.push_back({{}, 0, first, mid - first});
+        out.push_back({{}, 0, mid, end - mid});
+        out[index].left = left;
+        return true;
+    }
+
+    void Bvh::buildSubtree(std::vector<Node> &out, uint32_t index, int depth)
+    {
+        if (!splitNode(out, index, depth))
+            return;
+        const uint32_t left = out[index].left;
+        buildSubtree(out, left, depth + 1);
+        buildSubtree(out, left + 1, depth + 1);
+    }
+
+    void Bvh::linkParents()
+    {
+        parents.assign(nodes.size(), kNone);
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const Node &n = nodes[i];
+            if (n.left != 0)
+            {
+                parents[n.left] = i;
+                parents[n.left + 1] = i;
+            }
+            else
+            {
+                for (uint32_t k = n.first; k < n.first + n.count; k++)
+                    leafOf[items[k]] = i;
+            }
+        }
+    }
+
+    void Bvh::build(std::span<const math::AABB> bounds, const Parallel &parallel, int workers)
+    {
+        const uint32_t count = uint32_t(bounds.size());
+        boxes.assign(bounds.begin(), bounds.end());
+        centers.resize(count);
+        items.resize(count);
+        leafOf.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            centers[i] = boxes[i].center();
+            items[i] = i;
+        }
+        nodes.clear();
+        if (count == 0)
+        {
+            parents.clear();
+            return;
+        }
+
+        nodes.reserve(2 * count / kLeafSize + 1);
+        nodes.push_back({{}, 0, 0, count});
+        if (!parallel || workers <= 1)
+        {
+            buildSubtree(nodes, 0, 0);
+            linkParents();
+            return;
+        }
+
+        // top levels serially (largest node first) until there is work for every worker
+        struct Task
+        {
+            uint32_t index;
+            int      depth;
+        };
+        std::vector<Task> tasks{{0, 0}};
+        while (tasks.size() < size_t(4 * workers))
+        {
+            auto bySize = [&](const Task &a, const Task &b)
+            { return nodes[a.index].count < nodes[b.index].count; };
+            auto largest = std::max_element(tasks.begin(), tasks.end(), bySize);
+            const Task task = *largest;
+            if (nodes[task.index].count <= 64)
+                break;
+            tasks.erase(largest);
+            if (!splitNode(nodes, task.index, task.depth))
+                continue;
+            tasks.push_back({nodes[task.index].left, task.depth + 1});
+            tasks.push_back({nodes[task.index].left + 1, task.depth + 1});
+        }
+
+        // subtrees into private node arrays (local root = 0), then appended in task order
+        std::vector<std::vector<Node>> local(tasks.size());
+        std::atomic<size_t>            next{0};
+        parallel(
+            [&](int)
+            {
+                for (size_t t = next++; t < tasks.size(); t = next++)
+                {
+                    local[t].push_back(nodes[tasks[t].index]);
+                    buildSubtree(local[t], 0, tasks[t].depth);
+                }
+            });
+
+        for (size_t t = 0; t < tasks.size(); t++)
+        {
+            // local node k > 0 lands at base + k - 1
+            const uint32_t base = uint32_t(nodes.size());
+            auto           remap = [&](Node n)
+            {
+                if (n.left != 0)
+                    n.left = base + n.left - 1;
+                return n;
+            };
+            nodes[tasks[t].index] = remap(local[t][0]);
+            for (size_t k = 1; k < local[t].size(); k++)
+                nodes.push_back(remap(local[t][k]));
+        }
+        linkParents();
+    }
+
+    void Bvh::refit(std::span<const uint32_t> moved, std::span<const math::AABB> bounds)
+    {
+        for (uint32_t object : moved)
+        {
+            boxes[object] = bounds[object];
+
+            // leaf from its objects, then parents until a box stops changing
+            uint32_t index = leafOf[object];
+            Node    &leaf = nodes[index];
+            leaf.box = {};
+            for (uint32_t k = leaf.first; k < leaf.first + leaf.count; k++)
+                math::expand(leaf.box, boxes[items[k]]);
+
+            for (index = parents[index]; index != kNone; index = parents[index])
+            {
+                Node      &n = nodes[index];
+                math::AABB box = nodes[n.left].box;
+                math::expand(box, nodes[n.left + 1].box);
+                if (box.min.x == n.box.min.x && box.min.y == n.box.min.y &&
+                    box.min.z == n.box.min.z && box.max.x == n.box.max.x &&
+                    box.max.y == n.box.max.y && box.max.z == n.box.max.z)
+                    break;
+                n.box = box;
+            }
+        }
+    }
+
+    bool Bvh::overlaps(const math::Sphere &s) const
+    {
+        if (nodes.empty())
+            return false;
+
+        uint32_t stack[kMaxDepth];
+        int      top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &n = nodes[stack[--top]];
+            if (!intersects(s, n.box))
+                continue;
+            if (n.left == 0)
+            {
+                for (uint32_t i = n.first; i < n.first + n.count; i++)
+                    if (intersects(s, boxes[items[i]]))
+                        return true;
+                continue;
+            }
+            stack[top++] = n.left;
+            stack[top++] = n.left + 1;
+        }
+        return false;
+    }
+
+    std::optional<Bvh::Hit> Bvh::raycast(const math::Vec3 &origin, const math::Vec3 &dir,
+                                         float tMax) const
+    {
+        const math::Vec3 inv{1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z};
+
+        // slab test, entry distance or -1 on a miss
+        auto enter = [&](const math::AABB &b, float limit)
+        {
+            const float tx0 = (b.min.x - origin.x) * inv.x, tx1 = (b.max.x - origin.x) * inv.x;
+            const float ty0 = (b.min.y - origin.y) * inv.y, ty1 = (b.max.y - origin.y) * inv.y;
+            const float tz0 = (b.min.z - origin.z) * inv.z, tz1 = (b.max.z - origin.z) * inv.z;
+            const float t0 =
+                std::max({std::min(tx0, tx1), std::min(ty0, ty1), std::min(tz0, tz1), 0.0f});
+            const float t1 =
+                std::min({std::max(tx0, tx1), std::max(ty0, ty1), std::max(tz0, tz1), limit});
+            return t0 <= t1 ? t0 : -1.0f;
+        };
+
+        std::optional<Hit> hit;
+        if (nodes.empty())
+            return hit;
+
+        uint32_t stack[kMaxDepth];
+        int      top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &n = nodes[stack[--top]];
+            const float limit = hit ? hit->t : tMax;
+            if (enter(n.box, limit) < 0.0f)
+                continue;
+            if (n.left == 0)
+            {
+                for (uint32_t i = n.first; i < n.first + n.count; i++)
+                {
+                    const float t = enter(boxes[items[i]], hit ? hit->t : tMax);
+                    if (t >= 0.0f && (!hit || t < hit->t))
+                        hit = Hit{items[i], t};
+                }
+                continue;
+            }
+            // nearer child on top of the stack
+            const float tl = enter(nodes[n.left].box, limit);
+            const float tr = enter(nodes[n.left + 1].box, limit);
+            if (tl >= 0.0f && tr >= 0.0f)
+            {
+                stack[top++] = tl < tr ? n.left + 1 : n.left;
+                stack[top++] = tl < tr ? n.left : n.left + 1;
+            }
+            else if (tl >= 0.0f)
+                stack[top++] = n.left;
+            else if (tr >= 0.0f)
+                stack[top++] = n.left + 1;
+        }
+        return hit;
+    }
+} // namespace scene
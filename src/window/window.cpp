@@ -4,7 +4,7 @@
 
 namespace window
 {
-    // channels: 3=RGB24, 4=RGBA8888
+    // channels: 3=RGB24, 4=RGBA32 (bytes R, G, B, A in memory on any endianness)
     bool Manager::create(const std::string &title, int w, int h, int chn)
     {
         destroy();
@@ -21,9 +21,11 @@ namespace window
             return false;
         }
 
-        // renderer
+        // renderer; software when there is no GPU (e.g. SDL_VIDEODRIVER=dummy, headless tests)
         renderer =
             SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+        if (!renderer)
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
         if (!renderer)
         {
             LOG_ERROR();
@@ -32,7 +34,7 @@ namespace window
         }
 
         // texture
-        const Uint32 fmt = (channels == 3) ? SDL_PIXELFORMAT_RGB24 : SDL_PIXELFORMAT_RGBA8888;
+        const Uint32 fmt = (channels == 3) ? SDL_PIXELFORMAT_RGB24 : SDL_PIXELFORMAT_RGBA32;
         texture = SDL_CreateTexture(renderer, fmt, SDL_TEXTUREACCESS_STREAMING, width, height);
         if (!texture)
         {
@@ -57,8 +59,71 @@ namespace window
             memcpy((uint8_t *)target + y * pitch, pixels.data() + y * width * channels,
                    width * channels);
         SDL_UnlockTexture(texture);
+        present();
+    }
+
+    void Manager::render(const core::FrameBuffer &fb)
+    {
+        if (channels != 4)
+        {
+            // RGB24 texture: through a linear copy without alpha
+            const std::vector<uint8_t> rgba = fb.linear();
+            std::vector<uint8_t>       rgb(size_t(fb.width) * fb.height * 3);
+            for (size_t i = 0; i < rgb.size() / 3; i++)
+                memcpy(&rgb[i * 3], &rgba[i * 4], 3);
+            render(rgb);
+            return;
+        }
+
+        Frame frame;
+        if (!lock(frame))
+            return;
+        fb.resolve(frame.pixels, frame.pitch);
+        SDL_UnlockTexture(texture);
+        present();
+    }
 
-        // show
+    bool Manager::lock(Frame &frame)
+    {
+        void *target;
+        int   pitch;
+        if (SDL_LockTexture(texture, nullptr, &target, &pitch) != 0)
+        {
+            LOG_ERROR(SDL_GetError());
+            return false;
+        }
+        frame = {static_cast<uint8_t *>(target), pitch, width, height, channels};
+        return true;
+    }
+
+    // false once the window is closed (or ESC)
+    bool Manager::pollEvents(const EventCallback &onEvent)
+    {
+        bool      running = true;
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+        {
+            if (e.type == SDL_QUIT)
+                running = false;
+            else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
+                running = false;
+            if (onEvent)
+                onEvent(e);
+        }
+        return running;
+    }
+
+    // seconds since the previous call
+    float Manager::tick()
+    {
+        const Uint64 now = SDL_GetPerformanceCounter();
+        const float  dt = float(now - last) / float(SDL_GetPerformanceFrequency());
+        last = now;
+        return dt;
+    }
+
+    void Manager::present()
+    {
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, nullptr, nullptr);
         SDL_RenderPresent(renderer);
@@ -71,30 +136,14 @@ namespace window
 
         std::vector<uint8_t> pixels(width * height * channels);
 
-        bool   running = true;
-        Uint64 freq = SDL_GetPerformanceFrequency();
-        Uint64 last = SDL_GetPerformanceCounter();
-
+        last = SDL_GetPerformanceCounter();
+        bool running = true;
         while (running)
         {
-            SDL_Event e;
-            // 이벤트 처리
-            while (SDL_PollEvent(&e))
-            {
-                if (e.type == SDL_QUIT)
-                    running = false;
-                else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
-                    running = false;
-                if (onEvent)
-                    onEvent(e);
-            }
-
-            // deltaTime 계산
-            Uint64 now = SDL_GetPerformanceCounter();
-            float  dt = (now - last) / freq;
+            running = pollEvents(onEvent);
 
             // frame callback
-            if (!onFrame(dt, width, height, channels, pixels))
+            if (!onFrame(tick(), width, height, channels, pixels))
                 break;
 
             // upload
@@ -103,6 +152,29 @@ namespace window
         return true;
     }
 
+    bool Manager::loopDirect(const DirectFrameCallback &onFrame, const EventCallback &onEvent)
+    {
+        if (!window || !renderer || !texture)
+            return false;
+
+        last = SDL_GetPerformanceCounter();
+        bool running = true;
+        while (running)
+        {
+            running = pollEvents(onEvent);
+
+            Frame frame;
+            if (!lock(frame))
+                return false;
+            const bool more = onFrame(tick(), frame);
+            SDL_UnlockTexture(texture);
+            if (!more)
+                break;
+            present();
+        }
+        return true;
+    }
+
     void Manager::destroy()
     {
         if (texture)
@@ -111,6 +183,9 @@ namespace window
             SDL_DestroyRenderer(renderer);
         if (window)
             SDL_DestroyWindow(window);
+        texture = nullptr;
+        renderer = nullptr;
+        window = nullptr;
         SDL_Quit();
     }
 }; // namespace window
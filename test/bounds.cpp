@@ -0,0 +1,151 @@
+﻿#include "check.h"
+#include "math/math.h"
+#include "math/projection.h"
+#include <random>
+
+using namespace math;
+
+namespace
+{
+    std::mt19937 rng(9);
+
+    float uniform(float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); }
+
+    AABB randomBox(float range, float maxSize)
+    {
+        const Vec3 c{uniform(-range, range), uniform(-range, range), uniform(-range, range)};
+        const Vec3 e{uniform(0.0f, maxSize), uniform(0.0f, maxSize), uniform(0.0f, maxSize)};
+        return {c - e, c + e};
+    }
+
+    Vec3 corner(const AABB &b, int i)
+    {
+        return {i & 1 ? b.max.x : b.min.x, i & 2 ? b.max.y : b.min.y, i & 4 ? b.max.z : b.min.z};
+    }
+
+    // the brute force answer: outside when all 8 corners lie behind one clip plane
+    bool outsideOnePlane(const Mat4 &VP, const AABB &b)
+    {
+        Vec4 c[8];
+        for (int i = 0; i < 8; i++)
+            c[i] = VP.mul_point(corner(b, i));
+        auto all = [&](auto outside)
+        {
+            for (const Vec4 &p : c)
+                if (!outside(p))
+                    return false;
+            return true;
+        };
+        return all([](const Vec4 &p) { return p.x < -p.w; }) ||
+               all([](const Vec4 &p) { return p.x > p.w; }) ||
+               all([](const Vec4 &p) { return p.y < -p.w; }) ||
+               all([](const Vec4 &p) { return p.y > p.w; }) ||
+               all([](const Vec4 &p) { return p.z < -p.w; }) ||
+               all([](const Vec4 &p) { return p.z > p.w; });
+    }
+
+    // any point of the box in the clip volume
+    bool visiblePoint(const Mat4 &VP, const AABB &b)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            const Vec3 q{uniform(b.min.x, b.max.x), uniform(b.min.y, b.max.y),
+                         uniform(b.min.z, b.max.z)};
+            const Vec4 p = VP.mul_point(i < 8 ? corner(b, i) : q);
+            if (p.w > 0.0f && std::fabs(p.x) <= p.w && std::fabs(p.y) <= p.w &&
+                std::fabs(p.z) <= p.w)
+                return true;
+        }
+        return false;
+    }
+} // namespace
+
+// frustum-vs-box culling against the corner test on random cameras and boxes
+void test_frustumCull()
+{
+    int culled = 0, kept = 0;
+    for (int view = 0; view < 50; view++)
+    {
+        const Vec3    eye{uniform(-20, 20), uniform(-20, 20), uniform(-20, 20)};
+        const Vec3    target{uniform(-5, 5), uniform(-5, 5), uniform(-5, 5)};
+        const Mat4    VP = lookAt(eye, target, {0, 1, 0}) *
+                        perspective(uniform(30, 90), uniform(0.5f, 2.0f), 0.5f, 60.0f);
+        const Frustum f = frustumFromMatrix(VP);
+
+        for (int k = 0; k < 400; k++)
+        {
+            const AABB b = randomBox(30.0f, 4.0f);
+            const bool in = intersects(f, b);
+            // never culls a visible box, culls exactly what the corner test culls
+            if (visiblePoint(VP, b))
+                CHECK(in);
+            CHECK(in == !outsideOnePlane(VP, b));
+
+            // the bounding sphere is looser than the box, never tighter
+            const Sphere s{b.center(), std::sqrt(dot(b.extent(), b.extent()))};
+            if (in)
+                CHECK(intersects(f, s));
+            (in ? kept : culled)++;
+        }
+    }
+    // both outcomes were exercised
+    CHECK(culled > 0 && kept > 0);
+}
+
+// transformed box holds every transformed corner
+void test_transformBox()
+{
+    for (int k = 0; k < 200; k++)
+    {
+        const AABB b = randomBox(10.0f, 3.0f);
+        const Mat4 M = Mat4::scale({uniform(0.1f, 3), uniform(0.1f, 3), uniform(0.1f, 3)}) *
+                       lookAt({0, 0, 0}, {uniform(-1, 1), uniform(-1, 1), 1}, {0, 1, 0}) *
+                       Mat4::translation({uniform(-5, 5), uniform(-5, 5), uniform(-5, 5)});
+        const AABB t = transform(b, M);
+        for (int i = 0; i < 8; i++)
+        {
+            const Vec4 p = M.mul_point(corner(b, i));
+            const float eps = 1e-4f * (1.0f + std::fabs(p.x) + std::fabs(p.y) + std::fabs(p.z));
+            CHECK(p.x >= t.min.x - eps && p.x <= t.max.x + eps);
+            CHECK(p.y >= t.min.y - eps && p.y <= t.max.y + eps);
+            CHECK(p.z >= t.min.z - eps && p.z <= t.max.z + eps);
+        }
+    }
+}
+
+// spot light cones: every point within the angle and range lies in both bounds
+void test_coneBounds()
+{
+    for (int k = 0; k < 500; k++)
+    {
+        const Vec3   p{uniform(-5, 5), uniform(-5, 5), uniform(-5, 5)};
+        const Vec3   d = normalize(Vec3{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1)});
+        const float  range = uniform(0.5f, 8.0f);
+        const float  cosAngle = std::cos(uniform(0.05f, 1.5f));
+        const AABB   b = coneBox(p, d, range, cosAngle);
+        const Sphere s = coneBounds(p, d, range, cosAngle);
+
+        for (int i = 0; i < 200; i++)
+        {
+            const Vec3 u = normalize(Vec3{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1)});
+            if (dot(u, d) < cosAngle)
+                continue;
+            const Vec3  q = p + u * (i % 2 ? range : uniform(0.0f, range));
+            const float eps = 1e-4f * range;
+            CHECK(q.x >= b.min.x - eps && q.x <= b.max.x + eps);
+            CHECK(q.y >= b.min.y - eps && q.y <= b.max.y + eps);
+            CHECK(q.z >= b.min.z - eps && q.z <= b.max.z + eps);
+            CHECK(length(q - s.center) <= s.radius + eps);
+        }
+        // never looser than the range sphere
+        CHECK(s.radius <= range * 1.0001f);
+    }
+}
+
+int main()
+{
+    test_frustumCull();
+    test_transformBox();
+    test_coneBounds();
+    return failures;
+}
@@ -0,0 +1,176 @@
+﻿#include "check.h"
+#include "math/projection.h"
+#include "scene/bvh.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+
+using namespace math;
+
+namespace
+{
+    std::mt19937 rng(10);
+
+    float uniform(float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); }
+
+    AABB randomBox()
+    {
+        const Vec3 c{uniform(-50, 50), uniform(-50, 50), uniform(-50, 50)};
+        const Vec3 e{uniform(0.1f, 3), uniform(0.1f, 3), uniform(0.1f, 3)};
+        return {c - e, c + e};
+    }
+
+    // same slab test as Bvh::raycast, -1 on a miss
+    float enter(const AABB &b, const Vec3 &o, const Vec3 &d)
+    {
+        float t0 = 0.0f, t1 = FLT_MAX;
+        const float lo[3] = {b.min.x, b.min.y, b.min.z}, hi[3] = {b.max.x, b.max.y, b.max.z};
+        const float org[3] = {o.x, o.y, o.z}, dir[3] = {d.x, d.y, d.z};
+        for (int i = 0; i < 3; i++)
+        {
+            const float inv = 1.0f / dir[i];
+            const float a = (lo[i] - org[i]) * inv, c = (hi[i] - org[i]) * inv;
+            t0 = std::max(t0, std::min(a, c));
+            t1 = std::min(t1, std::max(a, c));
+        }
+        return t0 <= t1 ? t0 : -1.0f;
+    }
+
+    // every query of the tree against a loop over all boxes
+    void compare(const scene::Bvh &bvh, const std::vector<AABB> &boxes)
+    {
+        for (int k = 0; k < 20; k++)
+        {
+            const Mat4 VP = lookAt({uniform(-60, 60), uniform(-60, 60), uniform(-60, 60)},
+                                   {uniform(-10, 10), uniform(-10, 10), uniform(-10, 10)},
+                                   {0, 1, 0}) *
+                            perspective(uniform(20, 90), 1.5f, 0.5f, uniform(20, 150));
+            const Frustum f = frustumFromMatrix(VP);
+
+            std::vector<uint32_t> got, want;
+            bvh.query(f, [&](uint32_t o) { got.push_back(o); });
+            for (uint32_t o = 0; o < boxes.size(); o++)
+                if (intersects(f, boxes[o]))
+                    want.push_back(o);
+            std::sort(got.begin(), got.end());
+            CHECK(got == want);
+
+            const Sphere s{{uniform(-50, 50), uniform(-50, 50), uniform(-50, 50)},
+                           uniform(1, 30)};
+            got.clear();
+            want.clear();
+            bvh.query(s, [&](uint32_t o) { got.push_back(o); });
+            for (uint32_t o = 0; o < boxes.size(); o++)
+                if (scene::intersects(s, boxes[o]))
+                    want.push_back(o);
+            std::sort(got.begin(), got.end());
+            CHECK(got == want);
+            CHECK(bvh.overlaps(s) == !want.empty());
+        }
+
+        int hits = 0;
+        for (int k = 0; k < 200; k++)
+        {
+            const Vec3 o{uniform(-60, 60), uniform(-60, 60), uniform(-60, 60)};
+            const Vec3 d = normalize(Vec3{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1)});
+            float      best = FLT_MAX;
+            for (const AABB &b : boxes)
+                if (const float t = enter(b, o, d); t >= 0.0f)
+                    best = std::min(best, t);
+
+            const auto hit = bvh.raycast(o, d);
+            CHECK(hit.has_value() == (best != FLT_MAX));
+            if (hit)
+            {
+                hits++;
+                CHECK(hit->t == best);
+                CHECK(enter(boxes[hit->object], o, d) == hit->t);
+            }
+        }
+        CHECK(hits > 0);
+    }
+
+    // every node box holds its subtree
+    void checkNodes(const scene::Bvh &bvh)
+    {
+        const auto &nodes = bvh.hierarchy();
+        auto        inside = [](const AABB &in, const AABB &out)
+        {
+            return in.min.x >= out.min.x && in.min.y >= out.min.y && in.min.z >= out.min.z &&
+                   in.max.x <= out.max.x && in.max.y <= out.max.y && in.max.z <= out.max.z;
+        };
+        for (const scene::Bvh::Node &n : nodes)
+            if (n.left != 0)
+            {
+                CHECK(inside(nodes[n.left].box, n.box));
+                CHECK(inside(nodes[n.left + 1].box, n.box));
+            }
+    }
+} // namespace
+
+void test_build()
+{
+    std::vector<AABB> boxes(3000);
+    for (AABB &b : boxes)
+        b = randomBox();
+
+    scene::Bvh bvh;
+    bvh.build(boxes);
+    CHECK(bvh.objectCount() == boxes.size());
+    checkNodes(bvh);
+    compare(bvh, boxes);
+
+    // the parallel build answers the same queries
+    scene::Bvh::Parallel parallel = [](const std::function<void(int)> &fn)
+    {
+        std::vector<std::thread> threads;
+        for (int w = 0; w < 4; w++)
+            threads.emplace_back(fn, w);
+        for (std::thread &t : threads)
+            t.join();
+    };
+    scene::Bvh par;
+    par.build(boxes, parallel, 4);
+    checkNodes(par);
+    compare(par, boxes);
+}
+
+void test_refit()
+{
+    std::vector<AABB> boxes(1000);
+    for (AABB &b : boxes)
+        b = randomBox();
+    scene::Bvh bvh;
+    bvh.build(boxes);
+
+    for (int frame = 0; frame < 5; frame++)
+    {
+        std::vector<uint32_t> moved;
+        for (uint32_t o = 0; o < boxes.size(); o += 1 + rng() % 7)
+        {
+            const Vec3 d{uniform(-10, 10), uniform(-10, 10), uniform(-10, 10)};
+            boxes[o] = {boxes[o].min + d, boxes[o].max + d};
+            moved.push_back(o);
+        }
+        bvh.refit(moved, boxes);
+        checkNodes(bvh);
+        compare(bvh, boxes);
+    }
+}
+
+void test_empty()
+{
+    scene::Bvh bvh;
+    bvh.build({});
+    CHECK(bvh.empty());
+    CHECK(!bvh.raycast({0, 0, 0}, {0, 0, 1}));
+    CHECK(!bvh.overlaps(Sphere{{0, 0, 0}, 1.0f}));
+}
+
+int main()
+{
+    test_build();
+    test_refit();
+    test_empty();
+    return failures;
+}
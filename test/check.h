@@ -0,0 +1,16 @@
+﻿#pragma once
+#include <iostream>
+
+// failed CHECKs are printed and counted, main returns the count
+inline int failures = 0;
+
+#define CHECK(cond)                                                                            \
+    do                                                                                         \
+    {                                                                                          \
+        if (!(cond))                                                                           \
+        {                                                                                      \
+            std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed"            \
+                      << std::endl;                                                            \
+            failures++;                                                                        \
+        }                                                                                      \
+    } while (0)
@@ -0,0 +1,62 @@
+﻿#include "check.h"
+#include "color.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+// every float in [0, 1]: the table encode is within half an 8 bit step of linearToSrgb,
+// and the array version (AVX2) gives the same bytes as the scalar one
+void test_linearToSrgb8()
+{
+    constexpr uint32_t kOne = 0x3f800000, kChunk = 1 << 16;
+    std::vector<float>   in(kChunk);
+    std::vector<uint8_t> out(kChunk);
+    int                  far = 0, differ = 0;
+    for (uint32_t first = 0; first <= kOne; first += kChunk)
+    {
+        const uint32_t n = std::min(kChunk, kOne + 1 - first);
+        for (uint32_t i = 0; i < n; i++)
+            in[i] = std::bit_cast<float>(first + i);
+        color::linearToSrgb8(in.data(), out.data(), n);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const uint8_t code = color::linearToSrgb8(in[i]);
+            if (std::fabs(code / 255.0f - color::linearToSrgb(in[i])) > 0.5f / 255.0f + 1e-6f)
+                far++;
+            if (out[i] != code)
+                differ++;
+        }
+    }
+    CHECK(far == 0);
+    CHECK(differ == 0);
+
+    // out of range and NaN clamp like linearToSrgb
+    const float odd[] = {-1.0f, -0.0f, 1.5f, 1e30f, std::nanf("")};
+    uint8_t     codes[5];
+    color::linearToSrgb8(odd, codes, 5);
+    CHECK(codes[0] == 0 && codes[1] == 0 && codes[2] == 255 && codes[3] == 255 && codes[4] == 0);
+}
+
+// the 256 entry decode table against the formula, scalar and array lookups agreeing
+void test_srgb8ToLinear()
+{
+    uint8_t s[256];
+    float   l[256];
+    for (int i = 0; i < 256; i++)
+        s[i] = uint8_t(i);
+    color::srgb8ToLinear(s, l, 256);
+    for (int i = 0; i < 256; i++)
+    {
+        CHECK(l[i] == color::srgb8ToLinear(uint8_t(i)));
+        CHECK(std::fabs(l[i] - color::srgbToLinear(i / 255.0f)) <= 1e-6f);
+        CHECK(color::linearToSrgb8(l[i]) == i); // decode then encode is exact
+    }
+}
+
+int main()
+{
+    test_linearToSrgb8();
+    test_srgb8ToLinear();
+    return failures;
+}
@@ -0,0 +1,110 @@
+﻿#include "check.h"
+#include "core.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+using core::DepthFormat;
+
+namespace
+{
+    // Walks the buffer depth from the near to the far plane, so the raster depth (negated
+    // under reversed-Z) grows: keys never decrease, survive store / load, and decode to the
+    // depth up to half a step of the format. Neighbouring depths further apart than a step
+    // get different keys.
+    template <DepthFormat F> void checkCodec(float step)
+    {
+        using Codec = core::DepthCodec<F>;
+        constexpr bool reversed = F == DepthFormat::D32FReversed;
+        constexpr int  kSteps = 1 << 17;
+
+        int      decreasing = 0, merged = 0, lost = 0, off = 0;
+        uint32_t prev = 0;
+        float    prevDepth = 0.0f;
+        for (int i = 0; i <= kSteps; i++)
+        {
+            const float    t = float(i) / kSteps;
+            const float    d = reversed ? 1.0f - t : t;
+            const uint32_t k = Codec::key(reversed ? -d : d);
+            if (i > 0)
+            {
+                decreasing += k < prev;
+                merged += std::fabs(d - prevDepth) > 2.0f * step && k == prev;
+            }
+            prev = k;
+            prevDepth = d;
+
+            // a set byte after the pixel: D24 loads read it and must mask it off
+            uint8_t bytes[8];
+            std::fill(std::begin(bytes), std::end(bytes), uint8_t(0xff));
+            Codec::store(bytes, k);
+            lost += Codec::load(bytes) != k;
+            off += std::fabs(Codec::depth(k) - d) > 0.5f * step + 1e-7f;
+        }
+        CHECK(decreasing == 0);
+        CHECK(merged == 0);
+        CHECK(lost == 0);
+        CHECK(off == 0);
+
+        // the near plane keys below the far plane; raster depths below 0 clamp to it
+        const float near = reversed ? -1.0f : 0.0f, far = reversed ? 0.0f : 1.0f;
+        CHECK(Codec::key(near) < Codec::key(far));
+        CHECK(Codec::key(far - 1e-3f) < Codec::key(far));
+        if constexpr (!reversed)
+            CHECK(Codec::key(-0.5f) == Codec::key(0.0f));
+    }
+} // namespace
+
+void test_codecs()
+{
+    checkCodec<DepthFormat::D32F>(0.0f);
+    checkCodec<DepthFormat::D32FReversed>(0.0f);
+    checkCodec<DepthFormat::D24>(1.0f / ((1 << 24) - 1));
+    checkCodec<DepthFormat::D16>(1.0f / ((1 << 16) - 1));
+}
+
+// every float in [0, 1] keys in order of its value under D32F, and reversed-Z keeps the
+// opposite order of the stored float
+void test_floatKeys()
+{
+    using Plain = core::DepthCodec<DepthFormat::D32F>;
+    using Reversed = core::DepthCodec<DepthFormat::D32FReversed>;
+    int      wrong = 0;
+    uint32_t prev = Plain::key(0.0f), prevReversed = Reversed::key(-0.0f);
+    for (uint32_t bits = 1; bits <= std::bit_cast<uint32_t>(1.0f); bits++)
+    {
+        const float    d = std::bit_cast<float>(bits);
+        const uint32_t k = Plain::key(d), r = Reversed::key(-d);
+        wrong += k <= prev || r >= prevReversed;
+        prev = k;
+        prevReversed = r;
+    }
+    CHECK(wrong == 0);
+}
+
+// a cleared buffer reads back the clear depth in each format, compressed or not
+void test_clear()
+{
+    for (DepthFormat f :
+         {DepthFormat::D32F, DepthFormat::D32FReversed, DepthFormat::D24, DepthFormat::D16})
+    {
+        for (bool compress : {false, true})
+        {
+            core::DepthBuffer db(21, 13, f, compress);
+            db.clear(db.farDepth());
+            db.clearRect(8, 0, 16, 8, 0.5f);
+            db.decompress();
+            CHECK(db.at(0, 0) == db.farDepth() && db.at(20, 12) == db.farDepth());
+            CHECK(std::fabs(db.at(8, 0) - 0.5f) < 1e-4f);
+            CHECK(db.at(15, 7) == db.at(8, 0) && db.at(16, 7) == db.farDepth());
+        }
+    }
+}
+
+int main()
+{
+    test_codecs();
+    test_floatKeys();
+    test_clear();
+    return failures;
+}
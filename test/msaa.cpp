@@ -0,0 +1,94 @@
+﻿#include "check.h"
+#include "math/half.h"
+#include "renderer/msaa.h"
+#include <cmath>
+#include <cstring>
+
+using renderer::SampleStore;
+
+// a half covered pixel resolves to the average of the triangle's color and what was
+// there before; a second triangle over the other half replaces the background
+void test_resolveRGBA8()
+{
+    for (int samples : {2, 4, 8})
+    {
+        SampleStore store;
+        store.reset(samples, SampleStore::Format::RGBA8, 4, 1);
+        const uint32_t half = (1u << (samples / 2)) - 1; // the first half of the samples
+        const uint8_t  back[4] = {10, 20, 31, 255}, a[4] = {200, 101, 50, 255};
+        const uint8_t  b[4] = {0, 255, 7, 0};
+        uint8_t        target[4][4];
+        for (auto &p : target)
+            std::memcpy(p, back, 4);
+
+        // pixel 0: half a over back; 1: a and b halves; 2: covered whole by b afterwards;
+        // 3: never a record
+        store.write(0, &target[0][0], 0, half, a);
+        store.write(0, &target[0][0], 1, half, a);
+        store.write(0, &target[0][0], 1, store.fullMask() & ~half, b);
+        store.write(0, &target[0][0], 2, half, a);
+        store.write(0, &target[0][0], 2, store.fullMask(), b);
+        store.write(0, &target[0][0], 3, store.fullMask(), a);
+        store.resolve(0, &target[0][0]);
+
+        for (int ch = 0; ch < 4; ch++)
+        {
+            CHECK(target[0][ch] == (back[ch] + a[ch] + 1) / 2);
+            CHECK(target[1][ch] == (a[ch] + b[ch] + 1) / 2);
+            CHECK(target[2][ch] == b[ch]);
+            CHECK(target[3][ch] == a[ch]);
+        }
+
+        // the records are gone: resolving again changes nothing, a new partial write
+        // starts from the resolved color
+        uint8_t before[4][4];
+        std::memcpy(before, target, sizeof(target));
+        store.resolve(0, &target[0][0]);
+        CHECK(std::memcmp(before, target, sizeof(target)) == 0);
+        store.write(0, &target[0][0], 3, half, b);
+        store.resolve(0, &target[0][0]);
+        for (int ch = 0; ch < 4; ch++)
+            CHECK(target[3][ch] == (a[ch] + b[ch] + 1) / 2);
+    }
+}
+
+// the float targets average exactly (RGBA32F) or to half precision (RGBA16F)
+void test_resolveFloat()
+{
+    const float back[4] = {0.25f, 4.0f, 0.0f, 1.0f}, a[4] = {1.0f, 2.0f, 3.0f, 0.5f};
+    {
+        SampleStore store;
+        store.reset(4, SampleStore::Format::RGBA32F, 1, 2);
+        float target[4];
+        std::memcpy(target, back, sizeof(target));
+        store.write(1, reinterpret_cast<uint8_t *>(target), 0, 0b0101,
+                    reinterpret_cast<const uint8_t *>(a));
+        store.resolve(1, reinterpret_cast<uint8_t *>(target));
+        for (int ch = 0; ch < 4; ch++)
+            CHECK(target[ch] == 0.5f * (back[ch] + a[ch]));
+    }
+    {
+        SampleStore store;
+        store.reset(4, SampleStore::Format::RGBA16F, 1, 1);
+        uint16_t target[4], ha[4];
+        math::floatToHalf4(back, target);
+        math::floatToHalf4(a, ha);
+        store.write(0, reinterpret_cast<uint8_t *>(target), 0, 0b1001,
+                    reinterpret_cast<const uint8_t *>(ha));
+        store.resolve(0, reinterpret_cast<uint8_t *>(target));
+        float c[4];
+        math::halfToFloat4(target, c);
+        for (int ch = 0; ch < 4; ch++)
+        {
+            const float e = 0.5f * (back[ch] + a[ch]);
+            CHECK(std::fabs(c[ch] - e) <= e * 0x1p-11f);
+        }
+    }
+}
+
+int main()
+{
+    test_resolveRGBA8();
+    test_resolveFloat();
+    return failures;
+}
@@ -0,0 +1,142 @@
+﻿#include "check.h"
+#include "renderer/occlusion.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using math::Vec3;
+using renderer::OcclusionBuffer;
+
+namespace
+{
+    constexpr int kScale = 4; // full-resolution pixels per buffer pixel
+
+    // full-resolution depth buffer of the same occluders, pixel-center coverage
+    struct Reference
+    {
+        int                w, h;
+        std::vector<float> depth;
+
+        Reference(int bw, int bh) : w(bw * kScale), h(bh * kScale), depth(size_t(w) * h, 1.0f) {}
+
+        void draw(const Vec3 &p0, const Vec3 &p1, const Vec3 &p2)
+        {
+            const float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+            if (area == 0.0f)
+                return;
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                {
+                    const float px = (x + 0.5f) / kScale, py = (y + 0.5f) / kScale;
+                    const float w0 =
+                        ((p1.x - px) * (p2.y - py) - (p1.y - py) * (p2.x - px)) / area;
+                    const float w1 =
+                        ((p2.x - px) * (p0.y - py) - (p2.y - py) * (p0.x - px)) / area;
+                    const float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+                    float &d = depth[size_t(y) * w + x];
+                    d = std::min(d, w0 * p0.z + w1 * p1.z + w2 * p2.z);
+                }
+        }
+
+        // some full-resolution pixel of the buffer rect is farther than zMin
+        bool visible(int x0, int y0, int x1, int y1, float zMin) const
+        {
+            for (int y = y0 * kScale; y < (y1 + 1) * kScale; y++)
+                for (int x = x0 * kScale; x < (x1 + 1) * kScale; x++)
+                    if (depth[size_t(y) * w + x] > zMin + 1e-5f)
+                        return true;
+            return false;
+        }
+    };
+} // namespace
+
+// an edge partway across a buffer pixel leaves part of it open: an object right behind
+// that column stays visible, the fully covered column next to it is hidden
+void test_silhouette()
+{
+    OcclusionBuffer buffer;
+    buffer.resize(64, 16);
+    // quad [0, 10.75] x [0, 16] at depth 0.2
+    buffer.renderTriangle({0, 0, 0.2f}, {10.75f, 0, 0.2f}, {10.75f, 16, 0.2f});
+    buffer.renderTriangle({0, 0, 0.2f}, {10.75f, 16, 0.2f}, {0, 16, 0.2f});
+    CHECK(buffer.occluded(9, 4, 9, 5, 0.5f));
+    CHECK(!buffer.occluded(10, 4, 10, 5, 0.5f));
+    CHECK(!buffer.occluded(9, 4, 9, 5, 0.1f));
+
+    // diagonal edge x + y = 20.25
+    buffer.clear();
+    buffer.renderTriangle({0, 0, 0.2f}, {20.25f, 0, 0.2f}, {0, 20.25f, 0.2f});
+    CHECK(buffer.occluded(4, 4, 4, 4, 0.5f));
+    for (int y = 0; y < 16; y++)
+        CHECK(!buffer.occluded(20 - y - 1, y, 20 - y - 1, y, 0.5f));
+}
+
+// random occluders: every rect the buffer hides is hidden in the full-resolution depth
+// buffer too; small rects along the triangle edges catch partly covered pixels
+void test_fullResolution()
+{
+    std::mt19937                          rng(7);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    const int                             w = 45, h = 29; // partial tiles on both axes
+    int                                   hidden = 0;
+    for (int scene = 0; scene < 40; scene++)
+    {
+        OcclusionBuffer buffer;
+        buffer.resize(w, h);
+        Reference ref(w, h);
+        std::vector<Vec3> points;
+        const int         count = 1 + int(rng() % 12);
+        for (int t = 0; t < count; t++)
+        {
+            const Vec3  c{u(rng) * w, u(rng) * h, 0.2f + u(rng) * 0.6f};
+            const float size = 4.0f + u(rng) * 40.0f;
+            Vec3        p[3];
+            for (Vec3 &q : p)
+            {
+                q = {c.x + (u(rng) - 0.5f) * size, c.y + (u(rng) - 0.5f) * size,
+                     c.z + (u(rng) - 0.5f) * 0.2f};
+                points.push_back(q);
+            }
+            buffer.renderTriangle(p[0], p[1], p[2]);
+            ref.draw(p[0], p[1], p[2]);
+        }
+
+        for (int k = 0; k < 400; k++)
+        {
+            int x0, y0, x1, y1;
+            if (k % 2)
+            {
+                // a buffer pixel on an edge of one of the triangles
+                const size_t i = rng() % points.size(), j = i - i % 3 + (i + 1) % 3;
+                const float  s = u(rng);
+                x0 = x1 = int(points[i].x + (points[j].x - points[i].x) * s);
+                y0 = y1 = int(points[i].y + (points[j].y - points[i].y) * s);
+                if (x0 < 0 || x0 >= w || y0 < 0 || y0 >= h)
+                    continue;
+            }
+            else
+            {
+                x0 = int(rng() % w);
+                y0 = int(rng() % h);
+                x1 = std::min(w - 1, x0 + int(rng() % 8));
+                y1 = std::min(h - 1, y0 + int(rng() % 8));
+            }
+            const float z = u(rng);
+            if (buffer.occluded(x0, y0, x1, y1, z))
+            {
+                hidden++;
+                CHECK(!ref.visible(x0, y0, x1, y1, z));
+            }
+        }
+    }
+    CHECK(hidden > 0);
+}
+
+int main()
+{
+    test_silhouette();
+    test_fullResolution();
+    return failures;
+}
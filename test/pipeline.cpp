@@ -0,0 +1,148 @@
+﻿#include "check.h"
+#include "renderer/pipeline.h"
+#include "renderer/raster.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace renderer;
+
+namespace
+{
+    constexpr int kSize = 30; // 900 pixels: a partial batch is left at the end of a layer
+
+    // DefaultFS without batch(): every fragment shaded and written at once
+    struct ImmediateFS
+    {
+        shader::FSOut operator()(const shader::FSIn &in, const shader::FSUniform &u) const
+        {
+            return shader::DefaultFS{}(in, u);
+        }
+    };
+
+    // up to the rounding of the interpolated vertex color
+    bool near(const math::Vec4 &c, const math::Vec3 &e)
+    {
+        return std::fabs(c.x - e.x) < 1e-4f && std::fabs(c.y - e.y) < 1e-4f &&
+               std::fabs(c.z - e.z) < 1e-4f;
+    }
+
+    struct Layer
+    {
+        float                z;
+        math::Vec3           color;
+        const core::Texture *tex;
+    };
+
+    // the layers in draw order, each a screen-filling quad at depth z, through a
+    // FragmentQueue like rasterPass: color per sample, or per pixel with samples == 1
+    template <class FSType>
+    std::vector<math::Vec4> draw(const FSType &fs, const std::vector<Layer> &layers, int samples)
+    {
+        static const core::Sampler sampler;
+        shader::FSUniform          u;
+        u.hdr = true; // albedo out as it is
+        scene::Light ambient;
+        ambient.type = scene::LightType::Ambient;
+        u.lights.push_back(ambient);
+
+        std::vector<core::DepthBuffer>   depth(samples, core::DepthBuffer(kSize, kSize));
+        std::vector<core::DepthBuffer *> depthPtrs;
+        for (core::DepthBuffer &d : depth)
+        {
+            d.clear(1.0f);
+            depthPtrs.push_back(&d);
+        }
+        const SamplePattern    &pattern = samplePattern(samples);
+        std::vector<math::Vec4> out(size_t(kSize) * kSize * samples);
+        auto write = [&](const shader::FSIn &in, uint32_t mask, const math::Vec4 &c)
+        {
+            for (int s = 0; s < samples; s++)
+                if (mask >> s & 1)
+                    out[(in.y * kSize + in.x) * samples + s] = c;
+        };
+        FragmentQueue queue(fs, u, write);
+
+        const math::Viewport vp{0, 0, kSize, kSize};
+        const TileRect       rect{0, 0, kSize, kSize};
+        for (const Layer &l : layers)
+        {
+            shader::VSOut v[4] = {};
+            for (int i = 0; i < 4; i++)
+            {
+                v[i].clip_pos = {i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, l.z, 1.0f};
+                v[i].world_nrm = {0, 0, 1};
+                v[i].color = l.color;
+                v[i].uv = {float(i & 1), float(i >> 1)};
+            }
+            static const int kTris[2][3] = {{0, 1, 2}, {2, 1, 3}};
+            RasterTriangle   tris[kMaxClippedTriangles];
+            for (const int *t : kTris)
+            {
+                const int n = setupTriangle(v[t[0]], v[t[1]], v[t[2]], vp, tris);
+                for (int k = 0; k < n; k++)
+                {
+                    auto shade = [&](int x, int y, uint32_t mask)
+                    {
+                        shader::FSIn in = interpolate(tris[k], x, y);
+                        in.baseColorTex = l.tex;
+                        in.sampler = &sampler;
+                        queue.push(in, mask);
+                    };
+                    if (samples > 1)
+                        rasterizeTriangleMS(tris[k], rect, depthPtrs.data(), pattern, shade);
+                    else
+                        rasterizeTriangle(tris[k], rect, depth[0],
+                                          [&](int x, int y) { shade(x, y, 1); });
+                }
+            }
+        }
+        queue.flush();
+        return out;
+    }
+} // namespace
+
+// textured and untextured layers over the same pixels: whichever is nearest shows,
+// whatever the draw order, and batching gives what shading one by one gives
+void test_drawOrder()
+{
+    core::Texture   tex;
+    math::Vec4      red[16];
+    std::fill(std::begin(red), std::end(red), math::Vec4{1, 0, 0, 1});
+    tex.assign(4, 4, red);
+
+    const math::Vec3 white{1, 1, 1}, green{0, 1, 0}, blue{0, 0, 1};
+    const Layer      textured{0.5f, white, &tex}, plain{0.2f, green, nullptr};
+    const Layer      behind{0.8f, blue, nullptr};
+    for (int samples : {1, 4})
+    {
+        // untextured in front of textured, drawn after it
+        for (const math::Vec4 &c :
+             draw(shader::DefaultFS{}, {behind, textured, plain}, samples))
+            CHECK(near(c, {0, 1, 0}));
+
+        // textured in front, drawn after the untextured one
+        const Layer front{0.1f, white, &tex};
+        for (const math::Vec4 &c : draw(shader::DefaultFS{}, {plain, front}, samples))
+            CHECK(near(c, {1, 0, 0}));
+
+        // every order of the three against per-fragment shading
+        std::vector<Layer> layers{behind, textured, plain};
+        std::sort(layers.begin(), layers.end(),
+                  [](const Layer &a, const Layer &b) { return a.z < b.z; });
+        do
+        {
+            const std::vector<math::Vec4> batched = draw(shader::DefaultFS{}, layers, samples);
+            const std::vector<math::Vec4> single = draw(ImmediateFS{}, layers, samples);
+            CHECK(std::memcmp(batched.data(), single.data(),
+                              batched.size() * sizeof(math::Vec4)) == 0);
+        } while (std::next_permutation(layers.begin(), layers.end(),
+                                       [](const Layer &a, const Layer &b) { return a.z < b.z; }));
+    }
+}
+
+int main()
+{
+    test_drawOrder();
+    return failures;
+}
@@ -0,0 +1,155 @@
+﻿#include "check.h"
+#include "renderer/raster.h"
+#include "renderer/shadow.h"
+#include <random>
+
+using namespace renderer;
+
+namespace
+{
+    std::mt19937 rng(14);
+
+    float uniform(float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); }
+
+    // square of half size h centered at c, spanned by the unit axes u and v
+    struct Quad
+    {
+        math::Vec3 c, u, v;
+        float      h;
+    };
+
+    // depth of the quads as the renderer's shadow pass draws them
+    void render(ShadowView &view, const std::vector<Quad> &quads)
+    {
+        const int            size = view.depth.width;
+        const math::Viewport vp{0, 0, size, size};
+        view.depth.clear(1.0f);
+        for (const Quad &q : quads)
+        {
+            shader::VSOut v[4] = {};
+            for (int i = 0; i < 4; i++)
+            {
+                const math::Vec3 p = q.c + q.u * (i & 1 ? q.h : -q.h) + q.v * (i & 2 ? q.h : -q.h);
+                v[i].clip_pos = view.VP.mul_point(p);
+            }
+            static const int kTris[2][3] = {{0, 1, 2}, {2, 1, 3}};
+            RasterTriangle   tris[kMaxClippedTriangles];
+            for (const int *t : kTris)
+            {
+                const int n = setupTriangle(v[t[0]], v[t[1]], v[t[2]], vp, tris);
+                for (int k = 0; k < n; k++)
+                    rasterizeDepth(tris[k], {0, 0, size, size}, view.depth);
+            }
+        }
+    }
+} // namespace
+
+// a blocker in front of a point light on each axis: points behind it are shadowed,
+// points beside it or between it and the light are lit
+void test_pointShadow()
+{
+    scene::Light light;
+    light.type = scene::LightType::Point;
+    light.point.pos = {1, 2, 3};
+    light.point.range = 20.0f;
+
+    const math::Vec3  axes[6] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                                 {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+    std::vector<Quad> quads;
+    for (const math::Vec3 &a : axes)
+    {
+        const math::Vec3 u = std::fabs(a.x) > 0.5f ? math::Vec3{0, 1, 0} : math::Vec3{1, 0, 0};
+        quads.push_back({light.point.pos + a * 2.0f, u, math::cross(a, u), 1.0f});
+    }
+
+    ShadowMaps maps;
+    maps.views.resize(6);
+    cubeViews(light.point.pos, light.point.range, 256, maps.views.data());
+    for (ShadowView &v : maps.views)
+        render(v, quads);
+    maps.lights.push_back({0, 6});
+
+    int shadowed = 0, lit = 0;
+    for (const math::Vec3 &a : axes)
+    {
+        const math::Vec3 u = quads[&a - axes].u, w = math::cross(a, u);
+        for (int k = 0; k < 200; k++)
+        {
+            // receiver facing the light at distance 5 along the axis
+            const float      s = uniform(-4.0f, 4.0f), t = uniform(-4.0f, 4.0f);
+            const math::Vec3 p = light.point.pos + a * 5.0f + u * s + w * t;
+            // the blocker hides |s|, |t| < 2.5 at that distance; skip its edge
+            const float edge = std::max(std::fabs(s), std::fabs(t));
+            if (std::fabs(edge - 2.5f) < 0.1f)
+                continue;
+            const float vis = maps.visibility(light, 0, p, -a);
+            CHECK(vis == (edge < 2.5f ? 0.0f : 1.0f));
+            (vis == 0.0f ? shadowed : lit)++;
+
+            // in front of the blocker
+            const math::Vec3 q = light.point.pos + a * 1.5f + (u * s + w * t) * 0.2f;
+            CHECK(maps.visibility(light, 0, q, -a) == 1.0f);
+        }
+    }
+    CHECK(shadowed > 0 && lit > 0);
+}
+
+// a directional light straight down on a floor with a blocker above it, seen by a camera
+// whose shadow distance spans several cascades
+void test_cascadeShadow()
+{
+    scene::Light light;
+    light.type = scene::LightType::Directional;
+    light.directional.dir = {0, -1, 0};
+
+    scene::Camera cam({0, 6, 12}, {-25, 0, 0}, 60.0f, 0.1f, 100.0f);
+    const math::Mat4 camWorld = math::rotateX(math::radians(cam.rot.x)) *
+                                math::Mat4::translation(cam.pos);
+    const math::Vec4 f = camWorld.mul_vector({0, 0, -1});
+
+    const std::vector<Quad> quads = {{{0, 2, 0}, {1, 0, 0}, {0, 0, 1}, 1.5f},
+                                     {{0, 0, 0}, {1, 0, 0}, {0, 0, 1}, 30.0f}};
+    const math::AABB        scene{{-30, 0, -30}, {30, 2, 30}};
+
+    ShadowMaps maps;
+    maps.eye = cam.pos;
+    maps.forward = math::normalize(math::Vec3{f.x, f.y, f.z});
+    maps.views.resize(3);
+    cascadeViews(cam, camWorld, 16.0f / 9.0f, 40.0f, light.directional.dir, scene, 512,
+                 maps.views.data(), 3);
+    for (ShadowView &v : maps.views)
+        render(v, quads);
+    maps.lights.push_back({0, 3});
+
+    // cascades are ordered and cover the shadow distance
+    for (int i = 1; i < 3; i++)
+        CHECK(maps.views[i].sliceNear == maps.views[i - 1].sliceFar);
+    CHECK(maps.views[2].sliceFar >= 40.0f - 1e-3f);
+
+    int shadowed = 0;
+    for (int k = 0; k < 2000; k++)
+    {
+        const math::Vec3 p{uniform(-8, 8), 0.0f, uniform(-12, 4)};
+        const float      edge = std::max(std::fabs(p.x), std::fabs(p.z));
+        if (std::fabs(edge - 1.5f) < 0.1f)
+            continue;
+        const float vis = maps.visibility(light, 0, p, {0, 1, 0});
+        CHECK(vis == (edge < 1.5f ? 0.0f : 1.0f));
+        shadowed += vis == 0.0f;
+
+        // the top of the blocker is lit
+        if (edge < 1.4f)
+            CHECK(maps.visibility(light, 0, {p.x, 2.0f, p.z}, {0, 1, 0}) == 1.0f);
+    }
+    CHECK(shadowed > 0);
+
+    // past the last cascade everything is lit
+    CHECK(maps.visibility(light, 0, cam.pos + maps.forward * 60.0f, {0, 1, 0}) == 1.0f);
+}
+
+int main()
+{
+    test_pointShadow();
+    test_cascadeShadow();
+    return failures;
+}
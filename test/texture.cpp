@@ -0,0 +1,277 @@
+﻿#include "bcn.h"
+#include "check.h"
+#include "color.h"
+#include "core.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using Format = core::Texture::Format;
+
+namespace
+{
+    std::mt19937 rng(16);
+
+    float uniform(float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); }
+
+    // largest error of one channel after a round trip through f
+    float tolerance(Format f, float v, bool rgb)
+    {
+        switch (f)
+        {
+        case Format::RGBA32F:
+            return 0.0f;
+        case Format::RGBA16F:
+            return std::fabs(v) * 0x1p-11f + 0x1p-24f;
+        case Format::RGBA8Srgb:
+            if (rgb) // half a step in sRGB, measured in linear at v
+                return std::max(color::srgbToLinear(color::linearToSrgb(v) + 0.5f / 255.0f) - v,
+                                v - color::srgbToLinear(color::linearToSrgb(v) - 0.5f / 255.0f)) +
+                       1e-6f;
+            return 0.5f / 255.0f + 1e-6f;
+        default:
+            return 0.5f / 255.0f + 1e-6f;
+        }
+    }
+} // namespace
+
+// every uncompressed format keeps what store() wrote up to its precision, and a decoded
+// texel stored again comes back unchanged
+void test_storeTexel()
+{
+    for (Format f : {Format::RGBA32F, Format::RGBA16F, Format::RGBA8, Format::RGBA8Srgb,
+                     Format::RG8, Format::R8})
+    {
+        const bool    wide = f == Format::RGBA32F || f == Format::RGBA16F;
+        core::Texture tex;
+        tex.create(13, 7, f);
+
+        std::vector<math::Vec4> in(13 * 7);
+        for (math::Vec4 &c : in)
+        {
+            c = wide ? math::Vec4{uniform(-4, 100), uniform(0, 1), uniform(0, 0.01f), uniform(0, 1)}
+                     : math::Vec4{uniform(0, 1), uniform(0, 1), uniform(0, 1), uniform(0, 1)};
+        }
+        for (int y = 0; y < 7; y++)
+            for (int x = 0; x < 13; x++)
+                tex.store(0, x, y, in[y * 13 + x]);
+
+        for (int y = 0; y < 7; y++)
+        {
+            for (int x = 0; x < 13; x++)
+            {
+                const math::Vec4 &c = in[y * 13 + x];
+                const math::Vec4  t = tex.texel(0, x, y);
+                // what the format keeps of c
+                math::Vec4 want = c;
+                if (f == Format::RG8)
+                    want = {c.x, c.y, 0.0f, 1.0f};
+                else if (f == Format::R8)
+                    want = {c.x, c.x, c.x, 1.0f};
+                CHECK(std::fabs(t.x - want.x) <= tolerance(f, want.x, true));
+                CHECK(std::fabs(t.y - want.y) <= tolerance(f, want.y, true));
+                CHECK(std::fabs(t.z - want.z) <= tolerance(f, want.z, true));
+                CHECK(std::fabs(t.w - want.w) <= tolerance(f, want.w, false));
+
+                tex.store(0, x, y, t);
+                const math::Vec4 again = tex.texel(0, x, y);
+                CHECK(again.x == t.x && again.y == t.y && again.z == t.z && again.w == t.w);
+            }
+        }
+    }
+
+    // 8 bit formats clamp to [0, 1]
+    core::Texture tex;
+    tex.create(1, 1, Format::RGBA8);
+    tex.store(0, 0, 0, {-1.0f, 2.0f, 0.5f, 7.0f});
+    const math::Vec4 t = tex.texel(0, 0, 0);
+    CHECK(t.x == 0.0f && t.y == 1.0f && t.w == 1.0f);
+    CHECK(std::fabs(t.z - 0.5f) <= tolerance(Format::RGBA8, 0.5f, true));
+}
+
+// encode / decode of random blocks: solid colors and gradients with a little noise, which
+// every format should hold to within a few 8 bit steps (rms over the block)
+void test_bcnRoundTrip()
+{
+    struct Codec
+    {
+        void (*encode)(const uint8_t[16][4], uint8_t *);
+        void (*decode)(const uint8_t *, uint8_t[16][4]);
+        int   channels;                    // compared channels, alpha last
+        float solidRms, meanRms, worstRms; // bounds
+    };
+    const Codec codecs[] = {{bcn::encodeBC1, bcn::decodeBC1, 3, 4.0f, 5.0f, 12.0f},
+                            {bcn::encodeBC3, bcn::decodeBC3, 4, 4.0f, 4.5f, 10.0f},
+                            {bcn::encodeBC5, bcn::decodeBC5, 2, 0.0f, 1.5f, 3.0f},
+                            {bcn::encodeBC7, bcn::decodeBC7, 4, 1.0f, 4.0f, 10.0f}};
+
+    for (const Codec &codec : codecs)
+    {
+        float sum = 0.0f, worst = 0.0f, worstSolid = 0.0f;
+        for (int k = 0; k < 2000; k++)
+        {
+            const bool solid = k % 4 == 0;
+            int        base[4], dx[4], dy[4];
+            for (int c = 0; c < 4; c++)
+            {
+                base[c] = int(rng() % 256);
+                dx[c] = int(rng() % 21) - 10;
+                dy[c] = int(rng() % 21) - 10;
+            }
+            uint8_t in[16][4], out[16][4], block[16];
+            for (int i = 0; i < 16; i++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    const int v = solid ? base[c]
+                                        : base[c] + dx[c] * (i & 3) + dy[c] * (i >> 2) +
+                                              int(rng() % 5) - 2;
+                    in[i][c] = uint8_t(std::clamp(v, 0, 255));
+                }
+                if (codec.channels == 3)
+                    in[i][3] = 255; // BC1: opaque
+            }
+            codec.encode(in, block);
+            codec.decode(block, out);
+
+            float se = 0.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                for (int c = 0; c < codec.channels; c++)
+                {
+                    const float d = float(out[i][c]) - float(in[i][c]);
+                    se += d * d;
+                }
+            }
+            const float rms = std::sqrt(se / (16 * codec.channels));
+            sum += rms;
+            worst = std::max(worst, rms);
+            if (solid)
+                worstSolid = std::max(worstSolid, rms);
+        }
+        CHECK(worstSolid <= codec.solidRms);
+        CHECK(sum / 2000 <= codec.meanRms);
+        CHECK(worst <= codec.worstRms);
+    }
+}
+
+// compress() of a mipped texture: 8x (BC1) or 4x (the 16 byte formats) less memory than
+// RGBA8 over the whole chain, and a smooth image decodes close to what was compressed
+void test_compress()
+{
+    const int               w = 64, h = 40;
+    std::vector<math::Vec4> texels(w * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            texels[y * w + x] = {x / float(w), y / float(h), 0.5f, 1.0f - y / float(h)};
+
+    core::Texture src;
+    src.assign(w, h, texels.data(), Format::RGBA8);
+    src.generateMips();
+
+    for (Format f : {Format::BC1, Format::BC1Srgb, Format::BC3, Format::BC3Srgb, Format::BC5,
+                     Format::BC7, Format::BC7Srgb})
+    {
+        core::Texture tex = src;
+        tex.compress(f);
+        CHECK(tex.format == f);
+        CHECK(tex.levels.size() == src.levels.size());
+        const size_t ratio = f == Format::BC1 || f == Format::BC1Srgb ? 8 : 4;
+        CHECK(tex.data.size() * ratio == src.data.size());
+
+        // level 0: a few steps of the gradient per block (the mips pack all of it into one)
+        const bool bc1 = f == Format::BC1 || f == Format::BC1Srgb;
+        float      se = 0.0f;
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                const math::Vec4 a = src.texel(0, x, y), b = tex.texel(0, x, y);
+                if (f == Format::BC5)
+                {
+                    se += (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+                    CHECK(b.z == 0.0f && b.w == 1.0f);
+                    continue;
+                }
+                se += (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) +
+                      (a.z - b.z) * (a.z - b.z);
+                if (!bc1)
+                    se += (a.w - b.w) * (a.w - b.w);
+            }
+        }
+        CHECK(std::sqrt(se / (w * h)) <= 0.04f);
+    }
+}
+
+// every lane of sample8 / sample16 matches sampleLod at its own uv and lod, for each wrap
+// mode, filter and mip mode; the gathered formats as well as the lane by lane ones (BC7)
+void test_sample8()
+{
+    using Sampler = core::Sampler;
+    const int               w = 37, h = 23; // partial tiles, odd mips
+    std::vector<math::Vec4> texels(w * h);
+    for (math::Vec4 &c : texels)
+        c = {uniform(0, 1), uniform(0, 1), uniform(0, 1), uniform(0, 1)};
+
+    for (Format f : {Format::RGBA32F, Format::RGBA16F, Format::RGBA8, Format::RGBA8Srgb,
+                     Format::RG8, Format::R8, Format::BC7})
+    {
+        core::Texture tex;
+        tex.assign(w, h, texels.data(), f == Format::BC7 ? Format::RGBA8 : f);
+        tex.generateMips();
+        if (f == Format::BC7)
+            tex.compress(f);
+        const float maxLod = float(tex.levels.size());
+
+        for (Sampler::Wrap wrap : {Sampler::Wrap::Repeat, Sampler::Wrap::Clamp,
+                                   Sampler::Wrap::Mirror})
+        {
+            for (Sampler::Filter filter : {Sampler::Filter::Nearest, Sampler::Filter::Bilinear})
+            {
+                for (Sampler::Mip mip :
+                     {Sampler::Mip::None, Sampler::Mip::Nearest, Sampler::Mip::Linear})
+                {
+                    const Sampler s{wrap, wrap, filter, mip};
+                    for (int round = 0; round < 8; round++)
+                    {
+                        float u[16], v[16], lod[16];
+                        for (int i = 0; i < 16; i++)
+                        {
+                            u[i] = uniform(-2.5f, 2.5f);
+                            v[i] = uniform(-2.5f, 2.5f);
+                            lod[i] = uniform(-1.0f, maxLod + 1.0f);
+                        }
+                        lod[0] = 0.0f; // whole levels: the trilinear shortcut
+                        lod[1] = 1.0f;
+
+                        core::Texels<8>  t8;
+                        core::Texels<16> t16;
+                        tex.sample8(s, u, v, lod, t8);
+                        tex.sample16(s, u, v, lod, t16);
+                        for (int i = 0; i < 16; i++)
+                        {
+                            const math::Vec4 e = tex.sampleLod(s, {u[i], v[i]}, lod[i]);
+                            const float      k = 1e-5f;
+                            CHECK(std::fabs(t16.r[i] - e.x) <= k &&
+                                  std::fabs(t16.g[i] - e.y) <= k &&
+                                  std::fabs(t16.b[i] - e.z) <= k &&
+                                  std::fabs(t16.a[i] - e.w) <= k);
+                            if (i < 8)
+                                CHECK(t8.r[i] == t16.r[i] && t8.g[i] == t16.g[i] &&
+                                      t8.b[i] == t16.b[i] && t8.a[i] == t16.a[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    test_storeTexel();
+    test_bcnRoundTrip();
+    test_compress();
+    test_sample8();
+    return failures;
+}
@@ -0,0 +1,87 @@
+﻿#include "check.h"
+#include "window.h"
+#include <cstring>
+
+// SDL's dummy video driver: runs headless, no display needed
+// every locked texture row holds the framebuffer's row, honouring the texture's pitch; the
+// width is off the micro-tile grid so a row ends inside a tile
+void test_loopDirect()
+{
+    constexpr int w = 66, h = 48;
+    window::Manager mgr;
+    const bool      created = mgr.create("test", w, h);
+    CHECK(created);
+    if (!created)
+        return;
+
+    core::FrameBuffer fb(w, h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            fb.writeRGBAUnchecked(x, y, {x / float(w), y / float(h), (x ^ y) / 127.0f, 1.0f});
+    const std::vector<uint8_t> linear = fb.linear();
+
+    int frames = 0;
+    mgr.loopDirect(
+        [&](float, window::Frame &frame)
+        {
+            CHECK(frame.width == w && frame.height == h && frame.channels == 4);
+            CHECK(frame.pitch >= w * 4);
+            fb.resolve(frame.pixels, frame.pitch);
+            int rows = 0;
+            for (int y = 0; y < h; y++)
+                rows += std::memcmp(frame.pixels + size_t(y) * frame.pitch, &linear[y * w * 4],
+                                    w * 4) == 0;
+            CHECK(rows == h);
+
+            // and the bytes are the written colors
+            uint8_t px[4];
+            core::FrameBuffer::encode({65 / float(w), 47 / float(h), (65 ^ 47) / 127.0f, 1.0f},
+                                      px);
+            CHECK(std::memcmp(frame.pixels + size_t(47) * frame.pitch + 65 * 4, px, 4) == 0);
+            return ++frames < 3;
+        });
+    CHECK(frames == 3);
+}
+
+// render() resolves into the texture at its pitch; SDL's software renderer (the dummy
+// driver's) locks the texture's own surface, so the next lock still holds those pixels
+void test_renderFrameBuffer()
+{
+    constexpr int w = 70, h = 30;
+    window::Manager mgr;
+    const bool      created = mgr.create("test", w, h);
+    CHECK(created);
+    if (!created)
+        return;
+
+    auto color = [](int x, int y) { return math::Vec4{x / 69.0f, y / 29.0f, 0.5f, 1.0f}; };
+    core::FrameBuffer fb(w, h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            fb.writeRGBAUnchecked(x, y, color(x, y));
+    mgr.render(fb);
+
+    int frames = 0;
+    mgr.loopDirect(
+        [&](float, window::Frame &frame)
+        {
+            for (int y : {0, 1, 7, 8, 29})
+                for (int x : {0, 31, 32, 69})
+                {
+                    uint8_t px[4];
+                    core::FrameBuffer::encode(color(x, y), px);
+                    CHECK(std::memcmp(frame.pixels + size_t(y) * frame.pitch + x * 4, px, 4) == 0);
+                }
+            ++frames;
+            return false;
+        });
+    CHECK(frames == 1);
+}
+
+int main()
+{
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    test_loopDirect();
+    test_renderFrameBuffer();
+    return failures;
+}